@@ -0,0 +1,382 @@
+/*
+ * Divergence Bisect Tool
+ * Compares two state-hash streams written by 'retroshield --hash-every',
+ * finds the first divergent checkpoint interval, then optionally re-runs
+ * just that interval for both sides from the nearest common snapshot with
+ * full tracing and reports the first differing instruction.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/wait.h>
+
+#include "snapshot.h"
+#include "statehash.h"
+#include "trace.h"
+#include "z80_disasm.h"
+
+typedef struct {
+    statehash_header hdr;
+    statehash_record *recs;
+    size_t count;
+} hash_stream;
+
+/* One side of the comparison */
+typedef struct {
+    const char *rom;
+    const char *snap_prefix;
+    const char *trace_out;
+    const char *input;
+    snapshot_run run;        /* Options of the original run, from its snapshot */
+    bool have_run;
+} side;
+
+static int load_stream(const char *path, hash_stream *s) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    if (fread(&s->hdr, sizeof(s->hdr), 1, f) != 1 ||
+        memcmp(s->hdr.magic, STATEHASH_MAGIC, sizeof(STATEHASH_MAGIC)) != 0) {
+        fprintf(stderr, "%s: not a state-hash stream\n", path);
+        fclose(f);
+        return -1;
+    }
+
+    size_t cap = 1024;
+    s->recs = malloc(cap * sizeof(statehash_record));
+    s->count = 0;
+    while (s->recs) {
+        if (s->count == cap) {
+            cap *= 2;
+            statehash_record *n = realloc(s->recs, cap * sizeof(statehash_record));
+            if (!n) break;
+            s->recs = n;
+        }
+        if (fread(&s->recs[s->count], sizeof(statehash_record), 1, f) != 1) break;
+        s->count++;
+    }
+    fclose(f);
+    return s->recs ? 0 : -1;
+}
+
+/* True if <prefix>.<n>.snap exists */
+static bool has_snapshot(const char *prefix, uint64_t n) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s.%llu.snap", prefix, (unsigned long long)n);
+    return access(path, R_OK) == 0;
+}
+
+/* Largest snapshot number <= limit that exists for every given prefix */
+static uint64_t common_snapshot(const char *prefix_a, const char *prefix_b, uint64_t limit) {
+    char dir[1024];
+    const char *base = strrchr(prefix_a, '/');
+    if (base) {
+        snprintf(dir, sizeof(dir), "%.*s", (int)(base - prefix_a), prefix_a);
+        base++;
+    } else {
+        snprintf(dir, sizeof(dir), ".");
+        base = prefix_a;
+    }
+
+    DIR *d = opendir(dir);
+    if (!d) return 0;
+
+    uint64_t best = 0;
+    size_t blen = strlen(base);
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        if (strncmp(de->d_name, base, blen) != 0 || de->d_name[blen] != '.') continue;
+        char *end;
+        unsigned long long n = strtoull(de->d_name + blen + 1, &end, 10);
+        if (strcmp(end, ".snap") != 0 || n > limit || n <= best) continue;
+        if (prefix_b && !has_snapshot(prefix_b, n)) continue;
+        best = n;
+    }
+    closedir(d);
+    return best;
+}
+
+/* Take the ROM, input and run options the snapshot recorded, where the
+ * command line did not give them */
+static void load_run_options(side *s, uint64_t snap) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s.%llu.snap", s->snap_prefix, (unsigned long long)snap);
+    if (snapshot_read_run(path, &s->run) < 0) return;
+    s->have_run = true;
+    if (!s->rom && s->run.rom[0]) s->rom = s->run.rom;
+    if (!s->input && s->run.input[0]) s->input = s->run.input;
+}
+
+/* Run the emulator over [snap, stop] with tracing; returns exit status */
+static int run_interval(const char *emu, const side *s, uint64_t snap, uint64_t stop) {
+    static const char *eof_names[] = {"idle", "stop", "poll"};
+    char snap_path[1024], stop_str[32], cyc_str[32], pace_str[32], port_str[16];
+    const char *input = s->input;
+    snprintf(snap_path, sizeof(snap_path), "%s.%llu.snap", s->snap_prefix ? s->snap_prefix : "",
+             (unsigned long long)snap);
+    snprintf(stop_str, sizeof(stop_str), "%llu", (unsigned long long)stop);
+
+    const char *argv[24];
+    int argc = 0;
+    argv[argc++] = emu;
+    if (snap > 0) {
+        argv[argc++] = "--restore";
+        argv[argc++] = snap_path;
+    }
+    if (s->have_run) {
+        const snapshot_run *r = &s->run;
+        if (r->max_cycles) {
+            snprintf(cyc_str, sizeof(cyc_str), "%llu", (unsigned long long)r->max_cycles);
+            argv[argc++] = "-c";
+            argv[argc++] = cyc_str;
+        }
+        if (r->rx_pace) {
+            snprintf(pace_str, sizeof(pace_str), "%u", r->rx_pace);
+            argv[argc++] = "--rx-pace";
+            argv[argc++] = pace_str;
+        }
+        if (r->eof_policy < 3) {
+            argv[argc++] = "--eof";
+            argv[argc++] = eof_names[r->eof_policy];
+        }
+        if (r->clock_port) {
+            snprintf(port_str, sizeof(port_str), "0x%02X", r->clock_port);
+            argv[argc++] = "--clock-port";
+            argv[argc++] = port_str;
+        }
+        if (r->storage[0]) {
+            argv[argc++] = "-s";
+            argv[argc++] = r->storage;
+        }
+    }
+    argv[argc++] = "--stop-instr";
+    argv[argc++] = stop_str;
+    argv[argc++] = "-t";
+    argv[argc++] = s->trace_out;
+    argv[argc++] = s->rom;
+    argv[argc] = NULL;
+
+    fprintf(stderr, "Running:");
+    for (int i = 0; i < argc; i++) fprintf(stderr, " %s", argv[i]);
+    fprintf(stderr, "%s%s\n", input ? " < " : "", input ? input : "");
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        int in = open(input ? input : "/dev/null", O_RDONLY);
+        int out = open("/dev/null", O_WRONLY);
+        if (in >= 0) dup2(in, STDIN_FILENO);
+        if (out >= 0) dup2(out, STDOUT_FILENO);
+        execvp(emu, (char *const *)argv);
+        perror(emu);
+        _exit(127);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0) return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static void print_record(const char *label, const trace_record *r) {
+    static uint8_t scratch[0x10000];
+    char buf[64];
+    for (int i = 0; i < 4; i++) scratch[(uint16_t)(r->pc + i)] = r->op[i];
+    z80_disasm(scratch, r->pc, buf, sizeof(buf));
+    printf("  %s: cyc %llu  %04X  %-20s", label, (unsigned long long)r->cyc, r->pc, buf);
+    for (int i = 0; i < r->nwrites; i++) {
+        printf(" [%04X]=%02X", r->waddr[i], r->wval[i]);
+    }
+    printf("\n");
+}
+
+/* Records match if they executed the same bytes with the same effects */
+static bool same_record(const trace_record *a, const trace_record *b) {
+    static uint8_t scratch[0x10000];
+    char buf[64];
+    if (a->cyc != b->cyc || a->pc != b->pc || a->flags != b->flags ||
+        a->nwrites != b->nwrites) {
+        return false;
+    }
+    for (int i = 0; i < a->nwrites; i++) {
+        if (a->waddr[i] != b->waddr[i] || a->wval[i] != b->wval[i]) return false;
+    }
+    for (int i = 0; i < 4; i++) scratch[(uint16_t)(a->pc + i)] = a->op[i];
+    int len = z80_disasm(scratch, a->pc, buf, sizeof(buf));
+    return memcmp(a->op, b->op, len < 4 ? len : 4) == 0;
+}
+
+/* Walk both traces in lockstep and report the first differing record */
+static int compare_traces(const char *path_a, const char *path_b) {
+    FILE *fa = fopen(path_a, "rb");
+    FILE *fb = fopen(path_b, "rb");
+    trace_header ha, hb;
+    if (!fa || !fb || fread(&ha, sizeof(ha), 1, fa) != 1 ||
+        fread(&hb, sizeof(hb), 1, fb) != 1) {
+        fprintf(stderr, "Failed to read interval traces\n");
+        if (fa) fclose(fa);
+        if (fb) fclose(fb);
+        return -1;
+    }
+
+    trace_record ra, rb, prev;
+    memset(&prev, 0, sizeof(prev));
+    uint64_t n = 0;
+    int result = 1;
+    for (;;) {
+        bool ga = fread(&ra, sizeof(ra), 1, fa) == 1;
+        bool gb = fread(&rb, sizeof(rb), 1, fb) == 1;
+        if (!ga || !gb) {
+            if (ga != gb) {
+                printf("Traces agree for %llu records, then one side ends\n",
+                       (unsigned long long)n);
+                result = 0;
+            } else {
+                printf("Traces agree over the whole interval (%llu records); "
+                       "divergence is in register state only\n", (unsigned long long)n);
+            }
+            break;
+        }
+        if (!same_record(&ra, &rb)) {
+            printf("First differing instruction (record %llu of interval):\n",
+                   (unsigned long long)n);
+            if (n > 0) print_record("prev", &prev);
+            print_record("A   ", &ra);
+            print_record("B   ", &rb);
+            result = 0;
+            break;
+        }
+        prev = ra;
+        n++;
+    }
+    fclose(fa);
+    fclose(fb);
+    return result;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] <a.hsh> <b.hsh>\n", prog);
+    fprintf(stderr, "  --rom-a ROM        ROM for side A (default: from the snapshot)\n");
+    fprintf(stderr, "  --rom-b ROM        ROM for side B (default: same as A)\n");
+    fprintf(stderr, "  --snap-a PREFIX    Snapshot prefix used for run A\n");
+    fprintf(stderr, "  --snap-b PREFIX    Snapshot prefix used for run B\n");
+    fprintf(stderr, "  --input FILE       Host input replayed to both runs\n");
+    fprintf(stderr, "  --emu PATH         Emulator binary (default: ./retroshield)\n");
+    fprintf(stderr, "ROM, input and run options default to those recorded in the snapshots.\n");
+    fprintf(stderr, "Exit status: 0 = no divergence, 2 = divergence found, 1 = error\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *paths[2] = {NULL, NULL};
+    int npaths = 0;
+    side a = {.trace_out = "bisect_a.trc"};
+    side b = {.trace_out = "bisect_b.trc"};
+    const char *input = NULL;
+    const char *emu = "./retroshield";
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--rom-a") == 0 && i + 1 < argc) a.rom = argv[++i];
+        else if (strcmp(argv[i], "--rom-b") == 0 && i + 1 < argc) b.rom = argv[++i];
+        else if (strcmp(argv[i], "--snap-a") == 0 && i + 1 < argc) a.snap_prefix = argv[++i];
+        else if (strcmp(argv[i], "--snap-b") == 0 && i + 1 < argc) b.snap_prefix = argv[++i];
+        else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) input = argv[++i];
+        else if (strcmp(argv[i], "--emu") == 0 && i + 1 < argc) emu = argv[++i];
+        else if (argv[i][0] != '-' && npaths < 2) paths[npaths++] = argv[i];
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (npaths != 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    hash_stream sa, sb;
+    if (load_stream(paths[0], &sa) < 0 || load_stream(paths[1], &sb) < 0) {
+        return 1;
+    }
+    if (sa.hdr.every != sb.hdr.every) {
+        fprintf(stderr, "Streams use different intervals (%llu vs %llu)\n",
+                (unsigned long long)sa.hdr.every, (unsigned long long)sb.hdr.every);
+        return 1;
+    }
+
+    /* Merge by instruction count so a stream resumed from a snapshot lines up */
+    size_t i = 0, j = 0, matched = 0;
+    uint64_t lo = 0, lo_cyc = 0;
+    bool diverged = false;
+    while (i < sa.count && j < sb.count) {
+        const statehash_record *ra = &sa.recs[i], *rb = &sb.recs[j];
+        if (ra->instructions < rb->instructions) { i++; continue; }
+        if (ra->instructions > rb->instructions) { j++; continue; }
+        if (ra->hash != rb->hash) {
+            diverged = true;
+            break;
+        }
+        lo = ra->instructions;
+        lo_cyc = ra->cyc;
+        matched++;
+        i++;
+        j++;
+    }
+
+    if (!diverged) {
+        printf("No divergence in %zu common checkpoints", matched);
+        if (i < sa.count || j < sb.count) {
+            printf(" (%s runs longer)", i < sa.count ? "A" : "B");
+        }
+        printf("\n");
+        return 0;
+    }
+
+    uint64_t hi = sa.recs[i].instructions;
+    printf("First divergent interval: instructions %llu..%llu "
+           "(cycles %llu..%llu / %llu)\n",
+           (unsigned long long)lo, (unsigned long long)hi,
+           (unsigned long long)lo_cyc, (unsigned long long)sa.recs[i].cyc,
+           (unsigned long long)sb.recs[j].cyc);
+
+    uint64_t snap = 0;
+    if (a.snap_prefix) {
+        snap = common_snapshot(a.snap_prefix, b.snap_prefix ? b.snap_prefix : a.snap_prefix, lo);
+    }
+    if (!b.snap_prefix) b.snap_prefix = a.snap_prefix;
+    a.input = b.input = input;
+    if (snap > 0) {
+        load_run_options(&a, snap);
+        load_run_options(&b, snap);
+    }
+    if (!a.rom) return 2;
+    if (!b.rom) b.rom = a.rom;
+    if (snap > 0) {
+        printf("Re-running from snapshot at instruction %llu\n", (unsigned long long)snap);
+    } else {
+        printf("No snapshot at or before %llu; re-running from reset\n", (unsigned long long)lo);
+    }
+    fflush(stdout);
+
+    if (run_interval(emu, &a, snap, hi) != 0 ||
+        run_interval(emu, &b, snap, hi) != 0) {
+        fprintf(stderr, "Interval re-run failed\n");
+        return 1;
+    }
+
+    compare_traces(a.trace_out, b.trace_out);
+    return 2;
+}
@@ -0,0 +1,157 @@
+/*
+ * Branch Trace
+ * The reader rebuilds absolute cycles and IN_SAME values from the same
+ * state the writer keeps; a process is one or the other, never both.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <string.h>
+#include "btrace.h"
+
+#define DELTA_INLINE 31
+
+bool btrace_enabled = false;
+unsigned long btrace_step_cyc = 0;
+
+static FILE *out = NULL;
+static uint64_t last_cyc = 0;
+static uint8_t last_in[256];
+static bool seen_in[256];
+
+static void put_leb(uint64_t v) {
+    while (v >= 0x80) {
+        putc((int)(v & 0x7F) | 0x80, out);
+        v >>= 7;
+    }
+    putc((int)v, out);
+}
+
+static void put_head(int type, uint64_t cyc) {
+    uint64_t delta = cyc - last_cyc;
+    last_cyc = cyc;
+    if (delta < DELTA_INLINE) {
+        putc(type << 5 | (int)delta, out);
+    } else {
+        putc(type << 5 | DELTA_INLINE, out);
+        put_leb(delta - DELTA_INLINE);
+    }
+}
+
+int btrace_open(const char *path, uint16_t rom_size, uint64_t cyc, uint64_t instr) {
+    out = fopen(path, "wb");
+    if (!out) {
+        perror("Failed to open branch trace");
+        return -1;
+    }
+    setvbuf(out, NULL, _IOFBF, 1 << 20);
+
+    btrace_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, BTRACE_MAGIC, sizeof(BTRACE_MAGIC));
+    h.version = BTRACE_VERSION;
+    h.rom_size = rom_size;
+    h.start_cyc = cyc;
+    h.start_instr = instr;
+    fwrite(&h, sizeof(h), 1, out);
+
+    last_cyc = cyc;
+    btrace_enabled = true;
+    return 0;
+}
+
+void btrace_branch(uint16_t target) {
+    put_head(BTR_BRANCH, btrace_step_cyc);
+    putc(target & 0xFF, out);
+}
+
+void btrace_in(uint8_t port, uint8_t val) {
+    if (seen_in[port] && last_in[port] == val) {
+        put_head(BTR_IN_SAME, btrace_step_cyc);
+        putc(port, out);
+        return;
+    }
+    put_head(BTR_IN, btrace_step_cyc);
+    putc(port, out);
+    putc(val, out);
+    seen_in[port] = true;
+    last_in[port] = val;
+}
+
+void btrace_int(unsigned long cyc, uint8_t data) {
+    put_head(BTR_INT, cyc);
+    putc(data, out);
+}
+
+void btrace_close(unsigned long cyc, uint64_t instr) {
+    if (!btrace_enabled) return;
+    btrace_enabled = false;
+    put_head(BTR_END, cyc);
+    put_leb(instr);
+    fclose(out);
+    out = NULL;
+}
+
+int btrace_read_header(FILE *f, btrace_header *h) {
+    if (fread(h, sizeof(*h), 1, f) != 1 ||
+        memcmp(h->magic, BTRACE_MAGIC, sizeof(BTRACE_MAGIC)) != 0 ||
+        h->version != BTRACE_VERSION) {
+        return -1;
+    }
+    last_cyc = h->start_cyc;
+    memset(seen_in, 0, sizeof(seen_in));
+    return 0;
+}
+
+static int get_leb(FILE *f, uint64_t *v) {
+    *v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = getc(f);
+        if (c == EOF) return -1;
+        *v |= (uint64_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) return 0;
+    }
+    return -1;
+}
+
+int btrace_read(FILE *f, btrace_packet *p) {
+    int c = getc(f);
+    if (c == EOF) return 0;
+
+    uint64_t delta = c & DELTA_INLINE;
+    if (delta == DELTA_INLINE) {
+        uint64_t more;
+        if (get_leb(f, &more) < 0) return -1;
+        delta += more;
+    }
+    last_cyc += delta;
+    p->type = c >> 5;
+    p->cyc = last_cyc;
+
+    int a, b;
+    switch (p->type) {
+    case BTR_BRANCH:
+    case BTR_INT:
+        if ((a = getc(f)) == EOF) return -1;
+        p->val = (uint8_t)a;
+        return 1;
+    case BTR_IN:
+        if ((a = getc(f)) == EOF || (b = getc(f)) == EOF) return -1;
+        p->port = (uint8_t)a;
+        p->val = (uint8_t)b;
+        seen_in[p->port] = true;
+        last_in[p->port] = p->val;
+        return 1;
+    case BTR_IN_SAME:
+        if ((a = getc(f)) == EOF) return -1;
+        p->port = (uint8_t)a;
+        if (!seen_in[p->port]) return -1;
+        p->val = last_in[p->port];
+        return 1;
+    case BTR_END:
+        return get_leb(f, &p->instr) < 0 ? -1 : 1;
+    default:
+        return -1;
+    }
+}
@@ -0,0 +1,77 @@
+/*
+ * Branch Trace - Header
+ * Compact trace of only what re-execution cannot reproduce or needs for
+ * sync: taken non-sequential control flow, interrupt requests and port
+ * input values, each stamped with a cycle delta. Replaying the ROM against
+ * the trace (retroshield_replay) recovers every instruction.
+ *
+ * Packet: one byte of type (bits 7-5) and cycle delta (bits 4-0; 31 means
+ * a LEB128 delta - 31 follows), then a type-specific payload:
+ *   BTR_BRANCH   low byte of the new PC
+ *   BTR_IN       port, value
+ *   BTR_IN_SAME  port (value equals that port's previous input)
+ *   BTR_INT      data byte passed to z80_gen_int()
+ *   BTR_END      LEB128 instruction count
+ * The delta is measured between the cycle counts the packets refer to: the
+ * start of the instruction for BRANCH and IN, the instruction boundary at
+ * which the interrupt was raised for INT, the final cycle for END.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef BTRACE_H
+#define BTRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BTRACE_MAGIC   "Z80BTR1"
+#define BTRACE_VERSION 1
+
+enum { BTR_BRANCH = 1, BTR_IN, BTR_IN_SAME, BTR_INT, BTR_END };
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint16_t rom_size;
+    uint16_t reserved;
+    uint64_t start_cyc;      /* cpu.cyc when recording began */
+    uint64_t start_instr;    /* Instruction count when recording began */
+} btrace_header;
+
+typedef struct {
+    int type;
+    uint64_t cyc;            /* Absolute, rebuilt from the deltas */
+    uint8_t port;
+    uint8_t val;             /* BRANCH: PC low byte; IN: value; INT: data */
+    uint64_t instr;          /* END only */
+} btrace_packet;
+
+/* PC moved somewhere other than the next 1-4 bytes. Self-loops (LDIR,
+ * DJNZ $) and short forward skips are left to re-execution. */
+static inline bool btrace_is_branch(uint16_t from, uint16_t to) {
+    return to < from || to > from + 4;
+}
+
+/* Writer */
+extern bool btrace_enabled;
+extern unsigned long btrace_step_cyc;   /* Start of the current instruction */
+
+int btrace_open(const char *path, uint16_t rom_size, uint64_t cyc, uint64_t instr);
+void btrace_branch(uint16_t target);
+void btrace_in(uint8_t port, uint8_t val);
+void btrace_int(unsigned long cyc, uint8_t data);
+void btrace_close(unsigned long cyc, uint64_t instr);
+
+/* After z80_step() */
+static inline void btrace_step(uint16_t from, uint16_t to) {
+    if (btrace_is_branch(from, to)) btrace_branch(to);
+}
+
+/* Reader: returns 1 with a packet, 0 at end of file, -1 on a bad packet */
+int btrace_read_header(FILE *f, btrace_header *h);
+int btrace_read(FILE *f, btrace_packet *p);
+
+#endif /* BTRACE_H */
@@ -0,0 +1,231 @@
+/*
+ * Branch Trace Replay Tool
+ * Rebuilds the full instruction path of a run recorded with
+ * 'retroshield --branch-trace' by re-executing the ROM. Port input and
+ * interrupts come from the trace; every recorded branch is checked against
+ * the replay, so a wrong ROM or snapshot is caught at the first divergence.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "z80.h"
+#include "z80_disasm.h"
+#include "snapshot.h"
+#include "btrace.h"
+
+#define MEM_SIZE 0x10000
+#define FULL_RECORD_SIZE 24   /* sizeof(trace_record), for comparison */
+
+static uint8_t memory[MEM_SIZE];
+static uint16_t rom_size;
+static z80 cpu;
+
+static FILE *trace_f;
+static btrace_packet pkt;
+static bool have_pkt = false;
+static uint64_t npackets = 0;
+static unsigned long step_cyc;
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] <rom.bin> <trace.btr>\n", prog);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -r SNAP            Start from snapshot (run was recorded after --restore)\n");
+    fprintf(stderr, "  -v                 Print registers before each instruction\n");
+    fprintf(stderr, "  -q                 Verify only; print the summary\n");
+    fprintf(stderr, "  --from CYC         Print instructions from cycle CYC\n");
+    fprintf(stderr, "  -n COUNT           Print at most COUNT instructions (0 = all)\n");
+}
+
+static void next_packet(void) {
+    int r = btrace_read(trace_f, &pkt);
+    if (r < 0) {
+        fprintf(stderr, "Corrupt branch trace after %llu packets\n",
+                (unsigned long long)npackets);
+        exit(1);
+    }
+    have_pkt = r > 0;
+    if (have_pkt) npackets++;
+}
+
+static void diverged(const char *what) {
+    fprintf(stderr, "Replay diverged at cycle %lu, PC=%04X: %s", step_cyc, cpu.pc, what);
+    if (have_pkt) {
+        fprintf(stderr, " (next packet: type %d at cycle %llu)", pkt.type,
+                (unsigned long long)pkt.cyc);
+    }
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+static uint8_t mem_read(void *userdata, uint16_t addr) {
+    (void)userdata;
+    return memory[addr];
+}
+
+static void mem_write(void *userdata, uint16_t addr, uint8_t val) {
+    (void)userdata;
+    if (addr >= rom_size) memory[addr] = val;
+}
+
+static uint8_t port_in(z80 *z, uint8_t port) {
+    (void)z;
+    if (!have_pkt || (pkt.type != BTR_IN && pkt.type != BTR_IN_SAME) ||
+        pkt.cyc != step_cyc || pkt.port != port) {
+        diverged("port input not in trace");
+    }
+    uint8_t val = pkt.val;
+    next_packet();
+    return val;
+}
+
+static void port_out(z80 *z, uint8_t port, uint8_t val) {
+    (void)z;
+    (void)port;
+    (void)val;
+}
+
+static void print_step(bool regs) {
+    char buf[64];
+    char bytes[16] = "";
+    int len = z80_disasm(memory, cpu.pc, buf, sizeof(buf));
+    for (int i = 0; i < len && i < 4; i++) {
+        snprintf(bytes + i * 3, sizeof(bytes) - i * 3, "%02X ", memory[(uint16_t)(cpu.pc + i)]);
+    }
+    printf("%12lu  %04X  %-11s %-20s", cpu.cyc, cpu.pc, bytes, buf);
+    if (regs) {
+        uint8_t f = cpu.sf << 7 | cpu.zf << 6 | cpu.yf << 5 | cpu.hf << 4 |
+                    cpu.xf << 3 | cpu.pf << 2 | cpu.nf << 1 | cpu.cf;
+        printf(" AF=%02X%02X BC=%02X%02X DE=%02X%02X HL=%02X%02X SP=%04X IX=%04X IY=%04X",
+               cpu.a, f, cpu.b, cpu.c, cpu.d, cpu.e, cpu.h, cpu.l, cpu.sp, cpu.ix, cpu.iy);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *snap_path = NULL;
+    const char *rom_path = NULL, *trace_path = NULL;
+    bool regs = false, quiet = false;
+    uint64_t from = 0;
+    unsigned long limit = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            snap_path = argv[++i];
+        } else if (strcmp(argv[i], "-v") == 0) {
+            regs = true;
+        } else if (strcmp(argv[i], "-q") == 0) {
+            quiet = true;
+        } else if (strcmp(argv[i], "--from") == 0 && i + 1 < argc) {
+            from = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            limit = strtoul(argv[++i], NULL, 0);
+        } else if (argv[i][0] != '-' && !rom_path) {
+            rom_path = argv[i];
+        } else if (argv[i][0] != '-' && !trace_path) {
+            trace_path = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!rom_path || !trace_path) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    trace_f = fopen(trace_path, "rb");
+    if (!trace_f) {
+        perror("Failed to open branch trace");
+        return 1;
+    }
+    btrace_header h;
+    if (btrace_read_header(trace_f, &h) < 0) {
+        fprintf(stderr, "%s: not a branch trace\n", trace_path);
+        return 1;
+    }
+    rom_size = h.rom_size;
+
+    FILE *f = fopen(rom_path, "rb");
+    if (!f) {
+        perror("Failed to open ROM file");
+        return 1;
+    }
+    size_t bytes = fread(memory, 1, MEM_SIZE, f);
+    fclose(f);
+    if (bytes == 0) {
+        fprintf(stderr, "Failed to read ROM file\n");
+        return 1;
+    }
+
+    z80_init(&cpu);
+    cpu.read_byte = mem_read;
+    cpu.write_byte = mem_write;
+    cpu.port_in = port_in;
+    cpu.port_out = port_out;
+
+    uint64_t instr = 0;
+    if (snap_path) {
+        snapshot_extra extra;
+        if (snapshot_load(snap_path, &cpu, memory, &extra) < 0) {
+            return 1;
+        }
+        instr = extra.instructions;
+    }
+    if (cpu.cyc != h.start_cyc || instr != h.start_instr) {
+        fprintf(stderr, "Trace starts at cycle %llu, instruction %llu; replay is at %lu, %llu%s\n",
+                (unsigned long long)h.start_cyc, (unsigned long long)h.start_instr,
+                cpu.cyc, (unsigned long long)instr, snap_path ? "" : " (need -r?)");
+        return 1;
+    }
+
+    unsigned long printed = 0;
+    next_packet();
+    while (1) {
+        step_cyc = cpu.cyc;
+        while (have_pkt && pkt.type == BTR_INT && pkt.cyc == step_cyc) {
+            z80_gen_int(&cpu, pkt.val);
+            next_packet();
+        }
+        if (!have_pkt) diverged("trace ends without an end packet");
+        if (pkt.type == BTR_END && pkt.cyc == step_cyc) break;
+        if (pkt.cyc < step_cyc) diverged("replay passed a trace packet");
+
+        if (!quiet && step_cyc >= from && (limit == 0 || printed < limit)) {
+            print_step(regs);
+            printed++;
+        }
+
+        uint16_t pc = cpu.pc;
+        z80_step(&cpu);
+        instr++;
+
+        if (btrace_is_branch(pc, cpu.pc)) {
+            if (pkt.type != BTR_BRANCH || pkt.cyc != step_cyc || pkt.val != (cpu.pc & 0xFF)) {
+                diverged("branch not in trace");
+            }
+            next_packet();
+        }
+    }
+
+    if (instr != pkt.instr) {
+        fprintf(stderr, "Replay ran %llu instructions, trace recorded %llu\n",
+                (unsigned long long)instr, (unsigned long long)pkt.instr);
+        return 1;
+    }
+
+    long trace_bytes = ftell(trace_f);
+    uint64_t ran = instr - h.start_instr;
+    fprintf(stderr, "Replayed %llu instructions to cycle %lu from %llu packets\n",
+            (unsigned long long)ran, cpu.cyc, (unsigned long long)npackets);
+    fprintf(stderr, "Trace %ld bytes, %.3f bytes/instruction (full trace: %d)\n",
+            trace_bytes, ran ? (double)trace_bytes / ran : 0.0, FULL_RECORD_SIZE);
+    fclose(trace_f);
+    return 0;
+}
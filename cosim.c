@@ -0,0 +1,459 @@
+/*
+ * Multi-Machine Co-Simulation
+ * Runs several RetroShield machines in one process, each on its own
+ * thread, with chosen serial lines wired together as null-modem pairs
+ * (one machine's TX is the other's RX).
+ *
+ * Time advances in quanta of Q cycles. Every machine runs to the end of
+ * the current quantum, then waits at a barrier; the last thread to arrive
+ * moves the bytes sent during the quantum onto the receiving side of each
+ * link and opens the next quantum. A byte sent at cycle t is stamped t + Q
+ * and the receiver only sees it once its own cycle counter reaches the
+ * stamp. A byte sent in one quantum can therefore never be due inside that
+ * same quantum, so no machine can miss a byte because its peer is on a
+ * slower thread, and the outcome depends only on the ROMs, the input and Q,
+ * not on scheduling or core count.
+ *
+ * A machine has one serial line (ACIA and 8251 share it, as in machine.c),
+ * so a link joins two machines; an unlinked machine can be given input
+ * with -i, queued in full before the first quantum.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "machine.h"
+
+#define MAX_MACHINES   64
+#define DEFAULT_QUANTUM 4000      /* ~1 ms at 4 MHz, about one byte at 9600 baud */
+#define MAX_EXPECT     255
+
+typedef struct {
+    unsigned long at;             /* Receiver cycle from which the byte is visible */
+    uint8_t c;
+} stamped;
+
+typedef struct {
+    stamped *v;
+    size_t len, cap, pos;         /* pos = next unread entry */
+} stamp_queue;
+
+typedef struct {
+    const char *rom;
+    machine *m;
+    int peer;                     /* Linked machine, -1 = none */
+    pthread_t thread;
+
+    stamp_queue outbox;           /* Sent this quantum; only this thread writes */
+    stamp_queue inbox;            /* From the peer; refilled at the barrier */
+
+    FILE *log;                    /* -o transcript */
+    bool show;                    /* Copy TX to stdout */
+    char *shown;                  /* TX since the last barrier, for stdout */
+    size_t shown_len, shown_cap;
+
+    uint64_t tx_bytes, rx_bytes;
+    uint64_t tx_hash;             /* FNV-1a of everything transmitted */
+
+    const char *expect;
+    size_t expect_len;
+    char tail[MAX_EXPECT];        /* Last expect_len bytes sent */
+    size_t tail_len;
+    bool expect_seen;
+} node;
+
+static node nodes[MAX_MACHINES];
+static int node_count;
+static unsigned long quantum = DEFAULT_QUANTUM;
+static unsigned long max_cycles;
+static unsigned long window_end;
+static uint64_t windows;
+static bool stop;
+
+/* Barrier; the last thread in runs end_of_quantum() before releasing */
+static pthread_mutex_t bar_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bar_cond = PTHREAD_COND_INITIALIZER;
+static int bar_waiting;
+static unsigned long bar_gen;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int sq_push(stamp_queue *q, unsigned long at, uint8_t c) {
+    if (q->len == q->cap) {
+        size_t cap = q->cap ? q->cap * 2 : 256;
+        stamped *v = realloc(q->v, cap * sizeof(stamped));
+        if (!v) return -1;
+        q->v = v;
+        q->cap = cap;
+    }
+    q->v[q->len].at = at;
+    q->v[q->len].c = c;
+    q->len++;
+    return 0;
+}
+
+static bool link_ready(void *ctx, unsigned long cyc) {
+    node *n = ctx;
+    return n->inbox.pos < n->inbox.len && n->inbox.v[n->inbox.pos].at <= cyc;
+}
+
+static uint8_t link_take(void *ctx) {
+    node *n = ctx;
+    n->rx_bytes++;
+    return n->inbox.v[n->inbox.pos++].c;
+}
+
+static void on_tx(void *ctx, uint8_t c) {
+    node *n = ctx;
+
+    n->tx_bytes++;
+    n->tx_hash = (n->tx_hash ^ c) * 0x100000001b3ULL;
+    if (n->peer >= 0 && sq_push(&n->outbox, n->m->cpu.cyc + quantum, c) < 0) {
+        perror("cosim");
+        exit(1);
+    }
+    if (n->log) fputc(c, n->log);
+    if (n->show) {
+        if (n->shown_len == n->shown_cap) {
+            size_t cap = n->shown_cap ? n->shown_cap * 2 : 4096;
+            char *s = realloc(n->shown, cap);
+            if (!s) {
+                perror("cosim");
+                exit(1);
+            }
+            n->shown = s;
+            n->shown_cap = cap;
+        }
+        n->shown[n->shown_len++] = (char)c;
+    }
+    if (n->expect && !n->expect_seen) {
+        if (n->tail_len == n->expect_len) {
+            memmove(n->tail, n->tail + 1, n->tail_len - 1);
+            n->tail_len--;
+        }
+        n->tail[n->tail_len++] = (char)c;
+        if (n->tail_len == n->expect_len && memcmp(n->tail, n->expect, n->expect_len) == 0) {
+            n->expect_seen = true;
+        }
+    }
+}
+
+/* Cycle at which the next input byte can be read; ULONG_MAX if none */
+static unsigned long next_due(const node *n) {
+    if (n->peer >= 0) {
+        return n->inbox.pos < n->inbox.len ? n->inbox.v[n->inbox.pos].at : ULONG_MAX;
+    }
+    return machine_rx_pending(n->m) > 0 ? n->m->cpu.cyc : ULONG_MAX;
+}
+
+/* Run to 'until'. A HALT that input can end is still time passing: the
+ * CPU's cycle moves on to the next byte's stamp (or the window end) so
+ * the byte becomes visible and raises the interrupt that wakes it. */
+static void run_window(node *n, unsigned long until) {
+    machine *m = n->m;
+    while (m->cpu.cyc < until) {
+        if (m->cpu.halted) {
+            if (!machine_can_wake(m)) break;
+            unsigned long due = next_due(n);
+            if (due >= until) {
+                m->cpu.cyc = until;
+                break;
+            }
+            if (due > m->cpu.cyc) m->cpu.cyc = due;
+        }
+        if (machine_run(m, until) == 0 && m->cpu.halted) {
+            /* Its interrupt is already pending; nothing more happens this window */
+            m->cpu.cyc = until;
+            break;
+        }
+    }
+}
+
+/* Runs with every other thread parked at the barrier */
+static void end_of_quantum(void) {
+    bool all_halted = true, expect_seen = false;
+
+    for (int i = 0; i < node_count; i++) {
+        node *n = &nodes[i];
+        if (n->peer >= 0) {
+            stamp_queue *in = &nodes[n->peer].inbox;
+            /* Drop what the peer has consumed, then append */
+            memmove(in->v, in->v + in->pos, (in->len - in->pos) * sizeof(stamped));
+            in->len -= in->pos;
+            in->pos = 0;
+            for (size_t k = 0; k < n->outbox.len; k++) {
+                if (sq_push(in, n->outbox.v[k].at, n->outbox.v[k].c) < 0) {
+                    perror("cosim");
+                    exit(1);
+                }
+            }
+            n->outbox.len = 0;
+        }
+        if (n->shown_len) {
+            fwrite(n->shown, 1, n->shown_len, stdout);
+            n->shown_len = 0;
+        }
+        if (n->expect_seen) expect_seen = true;
+    }
+    fflush(stdout);
+
+    /* All halted ends the run only if no HALT can be ended by input */
+    for (int i = 0; i < node_count; i++) {
+        const node *n = &nodes[i];
+        if (!n->m->cpu.halted || (machine_can_wake(n->m) && next_due(n) != ULONG_MAX)) {
+            all_halted = false;
+        }
+    }
+
+    windows++;
+    if (all_halted || expect_seen || (max_cycles && window_end >= max_cycles)) stop = true;
+    window_end += quantum;
+}
+
+static void barrier(void) {
+    pthread_mutex_lock(&bar_lock);
+    if (++bar_waiting == node_count) {
+        end_of_quantum();
+        bar_waiting = 0;
+        bar_gen++;
+        pthread_cond_broadcast(&bar_cond);
+    } else {
+        unsigned long gen = bar_gen;
+        while (gen == bar_gen) pthread_cond_wait(&bar_cond, &bar_lock);
+    }
+    pthread_mutex_unlock(&bar_lock);
+}
+
+static void *machine_thread(void *arg) {
+    node *n = arg;
+
+    for (;;) {
+        /* stop and window_end only change inside the barrier */
+        pthread_mutex_lock(&bar_lock);
+        bool done = stop;
+        unsigned long until = window_end;
+        pthread_mutex_unlock(&bar_lock);
+        if (done) break;
+
+        if (max_cycles && until > max_cycles) until = max_cycles;
+        run_window(n, until);
+        barrier();
+    }
+    return NULL;
+}
+
+static int parse_pair(const char *s, int *a, char sep, const char **rest) {
+    char *end;
+    long v = strtol(s, &end, 10);
+    if (end == s || *end != sep || v < 0 || v >= MAX_MACHINES) return -1;
+    *a = (int)v;
+    *rest = end + 1;
+    return 0;
+}
+
+static int load_input(node *n, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    uint8_t buf[4096];
+    size_t got;
+    while ((got = fread(buf, 1, sizeof(buf), f)) > 0) {
+        if (machine_feed(n->m, buf, got) != got) {
+            fprintf(stderr, "%s: input queue full\n", path);
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] <rom0> <rom1> ...\n", prog);
+    fprintf(stderr, "Machines are numbered from 0 in the order their ROMs are given.\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -l A:B          Null-modem link between machines A and B\n");
+    fprintf(stderr, "  -q CYCLES       Quantum, also the link latency (default %d)\n", DEFAULT_QUANTUM);
+    fprintf(stderr, "  -c CYCLES       Stop every machine at CYCLES\n");
+    fprintf(stderr, "  -i M:FILE       Queue FILE as input to unlinked machine M\n");
+    fprintf(stderr, "  -o DIR          Write machine M's output to DIR/mM.log\n");
+    fprintf(stderr, "  -s M            Copy machine M's output to stdout\n");
+    fprintf(stderr, "  -e M:TEXT       Stop at the end of the quantum in which machine M\n");
+    fprintf(stderr, "                  has sent TEXT\n");
+    fprintf(stderr, "Runs until every machine halts, -c is reached or -e matches.\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *roms[MAX_MACHINES];
+    const char *inputs[MAX_MACHINES] = {0};
+    int links[MAX_MACHINES][2], link_count = 0;
+    int shows[MAX_MACHINES], show_count = 0;
+    const char *log_dir = NULL;
+    const char *expect = NULL;
+    int expect_node = -1;
+    int rom_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *rest;
+        int a, b;
+        if (strcmp(argv[i], "-l") == 0 && i + 1 < argc && link_count < MAX_MACHINES) {
+            if (parse_pair(argv[++i], &a, ':', &rest) < 0 || parse_pair(rest, &b, '\0', &rest) < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            links[link_count][0] = a;
+            links[link_count][1] = b;
+            link_count++;
+        } else if (strcmp(argv[i], "-q") == 0 && i + 1 < argc) {
+            quantum = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            max_cycles = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            if (parse_pair(argv[++i], &a, ':', &rest) < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            inputs[a] = rest;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            log_dir = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc && show_count < MAX_MACHINES) {
+            shows[show_count++] = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            if (parse_pair(argv[++i], &expect_node, ':', &expect) < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (argv[i][0] != '-' && rom_count < MAX_MACHINES) {
+            roms[rom_count++] = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (rom_count == 0 || quantum == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (expect && (strlen(expect) == 0 || strlen(expect) > MAX_EXPECT)) {
+        fprintf(stderr, "cosim: expect text must be 1-%d bytes\n", MAX_EXPECT);
+        return 1;
+    }
+
+    node_count = rom_count;
+    for (int i = 0; i < node_count; i++) {
+        nodes[i].rom = roms[i];
+        nodes[i].peer = -1;
+        nodes[i].tx_hash = 0xcbf29ce484222325ULL;
+        nodes[i].m = machine_create(roms[i]);
+        if (!nodes[i].m) return 1;
+        nodes[i].m->tx = on_tx;
+        nodes[i].m->tx_ctx = &nodes[i];
+    }
+
+    for (int k = 0; k < link_count; k++) {
+        int a = links[k][0], b = links[k][1];
+        if (a >= node_count || b >= node_count || a == b) {
+            fprintf(stderr, "cosim: bad link %d:%d\n", a, b);
+            return 1;
+        }
+        if (nodes[a].peer >= 0 || nodes[b].peer >= 0) {
+            fprintf(stderr, "cosim: machine %d already linked\n", nodes[a].peer >= 0 ? a : b);
+            return 1;
+        }
+        nodes[a].peer = b;
+        nodes[b].peer = a;
+        nodes[a].m->rx_src = (machine_rx_source){link_ready, link_take, &nodes[a]};
+        nodes[b].m->rx_src = (machine_rx_source){link_ready, link_take, &nodes[b]};
+    }
+
+    for (int i = 0; i < MAX_MACHINES; i++) {
+        if (!inputs[i]) continue;
+        if (i >= node_count || nodes[i].peer >= 0) {
+            fprintf(stderr, "cosim: -i needs an unlinked machine (got %d)\n", i);
+            return 1;
+        }
+        if (load_input(&nodes[i], inputs[i]) < 0) return 1;
+    }
+    for (int k = 0; k < show_count; k++) {
+        if (shows[k] < 0 || shows[k] >= node_count) {
+            fprintf(stderr, "cosim: no machine %d\n", shows[k]);
+            return 1;
+        }
+        nodes[shows[k]].show = true;
+    }
+    if (expect) {
+        if (expect_node >= node_count) {
+            fprintf(stderr, "cosim: no machine %d\n", expect_node);
+            return 1;
+        }
+        nodes[expect_node].expect = expect;
+        nodes[expect_node].expect_len = strlen(expect);
+    }
+    if (log_dir) {
+        for (int i = 0; i < node_count; i++) {
+            char path[4096];
+            snprintf(path, sizeof(path), "%s/m%d.log", log_dir, i);
+            if (!(nodes[i].log = fopen(path, "wb"))) {
+                perror(path);
+                return 1;
+            }
+        }
+    }
+
+    window_end = quantum;
+    double start = now_sec();
+    for (int i = 0; i < node_count; i++) {
+        if (pthread_create(&nodes[i].thread, NULL, machine_thread, &nodes[i]) != 0) {
+            perror("pthread_create");
+            return 1;
+        }
+    }
+    for (int i = 0; i < node_count; i++) pthread_join(nodes[i].thread, NULL);
+    double wall = now_sec() - start;
+
+    unsigned long total = 0;
+    fprintf(stderr, "\n%-3s %-20s %4s %14s %12s %8s %8s %-16s %s\n",
+            "#", "rom", "peer", "cycles", "instr", "tx", "rx", "tx hash", "state");
+    for (int i = 0; i < node_count; i++) {
+        node *n = &nodes[i];
+        const char *base = strrchr(n->rom, '/');
+        char peer[12] = "-";
+        if (n->peer >= 0) snprintf(peer, sizeof(peer), "%d", n->peer);
+        fprintf(stderr, "%-3d %-20s %4s %14lu %12llu %8llu %8llu %016llx %s\n",
+                i, base ? base + 1 : n->rom, peer, n->m->cpu.cyc,
+                (unsigned long long)n->m->instructions,
+                (unsigned long long)n->tx_bytes, (unsigned long long)n->rx_bytes,
+                (unsigned long long)n->tx_hash, n->m->cpu.halted ? "halted" : "running");
+        total += n->m->cpu.cyc;
+        if (n->log) fclose(n->log);
+    }
+    fprintf(stderr, "%llu quanta of %lu cycles, %.1f ms, %.2f MHz aggregate%s\n",
+            (unsigned long long)windows, quantum, wall * 1000.0,
+            wall > 0 ? total / wall / 1e6 : 0.0,
+            expect && nodes[expect_node].expect_seen ? ", expect matched" : "");
+
+    for (int i = 0; i < node_count; i++) {
+        free(nodes[i].outbox.v);
+        free(nodes[i].inbox.v);
+        free(nodes[i].shown);
+        machine_destroy(nodes[i].m);
+    }
+    return expect && !nodes[expect_node].expect_seen ? 1 : 0;
+}
@@ -0,0 +1,76 @@
+/*
+ * Published CPU State
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <string.h>
+#include "cpuview.h"
+
+void cpuview_init(cpuview *v) {
+    memset(v, 0, sizeof(*v));
+}
+
+void cpuview_publish(cpuview *v, const z80 *cpu) {
+    cpu_view s;
+    uint32_t w[CPUVIEW_WORDS] = {0};
+
+    memset(&s, 0, sizeof(s));
+    s.cyc = cpu->cyc;
+    s.pc = cpu->pc;
+    s.sp = cpu->sp;
+    s.ix = cpu->ix;
+    s.iy = cpu->iy;
+    s.a = cpu->a;
+    s.f = (cpu->sf << 7) | (cpu->zf << 6) | (cpu->yf << 5) | (cpu->hf << 4) |
+          (cpu->xf << 3) | (cpu->pf << 2) | (cpu->nf << 1) | cpu->cf;
+    s.b = cpu->b;
+    s.c = cpu->c;
+    s.d = cpu->d;
+    s.e = cpu->e;
+    s.h = cpu->h;
+    s.l = cpu->l;
+    s.i = cpu->i;
+    s.r = cpu->r;
+    s.im = cpu->interrupt_mode;
+    s.iff1 = cpu->iff1;
+    s.halted = cpu->halted;
+    memcpy(w, &s, sizeof(s));
+
+    unsigned seq = v->seq;
+    __atomic_store_n(&v->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (unsigned i = 0; i < CPUVIEW_WORDS; i++) {
+        __atomic_store_n(&v->words[i], w[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&v->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+unsigned cpuview_read(const cpuview *v, cpu_view *out) {
+    uint32_t w[CPUVIEW_WORDS];
+    unsigned seq;
+
+    for (;;) {
+        seq = __atomic_load_n(&v->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) continue;
+        for (unsigned i = 0; i < CPUVIEW_WORDS; i++) {
+            w[i] = __atomic_load_n(&v->words[i], __ATOMIC_RELAXED);
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&v->seq, __ATOMIC_RELAXED) == seq) break;
+    }
+    memcpy(out, w, sizeof(*out));
+    return seq;
+}
+
+uint32_t cpuview_range_gen(const cpuview *v, uint16_t addr, unsigned len) {
+    uint32_t sum = 0;
+    if (len == 0) return 0;
+    unsigned first = addr >> 8, last = ((addr + len - 1) & 0xFFFF) >> 8;
+    for (unsigned p = first; ; p = (p + 1) % CPUVIEW_PAGES) {
+        sum += __atomic_load_n(&v->page_gen[p], __ATOMIC_RELAXED);
+        if (p == last) break;
+    }
+    return sum;
+}
@@ -0,0 +1,60 @@
+/*
+ * Published CPU State - Header
+ * The thread running the CPU publishes a copy of the registers at slice
+ * boundaries through a seqlock, and bumps a generation counter for each
+ * 256-byte page it writes. A UI thread reads both without locking: a
+ * register copy is retried if a publish overlapped it, and a panel is
+ * redrawn only when its inputs have changed.
+ *
+ * One writer only. The copy is stored as 32-bit words with relaxed atomics
+ * between the sequence's release/acquire fences, so a torn read is caught
+ * by the sequence check rather than being a data race.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef CPUVIEW_H
+#define CPUVIEW_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "z80.h"
+
+#define CPUVIEW_PAGES 256
+
+typedef struct {
+    unsigned long cyc;
+    uint16_t pc, sp, ix, iy;
+    uint8_t a, f, b, c, d, e, h, l;
+    uint8_t i, r, im;
+    bool iff1, halted;
+    uint8_t pad[3];                    /* No implicit padding, so views memcmp */
+} cpu_view;
+
+#define CPUVIEW_WORDS ((sizeof(cpu_view) + 3) / 4)
+
+typedef struct {
+    unsigned seq;                      /* Odd while a publish is under way */
+    uint32_t words[CPUVIEW_WORDS];
+    uint32_t page_gen[CPUVIEW_PAGES];  /* Bumped on every write to the page */
+} cpuview;
+
+void cpuview_init(cpuview *v);
+
+/* Writer: publish the current registers */
+void cpuview_publish(cpuview *v, const z80 *cpu);
+
+/* Reader: consistent copy of the last publish; returns its sequence */
+unsigned cpuview_read(const cpuview *v, cpu_view *out);
+
+/* Writer: memory at addr changed */
+static inline void cpuview_touch(cpuview *v, uint16_t addr) {
+    uint32_t *g = &v->page_gen[addr >> 8];
+    __atomic_store_n(g, *g + 1, __ATOMIC_RELAXED);
+}
+
+/* Reader: sum of the generations of the pages covering [addr, addr+len) */
+uint32_t cpuview_range_gen(const cpuview *v, uint16_t addr, unsigned len);
+
+#endif /* CPUVIEW_H */
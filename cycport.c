@@ -0,0 +1,49 @@
+/*
+ * Guest Clock Ports
+ * Each 64-bit value is latched when its low byte is read, so a guest can
+ * read the remaining bytes without the value moving underneath it.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <time.h>
+#include "cycport.h"
+
+bool cycport_enabled = false;
+uint8_t cycport_base = 0;
+
+static uint64_t cyc_latch = 0;
+static uint64_t us_latch = 0;
+static uint64_t start_us = 0;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+int cycport_map(unsigned long base) {
+    /* 8251 at $00, SD card at $10, ACIA at $80 */
+    if (base > 0xF0 || base % CYCPORT_SPAN != 0 ||
+        base == 0x00 || base == 0x10 || base == 0x80) {
+        return -1;
+    }
+    cycport_base = (uint8_t)base;
+    cycport_enabled = true;
+    start_us = now_us();
+    return 0;
+}
+
+uint8_t cycport_read(uint8_t port, uint64_t cyc) {
+    unsigned off = (uint8_t)(port - cycport_base);
+
+    if (off < 8) {
+        if (off == 0) cyc_latch = cyc;
+        return (uint8_t)(cyc_latch >> (8 * off));
+    }
+    if (off == 8) us_latch = now_us() - start_us;
+    return (uint8_t)(us_latch >> (8 * (off - 8)));
+}
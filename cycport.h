@@ -0,0 +1,35 @@
+/*
+ * Guest Clock Ports - Header
+ * Optional read-only device giving guest code the CPU cycle counter and a
+ * host monotonic clock, so firmware benchmarks can time themselves.
+ *
+ *   BASE+0..7    cycle counter, little-endian; reading BASE+0 latches it
+ *   BASE+8..15   host microseconds since start; reading BASE+8 latches it
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef CYCPORT_H
+#define CYCPORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CYCPORT_SPAN 16
+
+extern bool cycport_enabled;
+extern uint8_t cycport_base;
+
+/* Map the device at base (a multiple of 16 clear of the serial and SD
+ * ports). Returns 0, or -1 if base is unusable. */
+int cycport_map(unsigned long base);
+
+/* Is port one of ours? Front-ends test cycport_enabled first. */
+static inline bool cycport_claims(uint8_t port) {
+    return (uint8_t)(port - cycport_base) < CYCPORT_SPAN;
+}
+
+uint8_t cycport_read(uint8_t port, uint64_t cyc);
+
+#endif /* CYCPORT_H */
@@ -0,0 +1,260 @@
+/*
+ * Categorised Debug Log
+ * Every thread that logs gets its own single-producer ring, created on its
+ * first record and linked into a list that only grows. The formatting
+ * thread and dlog_text() are the consumers; they take drain_lock, and the
+ * producers never do. When a ring is full the record is dropped and
+ * counted rather than making the emulator wait.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "dlog.h"
+
+#define RING_RECORDS 16384      /* Power of two; 1MB per logging thread */
+#define DRAIN_MS     20
+
+#define F_STR 0x01
+#define F_CPU 0x02
+
+typedef struct dlog_ring {
+    size_t head;                /* Consumer */
+    char pad0[64 - sizeof(size_t)];
+    size_t tail;                /* Producer */
+    size_t head_cache;
+    uint64_t dropped;
+    char pad1[64 - 2 * sizeof(size_t) - sizeof(uint64_t)];
+    struct dlog_ring *next;
+    dlog_record rec[RING_RECORDS];
+} dlog_ring;
+
+uint8_t dlog_levels[DLOG_NCAT];
+
+static const char *cat_names[DLOG_NCAT] = {"core", "sd", "acia", "8251", "int", "mem"};
+static const char *level_names[] = {"off", "error", "warn", "info", "debug", "trace"};
+
+static __thread dlog_ring *my_ring;
+static __thread const z80 *my_cpu;
+
+static dlog_ring *rings;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *out;
+static pthread_t drainer;
+static bool running = false;
+static int stop = 0;
+
+int dlog_parse(const char *spec) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", spec);
+
+    for (char *item = strtok(buf, ","); item; item = strtok(NULL, ",")) {
+        int level = DLOG_DEBUG;
+        char *colon = strchr(item, ':');
+        if (colon) {
+            *colon = '\0';
+            level = -1;
+            for (int l = 0; l <= DLOG_TRACE; l++) {
+                if (strcmp(colon + 1, level_names[l]) == 0) level = l;
+            }
+            if (level < 0) return -1;
+        }
+
+        bool all = strcmp(item, "all") == 0, found = all;
+        for (int c = 0; c < DLOG_NCAT; c++) {
+            if (all || strcmp(item, cat_names[c]) == 0) {
+                dlog_levels[c] = (uint8_t)level;
+                found = true;
+            }
+        }
+        if (!found) return -1;
+    }
+    return 0;
+}
+
+void dlog_attach(const z80 *cpu) {
+    my_cpu = cpu;
+}
+
+static dlog_ring *ring_create(void) {
+    dlog_ring *r = calloc(1, sizeof(dlog_ring));
+    if (!r) return NULL;
+    pthread_mutex_lock(&rings_lock);
+    r->next = rings;
+    __atomic_store_n(&rings, r, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&rings_lock);
+    return r;
+}
+
+/* Producer: next free slot, or NULL (record dropped) */
+static dlog_record *reserve(void) {
+    dlog_ring *r = my_ring;
+    if (!r && !(r = my_ring = ring_create())) return NULL;
+
+    if (r->tail - r->head_cache == RING_RECORDS) {
+        r->head_cache = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        if (r->tail - r->head_cache == RING_RECORDS) {
+            __atomic_store_n(&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+            return NULL;
+        }
+    }
+    return &r->rec[r->tail & (RING_RECORDS - 1)];
+}
+
+static void fill(dlog_record *rec, dlog_cat cat, dlog_level level, const char *fmt) {
+    rec->fmt = fmt;
+    rec->cat = (uint8_t)cat;
+    rec->level = (uint8_t)level;
+    rec->flags = 0;
+    if (my_cpu) {
+        rec->cyc = my_cpu->cyc;
+        rec->pc = my_cpu->pc;
+        rec->flags = F_CPU;
+    }
+}
+
+static void commit(void) {
+    dlog_ring *r = my_ring;
+    __atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_RELEASE);
+}
+
+void dlog_emit(dlog_cat cat, dlog_level level, const char *fmt,
+               uint32_t a, uint32_t b, uint32_t c) {
+    dlog_record *rec = reserve();
+    if (!rec) return;
+    fill(rec, cat, level, fmt);
+    rec->arg[0] = a;
+    rec->arg[1] = b;
+    rec->arg[2] = c;
+    commit();
+}
+
+void dlog_emit_str(dlog_cat cat, dlog_level level, const char *fmt,
+                   const char *s, uint32_t a, uint32_t b) {
+    dlog_record *rec = reserve();
+    if (!rec) return;
+    fill(rec, cat, level, fmt);
+    rec->flags |= F_STR;
+    strncpy(rec->str, s, DLOG_STR_LEN - 1);
+    rec->str[DLOG_STR_LEN - 1] = '\0';
+    rec->arg[0] = a;
+    rec->arg[1] = b;
+    commit();
+}
+
+static FILE *output(void) {
+    return out ? out : stderr;
+}
+
+static void prefix(FILE *f, int cat, int level, bool has_cpu, uint64_t cyc, uint16_t pc) {
+    if (has_cpu) {
+        fprintf(f, "%12llu %04X %-4s %-5s ", (unsigned long long)cyc, pc,
+                cat_names[cat], level_names[level]);
+    } else {
+        fprintf(f, "%12s %4s %-4s %-5s ", "-", "-", cat_names[cat], level_names[level]);
+    }
+}
+
+/* Consumer; caller holds drain_lock. Returns records written. */
+static size_t drain_all(void) {
+    FILE *f = output();
+    size_t wrote = 0;
+
+    for (dlog_ring *r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+        size_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+        size_t head = r->head;
+        for (; head != tail; head++) {
+            const dlog_record *rec = &r->rec[head & (RING_RECORDS - 1)];
+            prefix(f, rec->cat, rec->level, rec->flags & F_CPU, rec->cyc, rec->pc);
+            if (rec->flags & F_STR) {
+                fprintf(f, rec->fmt, rec->str, rec->arg[0], rec->arg[1]);
+            } else {
+                fprintf(f, rec->fmt, rec->arg[0], rec->arg[1], rec->arg[2]);
+            }
+            fputc('\n', f);
+            wrote++;
+        }
+        __atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+    }
+    if (wrote) fflush(f);
+    return wrote;
+}
+
+void dlog_text(dlog_cat cat, dlog_level level, const char *fmt, ...) {
+    FILE *f = output();
+    va_list ap;
+
+    if (!dlog_on(cat, level)) return;
+    pthread_mutex_lock(&drain_lock);
+    drain_all();
+    prefix(f, cat, level, my_cpu != NULL, my_cpu ? my_cpu->cyc : 0, my_cpu ? my_cpu->pc : 0);
+    va_start(ap, fmt);
+    vfprintf(f, fmt, ap);
+    va_end(ap);
+    fputc('\n', f);
+    fflush(f);
+    pthread_mutex_unlock(&drain_lock);
+}
+
+static void *drain_thread(void *arg) {
+    (void)arg;
+    struct timespec tick = {0, DRAIN_MS * 1000000L};
+
+    while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&drain_lock);
+        size_t n = drain_all();
+        pthread_mutex_unlock(&drain_lock);
+        /* Keep up with a busy producer; nap only when caught up */
+        if (n == 0) nanosleep(&tick, NULL);
+    }
+    return NULL;
+}
+
+int dlog_open(const char *path) {
+    bool any = false;
+    for (int c = 0; c < DLOG_NCAT; c++) {
+        if (dlog_levels[c]) any = true;
+    }
+    if (!any) return 0;
+
+    if (path && !(out = fopen(path, "w"))) {
+        perror(path);
+        return -1;
+    }
+    if (pthread_create(&drainer, NULL, drain_thread, NULL) != 0) {
+        perror("dlog");
+        return -1;
+    }
+    running = true;
+    return 0;
+}
+
+void dlog_close(void) {
+    if (running) {
+        __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+        pthread_join(drainer, NULL);
+        running = false;
+    }
+
+    pthread_mutex_lock(&drain_lock);
+    drain_all();
+    pthread_mutex_unlock(&drain_lock);
+
+    uint64_t dropped = 0;
+    for (dlog_ring *r = rings; r; r = r->next) dropped += r->dropped;
+    if (dropped) fprintf(stderr, "dlog: %llu records dropped (ring full)\n",
+                         (unsigned long long)dropped);
+
+    if (out) fclose(out);
+    out = NULL;
+    memset(dlog_levels, 0, sizeof(dlog_levels));
+}
@@ -0,0 +1,84 @@
+/*
+ * Categorised Debug Log - Header
+ * Each category (CORE, SD, ACIA, 8251, INT, MEM) has its own level, set at
+ * runtime with --log. A disabled call site costs one byte compare. An
+ * enabled one copies a fixed-size record (cycle, PC, format pointer and
+ * up to three integer arguments) into the calling thread's ring. A
+ * background thread formats the records later, and whatever is left is
+ * formatted at exit. Nothing is formatted or written on the emulation
+ * thread.
+ *
+ * Formats in DLOG() take only int-sized conversions (%u %d %x %X %c). In
+ * DLOG_STR() the one string argument must be the first conversion.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DLOG_H
+#define DLOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "z80.h"
+
+typedef enum {
+    DLOG_CORE, DLOG_SD, DLOG_ACIA, DLOG_8251, DLOG_INT, DLOG_MEM,
+    DLOG_NCAT
+} dlog_cat;
+
+typedef enum {
+    DLOG_OFF, DLOG_ERROR, DLOG_WARN, DLOG_INFO, DLOG_DEBUG, DLOG_TRACE
+} dlog_level;
+
+#define DLOG_STR_LEN 31
+
+typedef struct {
+    uint64_t cyc;
+    const char *fmt;             /* Static format string */
+    uint32_t arg[3];
+    uint16_t pc;
+    uint8_t cat, level;
+    uint8_t flags;
+    char str[DLOG_STR_LEN];      /* Copy of the string argument, if any */
+} dlog_record;                   /* 64 bytes */
+
+extern uint8_t dlog_levels[DLOG_NCAT];
+
+static inline bool dlog_on(dlog_cat cat, dlog_level level) {
+    return dlog_levels[cat] >= level;
+}
+
+#define DLOG(cat, level, fmt, a, b, c) do { \
+    if (dlog_on(cat, level)) dlog_emit(cat, level, fmt, a, b, c); \
+} while (0)
+
+#define DLOG_STR(cat, level, fmt, s, a, b) do { \
+    if (dlog_on(cat, level)) dlog_emit_str(cat, level, fmt, s, a, b); \
+} while (0)
+
+/* Enable categories: "cat[:level][,cat[:level]...]", cat may be "all",
+ * level defaults to debug. Returns -1 on an unknown name. */
+int dlog_parse(const char *spec);
+
+/* Start the formatting thread if any category is on; path NULL = stderr.
+ * Returns 0 or -1. */
+int dlog_open(const char *path);
+
+/* Stamp this thread's records with cpu's cycle counter and PC */
+void dlog_attach(const z80 *cpu);
+
+void dlog_emit(dlog_cat cat, dlog_level level, const char *fmt,
+               uint32_t a, uint32_t b, uint32_t c);
+void dlog_emit_str(dlog_cat cat, dlog_level level, const char *fmt,
+                   const char *s, uint32_t a, uint32_t b);
+
+/* Cold path: format now (after this thread's queued records), any printf
+ * arguments. For startup, shutdown and error messages. */
+void dlog_text(dlog_cat cat, dlog_level level, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+/* Format everything still queued, stop the thread, close the output */
+void dlog_close(void);
+
+#endif /* DLOG_H */
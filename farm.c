@@ -0,0 +1,1108 @@
+/*
+ * Distributed Regression Farm
+ * A coordinator hands the sessions of a manifest to worker processes over
+ * plain TCP; workers can run on any host that reaches the coordinator, or
+ * be forked locally with --spawn. Each worker connection runs one session
+ * at a time, so a worker started with -j N offers N slots.
+ *
+ * Protocol (one text line per message, binary payloads follow their line):
+ *
+ *   worker -> coordinator
+ *     HELLO <name>
+ *     NEED <key>                     ROM not cached yet; send it
+ *     DONE <id> <status> <cycles> <instructions> <out_len> <hash> <warm|cold>
+ *     DROP <id>                      Cancelled before finishing
+ *
+ *   coordinator -> worker
+ *     JOB <id> <key> <cycles> <budget> <input_len> <expect_len>
+ *         + input bytes + expect bytes (expect_len -1 = run to halt)
+ *     ROM <key> <len> <name>  + image bytes
+ *     CANCEL <id>                    Another copy already finished
+ *     BYE
+ *
+ * ROMs are keyed by a hash of name and contents, sent only to workers that
+ * ask for them and cached for the life of the worker process. The first
+ * session to use a ROM also warms it: the machine boots with no input up
+ * to the instruction before its first serial read, and later sessions
+ * start from a copy of that state plus the recorded boot output. Until the
+ * guest reads the serial port, queued input cannot change what it does,
+ * so warm and cold starts give the same output and cycle counts.
+ *
+ * Input is queued in full before a session starts and output is hashed up
+ * to the byte that completed the expect text, so a result does not depend
+ * on which worker produced it. A session whose worker disconnects is
+ * queued again (up to --retries times). Once nothing is left to hand out,
+ * idle workers run duplicate copies of sessions that have been running for
+ * longer than --steal seconds; the first result wins and the other copies
+ * are cancelled.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <poll.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "machine.h"
+#include "manifest.h"
+
+#define SLICE_CYCLES   100000     /* Cycles between cancel/budget checks */
+#define WARM_MAX       50000000   /* Give up warming a ROM after this many cycles */
+#define TICK_MS        20
+#define LINE_MAX_LEN   1024
+#define CONNECT_WAIT   10.0       /* Seconds a worker keeps retrying connect */
+#define GRACE_SEC      10.0       /* Past budget before a worker is presumed dead */
+#define DEFAULT_STEAL  2.0
+#define DEFAULT_RETRIES 3
+
+typedef enum { ST_RUNNING, ST_PASS, ST_FAIL, ST_TIMEOUT, ST_ERROR, ST_LOST } status;
+
+static const char *status_names[] = {"RUN", "PASS", "FAIL", "TIMEOUT", "ERROR", "LOST"};
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t fnv64(uint64_t h, const void *data, size_t len) {
+    const uint8_t *p = data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+#define FNV64_INIT 0xcbf29ce484222325ULL
+
+static const char *base_name(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+static int send_all(int fd, const void *data, size_t len) {
+    const uint8_t *p = data;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int send_line(int fd, const char *fmt, ...) {
+    char line[LINE_MAX_LEN];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line) - 1, fmt, ap);
+    va_end(ap);
+    if (n < 0 || n >= (int)sizeof(line) - 1) return -1;
+    line[n++] = '\n';
+    return send_all(fd, line, n);
+}
+
+static void set_nodelay(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+/* Split "host:port" (host optional); returns the port part */
+static const char *split_addr(const char *spec, char *host, size_t host_len) {
+    const char *colon = strrchr(spec, ':');
+    if (!colon) {
+        host[0] = '\0';
+        return spec;
+    }
+    snprintf(host, host_len, "%.*s", (int)(colon - spec), spec);
+    return colon + 1;
+}
+
+/* ---------- Worker ---------- */
+
+/* Buffered reader over a blocking socket */
+typedef struct {
+    int fd;
+    uint8_t buf[8192];
+    size_t pos, len;
+    bool bye;                   /* Coordinator has finished with us */
+} reader;
+
+static bool rd_fill(reader *r) {
+    if (r->pos == r->len) r->pos = r->len = 0;
+    for (;;) {
+        ssize_t n = recv(r->fd, r->buf + r->len, sizeof(r->buf) - r->len, 0);
+        if (n > 0) {
+            r->len += n;
+            return true;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        return false;
+    }
+}
+
+/* Next line without its newline; false at EOF */
+static bool rd_line(reader *r, char *line, size_t max) {
+    size_t n = 0;
+    for (;;) {
+        while (r->pos < r->len) {
+            char c = (char)r->buf[r->pos++];
+            if (c == '\n') {
+                line[n] = '\0';
+                return true;
+            }
+            if (n + 1 < max) line[n++] = c;
+        }
+        if (!rd_fill(r)) return false;
+    }
+}
+
+static bool rd_bytes(reader *r, uint8_t *dst, size_t len) {
+    while (len > 0) {
+        if (r->pos == r->len && !rd_fill(r)) return false;
+        size_t take = r->len - r->pos < len ? r->len - r->pos : len;
+        memcpy(dst, r->buf + r->pos, take);
+        r->pos += take;
+        dst += take;
+        len -= take;
+    }
+    return true;
+}
+
+/* Is a message waiting? Never blocks. */
+static bool rd_pending(reader *r) {
+    if (r->pos < r->len) return true;
+    struct pollfd p = {r->fd, POLLIN, 0};
+    return poll(&p, 1, 0) > 0;
+}
+
+/* One ROM as cached by a worker process */
+typedef struct rom_entry {
+    uint64_t key;
+    char name[256];
+    uint8_t *image;
+    size_t len;
+
+    pthread_mutex_t lock;       /* Held while warming */
+    bool warmed;
+    machine *warm;              /* NULL: sessions start cold */
+    uint8_t *boot_out;          /* Output produced while warming */
+    size_t boot_len;
+
+    struct rom_entry *next;
+} rom_entry;
+
+static rom_entry *rom_cache;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static rom_entry *rom_find(uint64_t key) {
+    pthread_mutex_lock(&cache_lock);
+    rom_entry *e = rom_cache;
+    while (e && e->key != key) e = e->next;
+    pthread_mutex_unlock(&cache_lock);
+    return e;
+}
+
+/* Takes ownership of image */
+static rom_entry *rom_add(uint64_t key, const char *name, uint8_t *image, size_t len) {
+    pthread_mutex_lock(&cache_lock);
+    rom_entry *e = rom_cache;
+    while (e && e->key != key) e = e->next;
+    if (e) {
+        /* Another slot of this process fetched it meanwhile */
+        free(image);
+    } else if ((e = calloc(1, sizeof(rom_entry))) != NULL) {
+        e->key = key;
+        snprintf(e->name, sizeof(e->name), "%s", name);
+        e->image = image;
+        e->len = len;
+        pthread_mutex_init(&e->lock, NULL);
+        e->next = rom_cache;
+        rom_cache = e;
+    } else {
+        free(image);
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return e;
+}
+
+/* Guest output of one session (or of warming a ROM) */
+typedef struct {
+    machine *m;
+    uint8_t *data;
+    size_t len, cap;
+    uint64_t hash;
+    const uint8_t *expect;
+    size_t expect_len;
+    bool matched;
+    unsigned long match_cyc;
+    bool oom;
+} output;
+
+static void out_byte(void *ctx, uint8_t c) {
+    output *o = ctx;
+    if (o->matched || o->oom) return;
+    if (o->len == o->cap) {
+        size_t cap = o->cap ? o->cap * 2 : 4096;
+        uint8_t *n = realloc(o->data, cap);
+        if (!n) {
+            o->oom = true;
+            return;
+        }
+        o->data = n;
+        o->cap = cap;
+    }
+    o->data[o->len++] = c;
+    o->hash = fnv64(o->hash, &c, 1);
+
+    size_t xl = o->expect_len;
+    if (o->expect && o->len >= xl && memcmp(o->data + o->len - xl, o->expect, xl) == 0) {
+        o->matched = true;
+        o->match_cyc = o->m->cpu.cyc;
+    }
+}
+
+/* Boot with no input up to the instruction before the first serial read */
+static void warm_up(rom_entry *e) {
+    machine *m = machine_create_image(e->name, e->image, e->len);
+    output boot = {0};
+
+    e->warmed = true;
+    if (!m) return;
+    boot.m = m;
+    m->tx = out_byte;
+    m->tx_ctx = &boot;
+
+    if (machine_boot_to_input(m, WARM_MAX) == 0 && !boot.oom && m->cpu.cyc > 0) {
+        /* Replaying the boot output rebuilds the hash per session */
+        m->tx = NULL;
+        e->warm = m;
+        e->boot_out = boot.data;
+        e->boot_len = boot.len;
+        m = NULL;
+        boot.data = NULL;
+    }
+    machine_destroy(m);
+    free(boot.data);
+}
+
+static bool contains(const uint8_t *hay, size_t len, const uint8_t *needle, size_t nlen) {
+    if (!needle) return false;
+    for (size_t i = 0; i + nlen <= len; i++) {
+        if (memcmp(hay + i, needle, nlen) == 0) return true;
+    }
+    return false;
+}
+
+typedef struct {
+    status st;
+    unsigned long cycles;
+    uint64_t instructions;
+    size_t out_len;
+    uint64_t hash;
+    bool warm;
+} result;
+
+/* Returns false if the coordinator went away. *cancelled is set when a
+ * CANCEL for this session arrives while it runs. */
+static bool run_job(reader *r, rom_entry *e, unsigned long id, unsigned long cycles,
+                    double budget, const uint8_t *input, size_t input_len,
+                    const uint8_t *expect, long expect_len, result *res, bool *cancelled) {
+    output out = {0};
+    out.hash = FNV64_INIT;
+    out.expect = expect_len >= 0 ? expect : NULL;
+    out.expect_len = expect_len >= 0 ? (size_t)expect_len : 0;
+    memset(res, 0, sizeof(*res));
+
+    pthread_mutex_lock(&e->lock);
+    if (!e->warmed) warm_up(e);
+    pthread_mutex_unlock(&e->lock);
+
+    machine *m = machine_create_image(e->name, e->image, e->len);
+    if (!m) {
+        res->st = ST_ERROR;
+        return true;
+    }
+    out.m = m;
+    m->tx = out_byte;
+    m->tx_ctx = &out;
+    /* A match inside the boot output must be timed by a cold run */
+    if (e->warm && (cycles == 0 || e->warm->cpu.cyc <= cycles) &&
+        !contains(e->boot_out, e->boot_len, out.expect, out.expect_len)) {
+        machine_copy_state(m, e->warm);
+        for (size_t i = 0; i < e->boot_len; i++) out_byte(&out, e->boot_out[i]);
+        res->warm = true;
+    }
+    if (out.expect && out.expect_len == 0) {
+        out.matched = true;
+        out.match_cyc = m->cpu.cyc;
+    }
+    machine_feed(m, input, input_len);
+
+    bool alive = true;
+    double start = now_sec();
+    res->st = ST_RUNNING;
+    while (res->st == ST_RUNNING) {
+        unsigned long until = m->cpu.cyc + SLICE_CYCLES;
+        if (cycles && until > cycles) until = cycles;
+        if (!out.matched) machine_run(m, until);
+
+        if (out.oom) {
+            res->st = ST_ERROR;
+        } else if (out.matched) {
+            res->st = ST_PASS;
+        } else if (m->cpu.halted || (cycles && m->cpu.cyc >= cycles)) {
+            res->st = out.expect ? ST_FAIL : ST_PASS;
+        } else if (now_sec() - start > budget) {
+            res->st = ST_TIMEOUT;
+        }
+
+        while (rd_pending(r)) {
+            char line[LINE_MAX_LEN];
+            unsigned long cid;
+            if (!rd_line(r, line, sizeof(line))) {
+                alive = false;
+                res->st = ST_ERROR;
+                break;
+            }
+            if (strcmp(line, "BYE") == 0) r->bye = true;
+            if (r->bye || (sscanf(line, "CANCEL %lu", &cid) == 1 && cid == id)) {
+                *cancelled = true;
+                res->st = ST_ERROR;
+            }
+        }
+    }
+
+    res->cycles = out.matched && out.expect ? out.match_cyc : m->cpu.cyc;
+    res->instructions = m->instructions;
+    res->out_len = out.len;
+    res->hash = out.hash;
+    machine_destroy(m);
+    free(out.data);
+    return alive;
+}
+
+/* Handle one JOB message; returns false once the connection is unusable */
+static bool worker_job(reader *r, const char *line) {
+    unsigned long id, cycles;
+    unsigned long long key;
+    double budget;
+    size_t input_len;
+    long expect_len;
+    char rom_line[LINE_MAX_LEN];
+
+    if (sscanf(line, "JOB %lu %llx %lu %lf %zu %ld",
+               &id, &key, &cycles, &budget, &input_len, &expect_len) != 6) {
+        fprintf(stderr, "farm worker: bad message: %s\n", line);
+        return false;
+    }
+    uint8_t *input = malloc(input_len + 1);
+    uint8_t *expect = malloc(expect_len > 0 ? expect_len : 1);
+    bool ok = input && expect && rd_bytes(r, input, input_len) &&
+              (expect_len <= 0 || rd_bytes(r, expect, expect_len));
+    bool cancelled = false;
+    result res;
+
+    rom_entry *e = ok ? rom_find(key) : NULL;
+    if (ok && !e) {
+        ok = send_line(r->fd, "NEED %016llx", key) == 0;
+        while (ok && (ok = rd_line(r, rom_line, sizeof(rom_line)))) {
+            unsigned long long rkey;
+            size_t len;
+            int name_at = 0;
+            unsigned long cid;
+            if (sscanf(rom_line, "CANCEL %lu", &cid) == 1) {
+                if (cid == id) cancelled = true;
+                continue;
+            }
+            if (strcmp(rom_line, "BYE") == 0) {
+                r->bye = true;
+                ok = false;
+                break;
+            }
+            if (sscanf(rom_line, "ROM %llx %zu %n", &rkey, &len, &name_at) != 2 ||
+                name_at == 0 || rkey != key || len > MACHINE_MEM_SIZE) {
+                fprintf(stderr, "farm worker: bad message: %s\n", rom_line);
+                ok = false;
+                break;
+            }
+            uint8_t *image = malloc(len ? len : 1);
+            if (!image || !rd_bytes(r, image, len)) {
+                free(image);
+                ok = false;
+                break;
+            }
+            e = rom_add(key, rom_line + name_at, image, len);
+            break;
+        }
+    }
+
+    if (ok && !cancelled) {
+        if (e) {
+            ok = run_job(r, e, id, cycles, budget, input, input_len,
+                         expect, expect_len, &res, &cancelled);
+        } else {
+            memset(&res, 0, sizeof(res));
+            res.st = ST_ERROR;
+        }
+    }
+    if (ok && !r->bye) {
+        if (cancelled) {
+            ok = send_line(r->fd, "DROP %lu", id) == 0;
+        } else {
+            ok = send_line(r->fd, "DONE %lu %s %lu %llu %zu %016llx %s", id,
+                           status_names[res.st], res.cycles,
+                           (unsigned long long)res.instructions, res.out_len,
+                           (unsigned long long)res.hash, res.warm ? "warm" : "cold") == 0;
+        }
+    }
+    free(input);
+    free(expect);
+    return ok && !r->bye;
+}
+
+static int connect_to(const char *spec) {
+    char host[256];
+    const char *port = split_addr(spec, host, sizeof(host));
+    struct addrinfo hints = {0}, *ai;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    double give_up = now_sec() + CONNECT_WAIT;
+    for (;;) {
+        int err = getaddrinfo(host[0] ? host : "localhost", port, &hints, &ai);
+        if (err) {
+            fprintf(stderr, "farm worker: %s: %s\n", spec, gai_strerror(err));
+            return -1;
+        }
+        for (struct addrinfo *a = ai; a; a = a->ai_next) {
+            int fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (fd < 0) continue;
+            if (connect(fd, a->ai_addr, a->ai_addrlen) == 0) {
+                freeaddrinfo(ai);
+                set_nodelay(fd);
+                return fd;
+            }
+            close(fd);
+        }
+        freeaddrinfo(ai);
+
+        /* The coordinator may not be listening yet */
+        if (now_sec() > give_up) {
+            fprintf(stderr, "farm worker: cannot connect to %s\n", spec);
+            return -1;
+        }
+        struct timespec ts = {0, 100000000};
+        nanosleep(&ts, NULL);
+    }
+}
+
+typedef struct {
+    const char *spec;
+    int slot;
+    int rc;
+} slot_arg;
+
+static void *worker_slot(void *arg) {
+    slot_arg *a = arg;
+    reader *r = calloc(1, sizeof(reader));
+    char line[LINE_MAX_LEN], host[128];
+
+    a->rc = 1;
+    if (!r || (r->fd = connect_to(a->spec)) < 0) {
+        free(r);
+        return NULL;
+    }
+    if (gethostname(host, sizeof(host)) < 0) snprintf(host, sizeof(host), "worker");
+    host[sizeof(host) - 1] = '\0';
+
+    if (send_line(r->fd, "HELLO %s/%ld.%d", host, (long)getpid(), a->slot) == 0) {
+        while (rd_line(r, line, sizeof(line))) {
+            if (strncmp(line, "JOB ", 4) == 0) {
+                if (!worker_job(r, line)) break;
+            } else if (strcmp(line, "BYE") == 0) {
+                r->bye = true;
+                break;
+            }
+            /* A CANCEL for a session already finished is harmless */
+        }
+    }
+    if (r->bye) a->rc = 0;
+    if (a->rc) fprintf(stderr, "farm worker: lost connection to %s\n", a->spec);
+    close(r->fd);
+    free(r);
+    return NULL;
+}
+
+static int worker_main(const char *spec, int slots) {
+    pthread_t *threads = calloc(slots, sizeof(pthread_t));
+    slot_arg *args = calloc(slots, sizeof(slot_arg));
+    int rc = 0;
+
+    if (!threads || !args) {
+        perror("farm worker");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    for (int i = 0; i < slots; i++) {
+        args[i].spec = spec;
+        args[i].slot = i;
+        args[i].rc = 1;
+        if (pthread_create(&threads[i], NULL, worker_slot, &args[i]) != 0) {
+            perror("pthread_create");
+            slots = i;
+            rc = 1;
+            break;
+        }
+    }
+    for (int i = 0; i < slots; i++) {
+        pthread_join(threads[i], NULL);
+        if (args[i].rc) rc = 1;
+    }
+
+    while (rom_cache) {
+        rom_entry *e = rom_cache;
+        rom_cache = e->next;
+        machine_destroy(e->warm);
+        free(e->boot_out);
+        free(e->image);
+        pthread_mutex_destroy(&e->lock);
+        free(e);
+    }
+    free(threads);
+    free(args);
+    return rc;
+}
+
+/* ---------- Coordinator ---------- */
+
+typedef struct {
+    char path[MANIFEST_PATH_LEN];
+    uint64_t key;
+    uint8_t *image;
+    size_t len;
+} rom_image;
+
+typedef enum { J_PENDING, J_RUNNING, J_DONE } job_state;
+
+typedef struct {
+    const manifest_entry *e;
+    int rom;                /* Index into roms, -1 = unreadable */
+    job_state state;
+    int copies;             /* Workers currently running it */
+    int attempts;           /* Times handed out from the queue */
+    int runs;               /* Copies started, including stolen ones */
+    double started;         /* When the current attempt was handed out */
+
+    status st;
+    unsigned long cycles;
+    uint64_t instructions;
+    size_t out_len;
+    uint64_t hash;
+    bool warm;
+    double wall;
+    char worker[96];
+} job;
+
+typedef struct {
+    int fd;
+    char name[96];
+    bool ready;             /* HELLO received */
+    char buf[LINE_MAX_LEN];
+    size_t len;
+    int job;                /* -1 = idle */
+    double started;
+    bool cancelled;
+    int sessions;
+} conn;
+
+static rom_image *roms;
+static size_t rom_count;
+static job *jobs;
+static size_t job_count, remaining;
+static conn *conns;
+static size_t conn_count, conn_cap;
+static int retries = DEFAULT_RETRIES;
+static int interrupted, stolen;
+
+static int load_rom(const char *path) {
+    for (size_t i = 0; i < rom_count; i++) {
+        if (strcmp(roms[i].path, path) == 0) return (int)i;
+    }
+
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    uint8_t *image = malloc(MACHINE_MEM_SIZE);
+    size_t len = image ? fread(image, 1, MACHINE_MEM_SIZE, f) : 0;
+    fclose(f);
+    if (len == 0) {
+        fprintf(stderr, "%s: empty ROM\n", path);
+        free(image);
+        return -1;
+    }
+
+    rom_image *n = realloc(roms, (rom_count + 1) * sizeof(rom_image));
+    if (!n) {
+        free(image);
+        return -1;
+    }
+    roms = n;
+    rom_image *ri = &roms[rom_count];
+    snprintf(ri->path, sizeof(ri->path), "%s", path);
+    ri->image = image;
+    ri->len = len;
+    /* The name picks the ROM size, so it is part of the identity */
+    ri->key = fnv64(fnv64(FNV64_INIT, base_name(path), strlen(base_name(path))), image, len);
+    return (int)rom_count++;
+}
+
+static void finish(job *j, status st) {
+    j->state = J_DONE;
+    j->st = st;
+    remaining--;
+}
+
+static void conn_close(conn *c, const char *why) {
+    if (c->job >= 0) {
+        job *j = &jobs[c->job];
+        j->copies--;
+        if (j->state == J_RUNNING && j->copies == 0) {
+            if (j->attempts > retries) {
+                finish(j, ST_LOST);
+            } else {
+                j->state = J_PENDING;
+            }
+        }
+        fprintf(stderr, "farm: %s %s while running %s\n", c->name, why, j->e->name);
+        interrupted++;
+    }
+    close(c->fd);
+    c->fd = -1;
+}
+
+static int assign(conn *c, size_t id) {
+    job *j = &jobs[id];
+    const manifest_entry *e = j->e;
+    const rom_image *ri = &roms[j->rom];
+    long expect_len = e->expect ? (long)e->expect_len : -1;
+
+    if (send_line(c->fd, "JOB %zu %016llx %lu %g %zu %ld", id,
+                  (unsigned long long)ri->key, e->cycles, e->budget,
+                  e->input_len, expect_len) < 0 ||
+        send_all(c->fd, e->input, e->input_len) < 0 ||
+        (expect_len > 0 && send_all(c->fd, e->expect, expect_len) < 0)) {
+        return -1;
+    }
+
+    double t = now_sec();
+    c->job = (int)id;
+    c->started = t;
+    c->cancelled = false;
+    j->copies++;
+    j->runs++;
+    if (j->state == J_PENDING) {
+        j->state = J_RUNNING;
+        j->attempts++;
+        j->started = t;
+    } else {
+        stolen++;
+    }
+    return 0;
+}
+
+/* Next job for an idle worker: the queue first, then a straggler */
+static int pick_job(double t, double steal_after) {
+    int best = -1;
+    for (size_t i = 0; i < job_count; i++) {
+        if (jobs[i].state == J_PENDING) return (int)i;
+    }
+    if (steal_after <= 0) return -1;
+    for (size_t i = 0; i < job_count; i++) {
+        job *j = &jobs[i];
+        if (j->state != J_RUNNING || j->copies != 1 || t - j->started < steal_after) continue;
+        if (best < 0 || j->started < jobs[best].started) best = (int)i;
+    }
+    return best;
+}
+
+static status parse_status(const char *s) {
+    for (size_t i = 0; i < sizeof(status_names) / sizeof(status_names[0]); i++) {
+        if (strcmp(s, status_names[i]) == 0) return (status)i;
+    }
+    return ST_ERROR;
+}
+
+static void on_done(conn *c, const char *line) {
+    size_t id, out_len;
+    char st[16], boot[8];
+    unsigned long cycles;
+    unsigned long long instructions, hash;
+
+    if (sscanf(line, "DONE %zu %15s %lu %llu %zu %llx %7s", &id, st, &cycles,
+               &instructions, &out_len, &hash, boot) != 7 || (int)id != c->job) {
+        conn_close(c, "sent a bad result");
+        return;
+    }
+    job *j = &jobs[id];
+    status s = parse_status(st);
+    c->job = -1;
+    c->sessions++;
+    j->copies--;
+
+    if (j->state == J_DONE) {
+        /* A stolen copy finished before its CANCEL arrived */
+        if (s != j->st || hash != j->hash) {
+            fprintf(stderr, "farm: %s: %s and %s disagree (%s/%016llx vs %s/%016llx)\n",
+                    j->e->name, j->worker, c->name, status_names[j->st],
+                    (unsigned long long)j->hash, st, hash);
+        }
+        return;
+    }
+
+    finish(j, s);
+    j->cycles = cycles;
+    j->instructions = instructions;
+    j->out_len = out_len;
+    j->hash = hash;
+    j->warm = strcmp(boot, "warm") == 0;
+    j->wall = now_sec() - c->started;
+    snprintf(j->worker, sizeof(j->worker), "%s", c->name);
+
+    for (size_t i = 0; i < conn_count; i++) {
+        conn *o = &conns[i];
+        if (o->fd >= 0 && o->job == (int)id && !o->cancelled) {
+            o->cancelled = true;
+            if (send_line(o->fd, "CANCEL %zu", id) < 0) conn_close(o, "disconnected");
+        }
+    }
+}
+
+static void on_line(conn *c, const char *line) {
+    unsigned long long key;
+    size_t id;
+
+    if (strncmp(line, "HELLO ", 6) == 0) {
+        size_t n = strlen(c->name);
+        snprintf(c->name + n, sizeof(c->name) - n, "=%s", line + 6);
+        c->ready = true;
+    } else if (strncmp(line, "DONE ", 5) == 0) {
+        on_done(c, line);
+    } else if (sscanf(line, "DROP %zu", &id) == 1 && (int)id == c->job) {
+        jobs[id].copies--;
+        c->job = -1;
+    } else if (sscanf(line, "NEED %llx", &key) == 1) {
+        for (size_t i = 0; i < rom_count; i++) {
+            rom_image *ri = &roms[i];
+            if (ri->key != key) continue;
+            if (send_line(c->fd, "ROM %016llx %zu %s", key, ri->len, base_name(ri->path)) < 0 ||
+                send_all(c->fd, ri->image, ri->len) < 0) {
+                conn_close(c, "disconnected");
+            }
+            return;
+        }
+        conn_close(c, "asked for an unknown ROM");
+    } else {
+        conn_close(c, "sent a bad message");
+    }
+}
+
+static void on_readable(conn *c) {
+    ssize_t n = recv(c->fd, c->buf + c->len, sizeof(c->buf) - c->len, 0);
+    if (n <= 0) {
+        if (n < 0 && errno == EINTR) return;
+        conn_close(c, "disconnected");
+        return;
+    }
+    c->len += n;
+
+    size_t start = 0;
+    for (size_t i = 0; i < c->len && c->fd >= 0; i++) {
+        if (c->buf[i] != '\n') continue;
+        c->buf[i] = '\0';
+        on_line(c, c->buf + start);
+        start = i + 1;
+    }
+    if (c->fd < 0) return;
+    if (start == 0 && c->len == sizeof(c->buf)) {
+        conn_close(c, "sent an overlong line");
+        return;
+    }
+    memmove(c->buf, c->buf + start, c->len - start);
+    c->len -= start;
+}
+
+static int listen_on(const char *spec, int *port) {
+    char host[256];
+    const char *service = split_addr(spec, host, sizeof(host));
+    struct addrinfo hints = {0}, *ai;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    int err = getaddrinfo(host[0] ? host : NULL, service, &hints, &ai);
+    if (err) {
+        fprintf(stderr, "farm: %s: %s\n", spec, gai_strerror(err));
+        return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo *a = ai; a && fd < 0; a = a->ai_next) {
+        int one = 1;
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0) continue;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, a->ai_addr, a->ai_addrlen) < 0 || listen(fd, 64) < 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(ai);
+    if (fd < 0) {
+        perror(spec);
+        return -1;
+    }
+
+    struct sockaddr_storage ss;
+    socklen_t sl = sizeof(ss);
+    getsockname(fd, (struct sockaddr *)&ss, &sl);
+    *port = ntohs(ss.ss_family == AF_INET6 ? ((struct sockaddr_in6 *)&ss)->sin6_port
+                                           : ((struct sockaddr_in *)&ss)->sin_port);
+    return fd;
+}
+
+static void on_accept(int lfd) {
+    struct sockaddr_storage ss;
+    socklen_t sl = sizeof(ss);
+    int fd = accept(lfd, (struct sockaddr *)&ss, &sl);
+    if (fd < 0) return;
+
+    if (conn_count == conn_cap) {
+        size_t cap = conn_cap ? conn_cap * 2 : 16;
+        conn *n = realloc(conns, cap * sizeof(conn));
+        if (!n) {
+            close(fd);
+            return;
+        }
+        conns = n;
+        conn_cap = cap;
+    }
+    conn *c = &conns[conn_count++];
+    memset(c, 0, sizeof(*c));
+    c->fd = fd;
+    c->job = -1;
+    set_nodelay(fd);
+
+    char host[64] = "?", serv[16] = "?";
+    getnameinfo((struct sockaddr *)&ss, sl, host, sizeof(host), serv, sizeof(serv),
+                NI_NUMERICHOST | NI_NUMERICSERV);
+    snprintf(c->name, sizeof(c->name), "%s:%s", host, serv);
+}
+
+static void coordinate(int lfd, double steal_after, int spawned) {
+    struct pollfd *pfds = NULL;
+    size_t pfd_cap = 0;
+
+    while (remaining > 0) {
+        if (pfd_cap < conn_count + 1) {
+            pfd_cap = conn_cap + 1;
+            struct pollfd *n = realloc(pfds, pfd_cap * sizeof(struct pollfd));
+            if (!n) break;
+            pfds = n;
+        }
+        pfds[0].fd = lfd;
+        pfds[0].events = POLLIN;
+        for (size_t i = 0; i < conn_count; i++) {
+            pfds[i + 1].fd = conns[i].fd;
+            pfds[i + 1].events = POLLIN;
+        }
+
+        size_t polled = conn_count;
+        if (poll(pfds, polled + 1, TICK_MS) > 0) {
+            for (size_t i = 0; i < polled; i++) {
+                if (conns[i].fd >= 0 && pfds[i + 1].revents) on_readable(&conns[i]);
+            }
+            if (pfds[0].revents & POLLIN) on_accept(lfd);
+        }
+
+        double t = now_sec();
+        size_t live = 0;
+        for (size_t i = 0; i < conn_count; i++) {
+            conn *c = &conns[i];
+            if (c->fd < 0) continue;
+            if (c->job >= 0 && t - c->started > jobs[c->job].e->budget + GRACE_SEC) {
+                conn_close(c, "stopped responding");
+                continue;
+            }
+            live++;
+            if (!c->ready || c->job >= 0) continue;
+            int id = pick_job(t, steal_after);
+            if (id >= 0 && assign(c, id) < 0) conn_close(c, "disconnected");
+        }
+
+        /* Local workers all gone: nobody is left to run the rest */
+        if (spawned > 0) {
+            while (waitpid(-1, NULL, WNOHANG) > 0) spawned--;
+            if (spawned == 0 && live == 0) {
+                fprintf(stderr, "farm: all local workers exited\n");
+                break;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < job_count; i++) {
+        if (jobs[i].state != J_DONE) finish(&jobs[i], ST_LOST);
+    }
+    for (size_t i = 0; i < conn_count; i++) {
+        if (conns[i].fd < 0) continue;
+        send_line(conns[i].fd, "BYE");
+        close(conns[i].fd);
+    }
+    free(pfds);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] <manifest>     (coordinator)\n", prog);
+    fprintf(stderr, "       %s -w HOST:PORT [-j N]      (worker)\n", prog);
+    fprintf(stderr, "Coordinator:\n");
+    fprintf(stderr, "  -l [ADDR:]PORT  Listen for workers (default: any free port)\n");
+    fprintf(stderr, "  --spawn N       Also fork N local worker processes\n");
+    fprintf(stderr, "  --steal SEC     Duplicate sessions running longer than SEC once the\n");
+    fprintf(stderr, "                  queue is empty (default %.0f, 0 = never)\n", DEFAULT_STEAL);
+    fprintf(stderr, "  --retries N     Re-run a session whose worker disconnects up to N\n");
+    fprintf(stderr, "                  times (default %d)\n", DEFAULT_RETRIES);
+    fprintf(stderr, "Worker:\n");
+    fprintf(stderr, "  -w HOST:PORT    Connect to a coordinator\n");
+    fprintf(stderr, "  -j N            Run N sessions at a time (default 1)\n");
+    fprintf(stderr, "Exit status: 0 = all sessions passed, 1 = otherwise\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *manifest_path = NULL;
+    const char *listen_spec = "0";
+    const char *worker_spec = NULL;
+    double steal_after = DEFAULT_STEAL;
+    int slots = 1, spawn = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) listen_spec = argv[++i];
+        else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) worker_spec = argv[++i];
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) slots = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--spawn") == 0 && i + 1 < argc) spawn = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--steal") == 0 && i + 1 < argc) steal_after = atof(argv[++i]);
+        else if (strcmp(argv[i], "--retries") == 0 && i + 1 < argc) retries = atoi(argv[++i]);
+        else if (argv[i][0] != '-' && !manifest_path) manifest_path = argv[i];
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (worker_spec) {
+        if (manifest_path || slots < 1) {
+            usage(argv[0]);
+            return 1;
+        }
+        return worker_main(worker_spec, slots);
+    }
+    if (!manifest_path || spawn < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    manifest mf;
+    if (manifest_load(manifest_path, &mf) < 0) return 1;
+    if (mf.count == 0) {
+        fprintf(stderr, "%s: no sessions\n", manifest_path);
+        return 1;
+    }
+
+    jobs = calloc(mf.count, sizeof(job));
+    if (!jobs) {
+        perror("farm");
+        return 1;
+    }
+    job_count = remaining = mf.count;
+    for (size_t i = 0; i < mf.count; i++) {
+        jobs[i].e = &mf.entries[i];
+        jobs[i].rom = load_rom(mf.entries[i].rom);
+        if (jobs[i].rom < 0) finish(&jobs[i], ST_ERROR);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    int port;
+    int lfd = listen_on(listen_spec, &port);
+    if (lfd < 0) return 1;
+    fprintf(stderr, "farm: %zu sessions, listening on port %d\n", mf.count, port);
+
+    fflush(NULL);
+    for (int i = 0; i < spawn; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            char spec[32];
+            close(lfd);
+            snprintf(spec, sizeof(spec), "127.0.0.1:%d", port);
+            _exit(worker_main(spec, 1));
+        }
+        if (pid < 0) {
+            perror("fork");
+            spawn = i;
+            break;
+        }
+    }
+
+    double start = now_sec();
+    coordinate(lfd, steal_after, spawn);
+    double total_wall = now_sec() - start;
+    close(lfd);
+    while (spawn > 0 && wait(NULL) > 0) {}
+
+    int failures = 0, workers = 0;
+    for (size_t i = 0; i < conn_count; i++) {
+        if (conns[i].sessions > 0) workers++;
+    }
+    printf("%-16s %-8s %10s %14s %8s %10s %-16s %-4s %4s  %s\n",
+           "session", "result", "wall ms", "cycles", "MHz", "output", "hash",
+           "boot", "runs", "worker");
+    for (size_t i = 0; i < job_count; i++) {
+        job *j = &jobs[i];
+        printf("%-16s %-8s %10.1f %14lu %8.2f %10zu %016llx %-4s %4d  %s\n",
+               j->e->name, status_names[j->st], j->wall * 1000.0, j->cycles,
+               j->wall > 0 ? j->cycles / j->wall / 1e6 : 0.0, j->out_len,
+               (unsigned long long)j->hash, j->runs ? (j->warm ? "warm" : "cold") : "-",
+               j->runs, j->worker[0] ? j->worker : "-");
+        if (j->st != ST_PASS) failures++;
+    }
+    printf("\n%zu sessions, %d failed, %.1f ms total, %d workers, %d interrupted, %d stolen\n",
+           job_count, failures, total_wall * 1000.0, workers, interrupted, stolen);
+
+    for (size_t i = 0; i < rom_count; i++) free(roms[i].image);
+    free(roms);
+    free(conns);
+    free(jobs);
+    manifest_free(&mf);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,109 @@
+/*
+ * Guest Interpreter Profiler
+ * Built-in configurations are matched against the ROM file name, the same
+ * way configure_rom() picks ROM sizes; anything else is configured with
+ * --gprof.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "guestprof.h"
+
+bool guestprof_enabled = false;
+guestprof_config guestprof_cfg;
+uint64_t guestprof_ticks[0x10000];
+uint32_t guestprof_entries[0x10000];
+uint16_t guestprof_unit = 0;
+unsigned long guestprof_last_cyc = 0;
+
+/* Per-ROM plugins */
+static const guestprof_config builtin[] = {
+    /* Grant's BASIC (NASCOM 4.7): LINEAT = WRKSPC+$A1, $FFFF in direct mode */
+    { "grantz80", "line", GP_VAR16, 0x20E6, GP_REG_HL, 0xFFFF, true },
+    { NULL, NULL, GP_VAR16, 0, GP_REG_HL, 0, false }
+};
+
+int guestprof_configure_rom(const char *rom_file) {
+    const char *basename = strrchr(rom_file, '/');
+    if (basename) basename++; else basename = rom_file;
+
+    for (int i = 0; builtin[i].rom_match; i++) {
+        if (strstr(basename, builtin[i].rom_match) != NULL) {
+            guestprof_cfg = builtin[i];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int guestprof_configure_spec(const char *spec) {
+    static const char *regs[] = {"bc", "de", "hl", "ix", "iy"};
+    char *end;
+
+    memset(&guestprof_cfg, 0, sizeof(guestprof_cfg));
+    guestprof_cfg.rom_match = "";
+
+    if (strncmp(spec, "var:", 4) == 0) {
+        guestprof_cfg.unit_name = "unit";
+        guestprof_cfg.mode = GP_VAR16;
+        guestprof_cfg.addr = (uint16_t)strtoul(spec + 4, &end, 0);
+        guestprof_cfg.idle = (*end == ':') ? (uint16_t)strtoul(end + 1, NULL, 0) : 0xFFFF;
+        guestprof_cfg.decimal = true;
+        return 0;
+    }
+    if (strncmp(spec, "pc:", 3) == 0) {
+        guestprof_cfg.unit_name = "word";
+        guestprof_cfg.mode = GP_DISPATCH;
+        guestprof_cfg.addr = (uint16_t)strtoul(spec + 3, &end, 0);
+        guestprof_cfg.idle = 0;
+        if (*end != ':') return -1;
+        for (int r = 0; r < 5; r++) {
+            if (strcmp(end + 1, regs[r]) == 0) {
+                guestprof_cfg.reg = (guestprof_reg)r;
+                return 0;
+            }
+        }
+    }
+    return -1;
+}
+
+static int cmp_ticks(const void *a, const void *b) {
+    uint64_t x = guestprof_ticks[*(const uint16_t *)a];
+    uint64_t y = guestprof_ticks[*(const uint16_t *)b];
+    return (x < y) - (x > y);
+}
+
+void guestprof_report(FILE *f, int top) {
+    static uint16_t order[0x10000];
+    uint64_t total = 0;
+    int n = 0;
+
+    for (int u = 0; u < 0x10000; u++) {
+        if (guestprof_ticks[u] == 0) continue;
+        total += guestprof_ticks[u];
+        order[n++] = (uint16_t)u;
+    }
+    qsort(order, n, sizeof(order[0]), cmp_ticks);
+
+    fprintf(f, "\nGuest profile by %s (%llu t-states):\n",
+            guestprof_cfg.unit_name, (unsigned long long)total);
+    fprintf(f, "  %-14s %14s %7s %10s\n", guestprof_cfg.unit_name, "t-states", "%", "entries");
+    for (int i = 0; i < n && i < top; i++) {
+        uint16_t u = order[i];
+        char label[32];
+        if (u == guestprof_cfg.idle) {
+            snprintf(label, sizeof(label), "(outside)");
+        } else if (guestprof_cfg.decimal) {
+            snprintf(label, sizeof(label), "%u", u);
+        } else {
+            snprintf(label, sizeof(label), "$%04X", u);
+        }
+        fprintf(f, "  %-14s %14llu %6.2f%% %10u\n", label,
+                (unsigned long long)guestprof_ticks[u],
+                total ? 100.0 * guestprof_ticks[u] / total : 0.0,
+                guestprof_entries[u]);
+    }
+}
@@ -0,0 +1,76 @@
+/*
+ * Guest Interpreter Profiler - Header
+ * Attributes t-states to BASIC lines, Forth words or other guest-language
+ * units, identified by a RAM variable or by a dispatch-PC hook
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef GUESTPROF_H
+#define GUESTPROF_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "z80.h"
+
+typedef enum {
+    GP_VAR16,      /* Unit = 16-bit little-endian variable at 'addr' */
+    GP_DISPATCH    /* Unit = register pair 'reg' whenever PC reaches 'addr' */
+} guestprof_mode;
+
+typedef enum { GP_REG_BC, GP_REG_DE, GP_REG_HL, GP_REG_IX, GP_REG_IY } guestprof_reg;
+
+typedef struct {
+    const char *rom_match;   /* Substring of the ROM file name */
+    const char *unit_name;   /* "line", "word", ... */
+    guestprof_mode mode;
+    uint16_t addr;
+    guestprof_reg reg;
+    uint16_t idle;           /* Unit value meaning "outside any unit" */
+    bool decimal;            /* Print units in decimal (line numbers) */
+} guestprof_config;
+
+extern bool guestprof_enabled;
+extern guestprof_config guestprof_cfg;
+extern uint64_t guestprof_ticks[0x10000];     /* T-states per unit */
+extern uint32_t guestprof_entries[0x10000];   /* Times each unit was entered */
+extern uint16_t guestprof_unit;               /* Current unit */
+extern unsigned long guestprof_last_cyc;
+
+/* Pick a built-in configuration by ROM name; returns -1 if none matches */
+int guestprof_configure_rom(const char *rom_file);
+
+/* Parse "var:ADDR[:IDLE]" or "pc:ADDR:REG" (REG = bc|de|hl|ix|iy) */
+int guestprof_configure_spec(const char *spec);
+
+static inline uint16_t guestprof_regpair(const z80 *cpu, guestprof_reg reg) {
+    switch (reg) {
+    case GP_REG_BC: return (cpu->b << 8) | cpu->c;
+    case GP_REG_DE: return (cpu->d << 8) | cpu->e;
+    case GP_REG_HL: return (cpu->h << 8) | cpu->l;
+    case GP_REG_IX: return cpu->ix;
+    default:        return cpu->iy;
+    }
+}
+
+/* Account the t-states of the step that just ran to the current unit.
+ * Variable mode costs one 16-bit load; dispatch mode one PC compare. */
+static inline void guestprof_step(const z80 *cpu, const uint8_t *mem) {
+    uint16_t unit = guestprof_unit;
+    if (guestprof_cfg.mode == GP_VAR16) {
+        unit = mem[guestprof_cfg.addr] | (mem[(uint16_t)(guestprof_cfg.addr + 1)] << 8);
+        if (unit != guestprof_unit) guestprof_entries[unit]++;
+    } else if (cpu->pc == guestprof_cfg.addr) {
+        unit = guestprof_regpair(cpu, guestprof_cfg.reg);
+        guestprof_entries[unit]++;
+    }
+    guestprof_ticks[unit] += cpu->cyc - guestprof_last_cyc;
+    guestprof_last_cyc = cpu->cyc;
+    guestprof_unit = unit;
+}
+
+void guestprof_report(FILE *f, int top);
+
+#endif /* GUESTPROF_H */
@@ -0,0 +1,155 @@
+/*
+ * Host Input Fast Path
+ * Regular files are mapped whole; pipes are read 64KB at a time into a
+ * private buffer. While the buffer holds data, hostin_ready() is a compare.
+ * When it runs dry, the source is re-read at most once every
+ * RETRY_CYCLES so an idle guest polling its UART doesn't turn into a
+ * syscall loop.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hostin.h"
+#include "phase.h"
+
+#define CHUNK_SIZE   0x10000
+#define RETRY_CYCLES 20000    /* ~5ms of guest time at 4MHz */
+
+bool hostin_active = false;
+bool hostin_done = false;
+const uint8_t *hostin_buf = NULL;
+size_t hostin_pos = 0, hostin_len = 0;
+unsigned long hostin_next = 0;
+unsigned long hostin_pace = 0;
+
+static int src_fd = -1;
+static int src_flags = -1;            /* Original fcntl flags, restored at exit */
+static hostin_eof_policy eof_policy = HOSTIN_EOF_IDLE;
+static bool src_eof = false;
+static unsigned long retry_cyc = 0;
+static uint8_t *map = NULL;           /* Mapped regular file */
+static size_t map_len = 0;
+static uint8_t chunk[CHUNK_SIZE];     /* Pipe / growing-file buffer */
+
+int hostin_parse_eof(const char *s, hostin_eof_policy *policy) {
+    if (strcmp(s, "idle") == 0) *policy = HOSTIN_EOF_IDLE;
+    else if (strcmp(s, "stop") == 0) *policy = HOSTIN_EOF_STOP;
+    else if (strcmp(s, "poll") == 0) *policy = HOSTIN_EOF_POLL;
+    else return -1;
+    return 0;
+}
+
+int hostin_open(int fd, unsigned long pace, hostin_eof_policy policy) {
+    struct stat st;
+
+    if (isatty(fd)) return 0;
+    if (fstat(fd, &st) < 0) {
+        perror("stdin");
+        return -1;
+    }
+
+    src_fd = fd;
+    eof_policy = policy;
+    hostin_pace = pace;
+    hostin_active = true;
+
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        map_len = (size_t)st.st_size;
+        map = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            map = NULL;
+            map_len = 0;
+        } else {
+            hostin_buf = map;
+            hostin_len = map_len;
+            /* Later reads (poll policy) continue after the mapping */
+            lseek(fd, (off_t)map_len, SEEK_SET);
+            return 1;
+        }
+    }
+
+    /* Pipes and anything that can't be mapped: non-blocking chunked reads */
+    src_flags = fcntl(fd, F_GETFL);
+    if (src_flags >= 0) {
+        fcntl(fd, F_SETFL, src_flags | O_NONBLOCK);
+        atexit(hostin_close);   /* The pipe may be shared with our parent */
+    }
+    hostin_buf = chunk;
+    return 1;
+}
+
+bool hostin_refill(unsigned long cyc) {
+    if (!hostin_active || hostin_done) return false;
+    if (src_eof && eof_policy != HOSTIN_EOF_POLL) return false;
+    if (cyc < retry_cyc) return false;
+
+    /* A consumed mapping is finished with; new data goes to the chunk */
+    if (hostin_buf == map && map) {
+        munmap(map, map_len);
+        map = NULL;
+        hostin_buf = chunk;
+    }
+
+    phase_id ph = phase_enter(PH_HOSTIO);
+    ssize_t n = read(src_fd, chunk, CHUNK_SIZE);
+    phase_leave(ph);
+    if (n > 0) {
+        hostin_buf = chunk;
+        hostin_pos = 0;
+        hostin_len = (size_t)n;
+        src_eof = false;
+        return true;
+    }
+    if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+        src_eof = true;
+    }
+    retry_cyc = cyc + RETRY_CYCLES;
+    return false;
+}
+
+void hostin_guest_poll_empty(void) {
+    if (eof_policy == HOSTIN_EOF_STOP && src_eof && hostin_pos == hostin_len) {
+        hostin_done = true;
+    }
+}
+
+uint64_t hostin_skip(uint64_t n) {
+    uint64_t skipped = 0;
+    while (skipped < n) {
+        if (hostin_pos == hostin_len) {
+            /* Wait for a pipe writer rather than losing position */
+            retry_cyc = 0;
+            if (!hostin_refill(0)) {
+                if (src_eof) break;
+                struct timespec ms = {0, 1000000};
+                nanosleep(&ms, NULL);
+                continue;
+            }
+        }
+        size_t take = hostin_len - hostin_pos;
+        if (take > n - skipped) take = (size_t)(n - skipped);
+        hostin_pos += take;
+        skipped += take;
+    }
+    return skipped;
+}
+
+void hostin_close(void) {
+    if (map) munmap(map, map_len);
+    map = NULL;
+    if (src_fd >= 0 && src_flags >= 0) fcntl(src_fd, F_SETFL, src_flags);
+    src_fd = -1;
+    hostin_active = false;
+}
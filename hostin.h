@@ -0,0 +1,65 @@
+/*
+ * Host Input Fast Path - Header
+ * When stdin is a regular file (mmap) or a pipe (64KB reads), guest RX is
+ * served from memory and polling the serial status costs no syscalls.
+ * Terminals keep the select()/getchar() path in retroshield.c.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef HOSTIN_H
+#define HOSTIN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* What happens once all input has been read by the guest */
+typedef enum {
+    HOSTIN_EOF_IDLE,   /* Keep running with no input (default) */
+    HOSTIN_EOF_STOP,   /* Stop when the guest next polls for input */
+    HOSTIN_EOF_POLL    /* Keep checking the source for new data */
+} hostin_eof_policy;
+
+extern bool hostin_active;            /* Fast path in use */
+extern bool hostin_done;              /* Input exhausted under HOSTIN_EOF_STOP */
+extern const uint8_t *hostin_buf;
+extern size_t hostin_pos, hostin_len;
+extern unsigned long hostin_next;     /* Cycle the next byte becomes visible */
+extern unsigned long hostin_pace;     /* Cycles between delivered bytes */
+
+/* Engage the fast path for fd unless it is a terminal.
+ * Returns 1 if engaged, 0 for a terminal, -1 on error. */
+int hostin_open(int fd, unsigned long pace, hostin_eof_policy policy);
+
+/* Parse "stop", "idle" or "poll" */
+int hostin_parse_eof(const char *s, hostin_eof_policy *policy);
+
+/* Slow path: buffer is dry, refill it (rate-limited by cycles) */
+bool hostin_refill(unsigned long cyc);
+
+/* Is a byte available to the guest at cycle cyc? */
+static inline bool hostin_ready(unsigned long cyc) {
+    if (hostin_pos < hostin_len) return cyc >= hostin_next;
+    return hostin_refill(cyc) && cyc >= hostin_next;
+}
+
+/* The guest's own status or data read found no byte. Under
+ * HOSTIN_EOF_STOP with the source exhausted this sets hostin_done; other
+ * checks (interrupt raising, loop fast-forward) must not call it, or the
+ * run would end before the guest acts on its last byte. */
+void hostin_guest_poll_empty(void);
+
+/* Take the next byte; call only after hostin_ready() */
+static inline uint8_t hostin_getc(unsigned long cyc) {
+    hostin_next = cyc + hostin_pace;
+    return hostin_buf[hostin_pos++];
+}
+
+/* Discard n bytes regardless of pacing (snapshot restore); returns count */
+uint64_t hostin_skip(uint64_t n);
+
+void hostin_close(void);
+
+#endif /* HOSTIN_H */
@@ -0,0 +1,145 @@
+/*
+ * Port I/O Statistics
+ * Sites live in an open-addressed table; firmware has a handful of IN/OUT
+ * instructions, so it never comes close to filling.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdlib.h>
+#include "iostats.h"
+
+#define SITE_SLOTS 4096   /* Power of two */
+
+typedef struct {
+    uint64_t reads, writes, poll_cycles;
+} port_totals;
+
+bool iostats_enabled = false;
+
+static iostats_site sites[SITE_SLOTS];
+static int site_count = 0;
+static uint64_t dropped = 0;        /* Accesses after the table filled */
+static port_totals ports[256];
+static const iostats_site *order[SITE_SLOTS];
+
+static iostats_site *lookup(uint8_t port, uint16_t pc) {
+    uint32_t key = ((uint32_t)pc << 8 | port) + 1;
+    uint32_t h = (key * 2654435761u) >> 20;
+
+    for (int probe = 0; probe < SITE_SLOTS; probe++) {
+        iostats_site *s = &sites[(h + probe) & (SITE_SLOTS - 1)];
+        if (s->key == key) return s;
+        if (s->key == 0) {
+            if (site_count >= SITE_SLOTS / 2) break;
+            s->key = key;
+            site_count++;
+            return s;
+        }
+    }
+    dropped++;
+    return NULL;
+}
+
+void iostats_in(uint8_t port, uint16_t pc, uint8_t val, unsigned long cyc) {
+    ports[port].reads++;
+    iostats_site *s = lookup(port, pc);
+    if (!s) return;
+
+    if (s->reads > 0 && val == s->last_val && cyc - s->last_cyc <= IOSTATS_POLL_GAP) {
+        s->unchanged++;
+        s->streak_cycles += cyc - s->last_cyc;
+        if (++s->streak > s->max_streak) s->max_streak = s->streak;
+        /* A few equal data bytes in a row are not a loop; wait for the run
+         * to get long before charging its cycles */
+        if (s->streak >= IOSTATS_POLL_STREAK) {
+            s->poll_cycles += s->streak_cycles;
+            ports[port].poll_cycles += s->streak_cycles;
+            s->streak_cycles = 0;
+        }
+    } else {
+        s->streak = 0;
+        s->streak_cycles = 0;
+    }
+    s->reads++;
+    s->last_val = val;
+    s->last_cyc = cyc;
+}
+
+void iostats_out(uint8_t port, uint16_t pc) {
+    ports[port].writes++;
+    iostats_site *s = lookup(port, pc);
+    if (s) s->writes++;
+}
+
+static int cmp_accesses(const void *a, const void *b) {
+    const iostats_site *x = *(const iostats_site * const *)a;
+    const iostats_site *y = *(const iostats_site * const *)b;
+    uint64_t nx = x->reads + x->writes, ny = y->reads + y->writes;
+    return nx < ny ? 1 : nx > ny ? -1 : (x->key > y->key) - (x->key < y->key);
+}
+
+int iostats_pollers(const iostats_site ***out) {
+    int n = 0;
+    for (int i = 0; i < SITE_SLOTS; i++) {
+        if (sites[i].key && sites[i].max_streak >= IOSTATS_POLL_STREAK) {
+            order[n++] = &sites[i];
+        }
+    }
+    qsort(order, n, sizeof(order[0]), cmp_accesses);
+    *out = order;
+    return n;
+}
+
+void iostats_report(FILE *f, unsigned long total_cycles, int top) {
+    double total = total_cycles ? (double)total_cycles : 1.0;
+
+    fprintf(f, "\nPort I/O (%lu cycles):\n", total_cycles);
+    fprintf(f, "  %-6s %12s %12s %14s %7s\n", "port", "reads", "writes", "poll cycles", "%");
+    for (int p = 0; p < 256; p++) {
+        if (ports[p].reads == 0 && ports[p].writes == 0) continue;
+        fprintf(f, "  $%02X    %12llu %12llu %14llu %6.2f%%\n", p,
+                (unsigned long long)ports[p].reads, (unsigned long long)ports[p].writes,
+                (unsigned long long)ports[p].poll_cycles,
+                100.0 * ports[p].poll_cycles / total);
+    }
+
+    int n = 0;
+    for (int i = 0; i < SITE_SLOTS; i++) {
+        if (sites[i].key) order[n++] = &sites[i];
+    }
+    qsort(order, n, sizeof(order[0]), cmp_accesses);
+
+    fprintf(f, "\n  %-6s %-6s %12s %12s %10s %14s\n",
+            "pc", "port", "reads", "writes", "unchanged", "poll cycles");
+    for (int i = 0; i < n && i < top; i++) {
+        const iostats_site *s = order[i];
+        uint32_t key = s->key - 1;
+        fprintf(f, "  $%04X  $%02X    %12llu %12llu %9.1f%% %14llu%s\n",
+                (unsigned)(key >> 8), (unsigned)(key & 0xFF),
+                (unsigned long long)s->reads, (unsigned long long)s->writes,
+                s->reads ? 100.0 * s->unchanged / s->reads : 0.0,
+                (unsigned long long)s->poll_cycles,
+                s->max_streak >= IOSTATS_POLL_STREAK ? "  polling" : "");
+    }
+    if (dropped) {
+        fprintf(f, "  (%llu accesses from further sites not tracked)\n",
+                (unsigned long long)dropped);
+    }
+
+    /* Summary: the status-poll loops, which a faster device model or an
+     * interrupt-driven guest would turn into useful work */
+    const iostats_site **polls;
+    int np = iostats_pollers(&polls);
+    uint64_t poll_total = 0;
+    for (int i = 0; i < np; i++) poll_total += polls[i]->poll_cycles;
+    fprintf(f, "\n  %d polling site%s, %llu cycles (%.2f%%)", np, np == 1 ? "" : "s",
+            (unsigned long long)poll_total, 100.0 * poll_total / total);
+    for (int i = 0; i < np && i < top; i++) {
+        uint32_t key = polls[i]->key - 1;
+        fprintf(f, "%s $%04X/$%02X", i ? "," : ":",
+                (unsigned)(key >> 8), (unsigned)(key & 0xFF));
+    }
+    fputc('\n', f);
+}
@@ -0,0 +1,47 @@
+/*
+ * Port I/O Statistics - Header
+ * Counts reads and writes per port and per issuing PC, and spots status
+ * polling loops: a PC re-reading the same port and getting the same value
+ * back within a short gap. Once a run of such reads is long enough to be a
+ * loop, the cycles between them count as "polling".
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef IOSTATS_H
+#define IOSTATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define IOSTATS_POLL_GAP    2000   /* Max cycles between reads of one poll loop */
+#define IOSTATS_POLL_STREAK 8      /* Unchanged reads before a PC is a poller */
+
+/* One (PC, port) pair */
+typedef struct {
+    uint32_t key;                /* (pc << 8 | port) + 1, 0 = empty slot */
+    uint64_t reads, writes;
+    uint64_t unchanged;          /* Reads returning the previous value */
+    uint64_t poll_cycles;        /* Cycles spent in this site's poll loop */
+    uint64_t streak_cycles;      /* Cycles in the current run, not yet counted */
+    uint32_t streak, max_streak;
+    uint8_t last_val;
+    unsigned long last_cyc;
+} iostats_site;
+
+extern bool iostats_enabled;
+
+/* Hooks, called from port_in/port_out with the IN/OUT instruction's PC */
+void iostats_in(uint8_t port, uint16_t pc, uint8_t val, unsigned long cyc);
+void iostats_out(uint8_t port, uint16_t pc);
+
+/* Sites whose max_streak reached IOSTATS_POLL_STREAK; returns count and
+ * points *sites at them (valid until the next hook call) */
+int iostats_pollers(const iostats_site ***sites);
+
+/* Per-port totals, then the top PCs by accesses; total_cycles for percent */
+void iostats_report(FILE *f, unsigned long total_cycles, int top);
+
+#endif /* IOSTATS_H */
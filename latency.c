@@ -0,0 +1,130 @@
+/*
+ * Keystroke-to-Echo Latency
+ * Keys move through a ring of in-flight entries: a guest read stamps the
+ * oldest unread key, the next TX byte stamps every key read since the
+ * previous TX, and the next frame completes every key that has a TX stamp.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "latency.h"
+
+#define INFLIGHT_SIZE 1024   /* Keys between queueing and display */
+#define SAMPLE_SIZE   4096   /* Completed keys kept for percentiles */
+
+typedef struct {
+    uint64_t t_key, t_read, t_tx;
+} inflight;
+
+bool latency_enabled = false;
+
+static inflight ring[INFLIGHT_SIZE];
+static uint32_t key_idx = 0;     /* Next slot for a new key */
+static uint32_t read_idx = 0;    /* Oldest key not yet read */
+static uint32_t tx_idx = 0;      /* Oldest read key without a TX stamp */
+static uint32_t frame_idx = 0;   /* Oldest key not yet displayed */
+
+static uint32_t samples[LAT_NSTAGES][SAMPLE_SIZE];  /* Microseconds */
+static unsigned long completed = 0;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint32_t to_us(uint64_t from, uint64_t to) {
+    uint64_t d = to > from ? (to - from) / 1000 : 0;
+    return d > UINT32_MAX ? UINT32_MAX : (uint32_t)d;
+}
+
+void latency_key(void) {
+    if (!latency_enabled) return;
+    /* A full ring drops the oldest key rather than blocking input */
+    if (key_idx - frame_idx == INFLIGHT_SIZE) {
+        frame_idx++;
+        if (tx_idx < frame_idx) tx_idx = frame_idx;
+        if (read_idx < frame_idx) read_idx = frame_idx;
+    }
+    ring[key_idx % INFLIGHT_SIZE].t_key = now_ns();
+    key_idx++;
+}
+
+void latency_guest_read(void) {
+    if (!latency_enabled || read_idx == key_idx) return;
+    ring[read_idx % INFLIGHT_SIZE].t_read = now_ns();
+    read_idx++;
+}
+
+void latency_tx(void) {
+    if (!latency_enabled || tx_idx == read_idx) return;
+    uint64_t t = now_ns();
+    for (; tx_idx != read_idx; tx_idx++) {
+        ring[tx_idx % INFLIGHT_SIZE].t_tx = t;
+    }
+}
+
+void latency_frame(void) {
+    if (!latency_enabled || frame_idx == tx_idx) return;
+    uint64_t t = now_ns();
+    for (; frame_idx != tx_idx; frame_idx++) {
+        const inflight *e = &ring[frame_idx % INFLIGHT_SIZE];
+        uint32_t slot = completed % SAMPLE_SIZE;
+        samples[LAT_KEY_TO_READ][slot] = to_us(e->t_key, e->t_read);
+        samples[LAT_READ_TO_TX][slot] = to_us(e->t_read, e->t_tx);
+        samples[LAT_TX_TO_FRAME][slot] = to_us(e->t_tx, t);
+        samples[LAT_TOTAL][slot] = to_us(e->t_key, t);
+        completed++;
+    }
+}
+
+unsigned latency_pending_reads(void) {
+    return key_idx - read_idx;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+void latency_summarize(latency_summary *s) {
+    static uint32_t sorted[SAMPLE_SIZE];
+    size_t n = completed < SAMPLE_SIZE ? completed : SAMPLE_SIZE;
+
+    memset(s, 0, sizeof(*s));
+    s->count = completed;
+    if (n == 0) return;
+
+    for (int st = 0; st < LAT_NSTAGES; st++) {
+        memcpy(sorted, samples[st], n * sizeof(uint32_t));
+        qsort(sorted, n, sizeof(uint32_t), cmp_u32);
+        s->p50_ms[st] = sorted[(n - 1) * 50 / 100] / 1000.0;
+        s->p99_ms[st] = sorted[(n - 1) * 99 / 100] / 1000.0;
+        s->max_ms[st] = sorted[n - 1] / 1000.0;
+    }
+}
+
+void latency_report(FILE *f) {
+    static const char *names[LAT_NSTAGES] = {
+        "key -> guest read", "guest read -> TX", "TX -> frame", "key -> frame"
+    };
+    latency_summary s;
+    latency_summarize(&s);
+
+    fprintf(f, "\nKeystroke latency (%lu keys, last %d used):\n", s.count, SAMPLE_SIZE);
+    if (s.count == 0) {
+        fprintf(f, "  no echoed keys\n");
+        return;
+    }
+    fprintf(f, "  %-20s %10s %10s %10s\n", "stage", "p50 ms", "p99 ms", "max ms");
+    for (int st = 0; st < LAT_NSTAGES; st++) {
+        fprintf(f, "  %-20s %10.3f %10.3f %10.3f\n", names[st],
+                s.p50_ms[st], s.p99_ms[st], s.max_ms[st]);
+    }
+}
@@ -0,0 +1,47 @@
+/*
+ * Keystroke-to-Echo Latency - Header
+ * Timestamps each host key through guest read, first TX byte and display
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Stages measured between consecutive timestamps */
+enum {
+    LAT_KEY_TO_READ,   /* Host key queued -> guest read via port_in */
+    LAT_READ_TO_TX,    /* Guest read -> first following TX byte */
+    LAT_TX_TO_FRAME,   /* TX byte -> frame/flush that shows it */
+    LAT_TOTAL,         /* Host key -> frame */
+    LAT_NSTAGES
+};
+
+typedef struct {
+    unsigned long count;   /* Completed keys */
+    double p50_ms[LAT_NSTAGES];
+    double p99_ms[LAT_NSTAGES];
+    double max_ms[LAT_NSTAGES];
+} latency_summary;
+
+extern bool latency_enabled;
+
+/* Stage hooks, called in order by the front-end */
+void latency_key(void);
+void latency_guest_read(void);
+void latency_tx(void);
+void latency_frame(void);
+
+/* Keys stamped but not yet read by the guest */
+unsigned latency_pending_reads(void);
+
+/* Percentiles over the most recent completed keys */
+void latency_summarize(latency_summary *s);
+void latency_report(FILE *f);
+
+#endif /* LATENCY_H */
@@ -0,0 +1,208 @@
+/*
+ * Loop Idiom Fast-Forward
+ * Each idiom is a byte pattern at the loop head, a per-iteration cost
+ * (t-states, instructions, R increments) and a kernel that applies s
+ * iterations at once. The pattern is re-checked before every use, so code
+ * in RAM that changes simply stops matching.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <string.h>
+#include "loopff.h"
+
+typedef struct {
+    const char *name;
+    uint8_t len;            /* Loop body bytes */
+    uint8_t cyc;            /* T-states per taken iteration */
+    uint8_t instr;          /* Instructions per iteration */
+    uint8_t r;              /* R increments per iteration */
+} idiom_info;
+
+static const idiom_info idioms[LF_NIDIOMS] = {
+    [LF_DJNZ]     = { "djnz $",           2, 13, 1, 1 },
+    [LF_DELAY_BC] = { "dec bc delay",     5, 26, 4, 4 },
+    [LF_FILL_N]   = { "fill (hl),n",      8, 42, 6, 6 },
+    [LF_FILL_R]   = { "fill (hl),r",      7, 39, 6, 6 },
+    [LF_LDIR]     = { "ldir",             2, 21, 1, 2 },
+    [LF_CPIR]     = { "cpir",             2, 21, 1, 2 },
+};
+
+bool loopff_enabled = false;
+uint8_t loopff_idiom[0x10000];
+
+static uint64_t hits[LF_NIDIOMS];
+static uint64_t declined[LF_NIDIOMS];
+static uint64_t iters[LF_NIDIOMS];
+static uint64_t cycles[LF_NIDIOMS];
+
+static bool match(const uint8_t *mem, uint16_t pc, const uint8_t *pat, int len) {
+    for (int i = 0; i < len; i++) {
+        if (mem[(uint16_t)(pc + i)] != pat[i]) return false;
+    }
+    return true;
+}
+
+static int classify(const uint8_t *mem, uint16_t pc) {
+    static const uint8_t djnz[] = { 0x10, 0xFE };
+    static const uint8_t delay_bc[] = { 0x0B, 0x78, 0xB1, 0x20, 0xFB };
+    static const uint8_t delay_cb[] = { 0x0B, 0x79, 0xB0, 0x20, 0xFB };
+    static const uint8_t fill_tail[] = { 0x23, 0x0B, 0x78, 0xB1, 0x20 };
+    static const uint8_t ldir[] = { 0xED, 0xB0 };
+    static const uint8_t cpir[] = { 0xED, 0xB1 };
+    uint8_t op = mem[pc];
+
+    if (match(mem, pc, djnz, 2)) return LF_DJNZ;
+    if (match(mem, pc, delay_bc, 5) || match(mem, pc, delay_cb, 5)) return LF_DELAY_BC;
+    if (op == 0x36 && match(mem, (uint16_t)(pc + 2), fill_tail, 5) &&
+        mem[(uint16_t)(pc + 7)] == 0xF8) {
+        return LF_FILL_N;
+    }
+    if ((op == 0x72 || op == 0x73) && match(mem, (uint16_t)(pc + 1), fill_tail, 5) &&
+        mem[(uint16_t)(pc + 6)] == 0xF9) {
+        return LF_FILL_R;
+    }
+    if (match(mem, pc, ldir, 2)) return LF_LDIR;
+    if (match(mem, pc, cpir, 2)) return LF_CPIR;
+    return LF_NONE;
+}
+
+void loopff_learn(uint16_t pc, const uint8_t *mem, uint16_t ram_start) {
+    int kind = classify(mem, pc);
+    /* Code in RAM may change: leave it unclassified so it is looked at again */
+    if (kind != LF_NONE || pc < ram_start) loopff_idiom[pc] = (uint8_t)kind;
+}
+
+static inline uint16_t get_bc(const z80 *z) { return (z->b << 8) | z->c; }
+static inline uint16_t get_hl(const z80 *z) { return (z->h << 8) | z->l; }
+static inline uint16_t get_de(const z80 *z) { return (z->d << 8) | z->e; }
+static inline void set_bc(z80 *z, uint16_t v) { z->b = v >> 8; z->c = v & 0xFF; }
+static inline void set_hl(z80 *z, uint16_t v) { z->h = v >> 8; z->l = v & 0xFF; }
+static inline void set_de(z80 *z, uint16_t v) { z->d = v >> 8; z->e = v & 0xFF; }
+
+/* Does [start, start + len) stay in writable RAM and clear of the loop? */
+static bool writable(uint32_t start, uint32_t len, uint16_t pc, int body,
+                     uint16_t ram_start) {
+    if (start < ram_start || start + len > 0x10000) return false;
+    return start + len <= pc || start >= (uint32_t)pc + body;
+}
+
+uint64_t loopff_try(z80 *cpu, uint8_t *mem, const loopff_limits *lim,
+                    uint16_t *wr_start, uint32_t *wr_len) {
+    uint16_t pc = cpu->pc;
+    int kind = loopff_idiom[pc];
+    *wr_start = 0;
+    *wr_len = 0;
+
+    if (classify(mem, pc) != kind) {
+        loopff_idiom[pc] = pc < lim->ram_start ? LF_NONE : 0;
+        return 0;
+    }
+    const idiom_info *id = &idioms[kind];
+
+    /* Iterations left, counting the one about to start */
+    uint32_t n;
+    uint16_t bc = get_bc(cpu), hl = get_hl(cpu);
+    switch (kind) {
+    case LF_DJNZ:
+        n = cpu->b ? cpu->b : 256;
+        break;
+    case LF_CPIR: {
+        uint32_t span = bc ? bc : 0x10000;
+        if (span > 0x10000u - hl) span = 0x10000u - hl;   /* No wrap */
+        const uint8_t *hit = memchr(mem + hl, cpu->a, span);
+        n = hit ? (uint32_t)(hit - (mem + hl)) + 1 : span;
+        break;
+    }
+    default:
+        n = bc ? bc : 0x10000;
+        break;
+    }
+    if (n < 3) return 0;
+
+    /* Skip all but the last two iterations, within the front-end's limits */
+    uint64_t s = n - 2;
+    if (cpu->cyc >= lim->max_cyc) s = 0;
+    else if (s > (lim->max_cyc - cpu->cyc) / id->cyc) s = (lim->max_cyc - cpu->cyc) / id->cyc;
+    if (s > lim->max_instr / id->instr) s = lim->max_instr / id->instr;
+
+    switch (kind) {
+    case LF_FILL_N:
+    case LF_FILL_R:
+        if (!writable(hl, (uint32_t)s, pc, id->len, lim->ram_start)) s = 0;
+        break;
+    case LF_LDIR:
+        if ((uint32_t)hl + s > 0x10000 ||
+            !writable(get_de(cpu), (uint32_t)s, pc, id->len, lim->ram_start)) {
+            s = 0;
+        }
+        break;
+    }
+    if (s < 2) {
+        declined[kind]++;
+        return 0;
+    }
+
+    /* Closed form for s - 1 iterations; the last skipped one is interpreted
+     * so A, flags and WZ are exactly what a full run leaves at the head */
+    uint32_t k = (uint32_t)s - 1;
+    switch (kind) {
+    case LF_DJNZ:
+        cpu->b -= (uint8_t)k;
+        break;
+    case LF_DELAY_BC:
+        set_bc(cpu, (uint16_t)(bc - k));
+        break;
+    case LF_FILL_N:
+    case LF_FILL_R: {
+        uint8_t v = kind == LF_FILL_N ? mem[(uint16_t)(pc + 1)]
+                  : mem[pc] == 0x72 ? cpu->d : cpu->e;
+        memset(mem + hl, v, k);
+        *wr_start = hl;
+        *wr_len = k;
+        set_hl(cpu, (uint16_t)(hl + k));
+        set_bc(cpu, (uint16_t)(bc - k));
+        break;
+    }
+    case LF_LDIR: {
+        uint16_t de = get_de(cpu);
+        if (de > hl && de < hl + k) {
+            /* Overlapping forward copy repeats the pattern; keep its meaning */
+            for (uint32_t i = 0; i < k; i++) mem[de + i] = mem[hl + i];
+        } else {
+            memmove(mem + de, mem + hl, k);
+        }
+        *wr_start = de;
+        *wr_len = k;
+        set_hl(cpu, (uint16_t)(hl + k));
+        set_de(cpu, (uint16_t)(de + k));
+        set_bc(cpu, (uint16_t)(bc - k));
+        break;
+    }
+    case LF_CPIR:
+        set_hl(cpu, (uint16_t)(hl + k));
+        set_bc(cpu, (uint16_t)(bc - k));
+        break;
+    }
+    cpu->cyc += (unsigned long)k * id->cyc;
+    cpu->r = (cpu->r & 0x80) | ((cpu->r + k * id->r) & 0x7F);
+
+    for (int i = 0; i < id->instr; i++) z80_step(cpu);
+
+    hits[kind]++;
+    iters[kind] += s;
+    cycles[kind] += s * id->cyc;
+    return s * id->instr;
+}
+
+void loopff_report(FILE *f) {
+    fprintf(f, "\nLoop fast-forward:\n");
+    fprintf(f, "  %-16s %10s %10s %14s %14s\n", "idiom", "hits", "declined", "iterations", "t-states");
+    for (int k = LF_DJNZ; k < LF_NIDIOMS; k++) {
+        if (hits[k] == 0 && declined[k] == 0) continue;
+        fprintf(f, "  %-16s %10llu %10llu %14llu %14llu\n", idioms[k].name,
+                (unsigned long long)hits[k], (unsigned long long)declined[k],
+                (unsigned long long)iters[k], (unsigned long long)cycles[k]);
+    }
+}
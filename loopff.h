@@ -0,0 +1,54 @@
+/*
+ * Loop Idiom Fast-Forward - Header
+ * When a backward branch lands on a PC, the code there is matched against
+ * known loop idioms (DJNZ $, DEC BC delay loops, fill loops, LDIR, CPIR).
+ * On later visits the loop is advanced in closed form, leaving its last two
+ * iterations to the interpreter so flags, WZ and the exit path come out
+ * exactly as if every iteration had run.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef LOOPFF_H
+#define LOOPFF_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "z80.h"
+
+/* Idioms; 0 = not yet classified */
+enum {
+    LF_NONE = 1,      /* Classified, no idiom */
+    LF_DJNZ,          /* djnz $ */
+    LF_DELAY_BC,      /* dec bc / ld a,b / or c / jr nz (or ld a,c / or b) */
+    LF_FILL_N,        /* ld (hl),n / inc hl / dec bc / ld a,b / or c / jr nz */
+    LF_FILL_R,        /* Same with ld (hl),d or ld (hl),e */
+    LF_LDIR,
+    LF_CPIR,
+    LF_NIDIOMS
+};
+
+/* Bounds the front-end puts on one fast-forward */
+typedef struct {
+    unsigned long max_cyc;       /* cpu.cyc must stay at or below this */
+    uint64_t max_instr;          /* Instructions that may be skipped */
+    uint16_t ram_start;          /* Lowest address writes may land on */
+} loopff_limits;
+
+extern bool loopff_enabled;
+extern uint8_t loopff_idiom[0x10000];
+
+/* Classify the code at pc after a backward branch to it */
+void loopff_learn(uint16_t pc, const uint8_t *mem, uint16_t ram_start);
+
+/* Advance the loop at cpu->pc. Returns instructions skipped (0 if declined);
+ * bytes written directly are [*wr_start, *wr_start + *wr_len). One
+ * iteration runs through z80_step(), i.e. the front-end's callbacks. */
+uint64_t loopff_try(z80 *cpu, uint8_t *mem, const loopff_limits *lim,
+                    uint16_t *wr_start, uint32_t *wr_len);
+
+void loopff_report(FILE *f);
+
+#endif /* LOOPFF_H */
@@ -0,0 +1,278 @@
+/*
+ * Reentrant RetroShield Machine
+ * Same memory map and serial behaviour as retroshield.c, but all state is
+ * reached through z80.userdata instead of file-scope globals.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "machine.h"
+
+/* MC6850 ACIA ports */
+#define ACIA_CTRL 0x80
+#define ACIA_DATA 0x81
+#define ACIA_RDRF 0x01
+#define ACIA_TDRE 0x02
+
+/* Intel 8251 USART ports */
+#define USART_DATA 0x00
+#define USART_CTRL 0x01
+#define STAT_8251_TxRDY 0x01
+#define STAT_8251_RxRDY 0x02
+#define STAT_8251_TxE   0x04
+#define STAT_DSR        0x80
+#define USART_STATUS_INIT (STAT_8251_TxRDY | STAT_8251_TxE | STAT_DSR)
+
+static inline bool rx_available(machine *m) {
+    if (m->rx_src.ready) return m->rx_src.ready(m->rx_src.ctx, m->cpu.cyc);
+    return rxq_ready(&m->rx);
+}
+
+static uint8_t rx_getchar(machine *m) {
+    uint8_t c = m->rx_src.ready ? m->rx_src.take(m->rx_src.ctx) : (uint8_t)rxq_getc(&m->rx);
+    m->int_signaled = false;
+    return c;
+}
+
+static uint8_t mem_read(void *userdata, uint16_t addr) {
+    machine *m = userdata;
+    return m->memory[addr];
+}
+
+static void mem_write(void *userdata, uint16_t addr, uint8_t val) {
+    machine *m = userdata;
+    /* Protect ROM area */
+    if (addr >= m->rom_size) {
+        m->memory[addr] = val;
+    }
+}
+
+static uint8_t port_in(z80 *z, uint8_t port) {
+    machine *m = z->userdata;
+
+    if (port == ACIA_CTRL || port == ACIA_DATA || port == USART_CTRL || port == USART_DATA) {
+        m->rx_polls++;
+    }
+
+    if (port == ACIA_CTRL) {
+        uint8_t status = ACIA_TDRE;
+        if (rx_available(m)) status |= ACIA_RDRF;
+        else m->rx_idle_polls++;
+        return status;
+    } else if (port == ACIA_DATA) {
+        if (rx_available(m)) return rx_getchar(m);
+        m->rx_idle_polls++;
+        return 0;
+    } else if (port == USART_CTRL) {
+        m->uses_8251 = true;
+        uint8_t status = USART_STATUS_INIT;
+        if (rx_available(m)) status |= STAT_8251_RxRDY;
+        else m->rx_idle_polls++;
+        return status;
+    } else if (port == USART_DATA) {
+        m->uses_8251 = true;
+        if (rx_available(m)) {
+            uint8_t c = rx_getchar(m);
+            /* Convert lowercase to uppercase like Arduino does */
+            if (c >= 'a' && c <= 'z') c = c - 'a' + 'A';
+            return c;
+        }
+        m->rx_idle_polls++;
+        return 0;
+    }
+    return 0xFF;
+}
+
+static void port_out(z80 *z, uint8_t port, uint8_t val) {
+    machine *m = z->userdata;
+
+    if (port == ACIA_CTRL) {
+        m->acia_control = val;
+    } else if (port == ACIA_DATA || port == USART_DATA) {
+        m->tx_bytes++;
+        if (m->tx) m->tx(m->tx_ctx, val);
+    }
+}
+
+/* Configure ROM size based on ROM type (matches retroshield.c) */
+static void configure_rom(machine *m, const char *filename) {
+    const char *basename = strrchr(filename, '/');
+    if (basename) basename++; else basename = filename;
+
+    if (strstr(basename, "mint") != NULL) {
+        m->rom_size = 0x0800;  /* 2KB ROM */
+    } else {
+        m->rom_size = 0x2000;  /* Default 8KB ROM */
+    }
+}
+
+void machine_reset(machine *m) {
+    z80_init(&m->cpu);
+    m->cpu.read_byte = mem_read;
+    m->cpu.write_byte = mem_write;
+    m->cpu.port_in = port_in;
+    m->cpu.port_out = port_out;
+    m->cpu.userdata = m;
+    m->acia_control = 0;
+    m->uses_8251 = false;
+    m->int_signaled = false;
+    m->instructions = 0;
+    m->rx_polls = 0;
+    m->rx_idle_polls = 0;
+    m->tx_bytes = 0;
+}
+
+machine *machine_create_image(const char *name, const uint8_t *image, size_t len) {
+    if (len == 0) {
+        fprintf(stderr, "%s: empty ROM\n", name);
+        return NULL;
+    }
+    machine *m = calloc(1, sizeof(machine));
+    if (!m) return NULL;
+
+    /* Up to full 64KB - some ROMs include RAM initialization */
+    memcpy(m->memory, image, len < MACHINE_MEM_SIZE ? len : MACHINE_MEM_SIZE);
+
+    if (rxq_init(&m->rx, RXQ_DEFAULT_SIZE) < 0) {
+        free(m);
+        return NULL;
+    }
+    configure_rom(m, name);
+    m->break_pc = -1;
+    machine_reset(m);
+    return m;
+}
+
+machine *machine_create(const char *rom_file) {
+    uint8_t *image = malloc(MACHINE_MEM_SIZE);
+    if (!image) return NULL;
+
+    FILE *f = fopen(rom_file, "rb");
+    if (!f) {
+        perror(rom_file);
+        free(image);
+        return NULL;
+    }
+    size_t bytes = fread(image, 1, MACHINE_MEM_SIZE, f);
+    fclose(f);
+    machine *m = machine_create_image(rom_file, image, bytes);
+    free(image);
+    return m;
+}
+
+void machine_copy_state(machine *dst, const machine *src) {
+    dst->cpu = src->cpu;
+    dst->cpu.userdata = dst;
+    memcpy(dst->memory, src->memory, MACHINE_MEM_SIZE);
+    dst->rom_size = src->rom_size;
+    dst->acia_control = src->acia_control;
+    dst->uses_8251 = src->uses_8251;
+    dst->int_signaled = src->int_signaled;
+    dst->instructions = src->instructions;
+    dst->rx_polls = src->rx_polls;
+    dst->rx_idle_polls = src->rx_idle_polls;
+    dst->tx_bytes = src->tx_bytes;
+}
+
+size_t machine_feed(machine *m, const uint8_t *data, size_t len) {
+    return rxq_push(&m->rx, data, len);
+}
+
+size_t machine_rx_pending(const machine *m) {
+    return rxq_pending(&m->rx);
+}
+
+/* Trigger interrupt when input is available (8251 ROMs only) */
+static inline bool serial_int(machine *m) {
+    z80 *cpu = &m->cpu;
+    if (m->uses_8251 && rx_available(m) && cpu->iff1 && !m->int_signaled &&
+        cpu->iff_delay == 0) {
+        z80_gen_int(cpu, 0xFF);  /* RST 38H vector for IM 1 */
+        m->int_signaled = true;
+        return true;
+    }
+    return false;
+}
+
+bool machine_can_wake(const machine *m) {
+    return m->cpu.halted && m->uses_8251 && m->cpu.iff1;
+}
+
+unsigned long machine_run(machine *m, unsigned long until) {
+    z80 *cpu = &m->cpu;
+    unsigned long start = cpu->cyc;
+
+    /* Input that arrived during a HALT: the INT ends it on the next step */
+    if (cpu->halted && cpu->cyc < until && serial_int(m)) {
+        z80_step(cpu);
+        m->instructions++;
+    }
+
+    while (cpu->cyc < until && !cpu->halted) {
+        z80_step(cpu);
+        m->instructions++;
+        serial_int(m);
+        if (cpu->pc == m->break_pc) break;
+    }
+    return cpu->cyc - start;
+}
+
+#define BOOT_SLICE 10000
+
+/* Scratch machine for machine_copy_state(): empty queue, no tx */
+static machine *machine_blank(void) {
+    machine *m = calloc(1, sizeof(machine));
+    if (!m) return NULL;
+    if (rxq_init(&m->rx, RXQ_DEFAULT_SIZE) < 0) {
+        free(m);
+        return NULL;
+    }
+    m->break_pc = -1;
+    return m;
+}
+
+int machine_boot_to_input(machine *m, unsigned long max_cycles) {
+    /* Find the polling instruction on a silent copy, then run m to it */
+    machine *probe = machine_blank();
+    machine *save = machine_blank();
+    int rc = -1;
+
+    if (!probe || !save) goto done;
+    machine_copy_state(probe, m);
+    uint64_t polls = probe->rx_polls;
+
+    while (probe->cpu.cyc < max_cycles && !probe->cpu.halted) {
+        machine_copy_state(save, probe);
+        machine_run(probe, probe->cpu.cyc + BOOT_SLICE);
+        if (probe->rx_polls == polls) continue;
+
+        machine_copy_state(probe, save);
+        unsigned long at;
+        do {
+            at = probe->cpu.cyc;
+            machine_run(probe, at + 1);
+        } while (probe->rx_polls == polls);
+
+        int break_pc = m->break_pc;
+        m->break_pc = -1;
+        machine_run(m, at);
+        m->break_pc = break_pc;
+        rc = 0;
+        break;
+    }
+
+done:
+    machine_destroy(probe);
+    machine_destroy(save);
+    return rc;
+}
+
+void machine_destroy(machine *m) {
+    if (!m) return;
+    rxq_free(&m->rx);
+    free(m);
+}
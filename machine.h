@@ -0,0 +1,97 @@
+/*
+ * Reentrant RetroShield Machine - Header
+ * One instance = CPU + 64KB memory + ACIA/8251 serial, so several machines
+ * can run in one process (suite runner, farm workers, co-simulation)
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "z80.h"
+#include "rxqueue.h"
+
+#define MACHINE_MEM_SIZE 0x10000
+
+/* Called for every byte the guest transmits */
+typedef void (*machine_tx_fn)(void *ctx, uint8_t c);
+
+/* Optional replacement for the rx queue (co-simulation links): ready()
+ * says whether a byte is visible at cycle cyc, take() removes it */
+typedef struct {
+    bool (*ready)(void *ctx, unsigned long cyc);
+    uint8_t (*take)(void *ctx);
+    void *ctx;
+} machine_rx_source;
+
+typedef struct machine {
+    z80 cpu;
+    uint8_t memory[MACHINE_MEM_SIZE];
+    uint16_t rom_size;
+
+    /* Serial state */
+    uint8_t acia_control;
+    bool uses_8251;
+    bool int_signaled;
+
+    /* Host -> guest bytes */
+    rxqueue rx;
+    machine_rx_source rx_src;   /* Used instead of rx when ready is set */
+
+    /* Guest -> host bytes */
+    machine_tx_fn tx;
+    void *tx_ctx;
+
+    int break_pc;               /* machine_run stops when PC lands here; -1 = off */
+
+    uint64_t instructions;
+    uint64_t rx_polls;          /* Serial status/data reads so far */
+    uint64_t rx_idle_polls;     /* ... of which found no byte waiting */
+    uint64_t tx_bytes;
+} machine;
+
+/* Allocate a machine, load a ROM and reset; ROM size is picked from the
+ * file name. Returns NULL on failure. */
+machine *machine_create(const char *rom_file);
+
+/* Same, from a ROM image already in memory; name picks the ROM size */
+machine *machine_create_image(const char *name, const uint8_t *image, size_t len);
+
+/* Copy CPU, memory and serial state from src; dst keeps its own input
+ * queue, tx callback and break_pc */
+void machine_copy_state(machine *dst, const machine *src);
+
+/* Reset the CPU, keeping memory */
+void machine_reset(machine *m);
+
+/* Append host input for the guest. May be called from one producer thread
+ * other than the one running the machine. Returns bytes queued. */
+size_t machine_feed(machine *m, const uint8_t *data, size_t len);
+
+/* Bytes queued for the guest and not yet read */
+size_t machine_rx_pending(const machine *m);
+
+/* Run until cpu.cyc reaches 'until', the CPU halts or PC reaches break_pc;
+ * returns cycles run.
+ * A halted 8251 machine with interrupts enabled resumes once input is
+ * queued (see machine_can_wake). */
+unsigned long machine_run(machine *m, unsigned long until);
+
+/* Halted, but serial input would raise an interrupt and end the HALT */
+bool machine_can_wake(const machine *m);
+
+/* Run with no input up to the instruction before the first serial read,
+ * so that copies of m can be started there with any input (until then
+ * input cannot change what the guest does). Output goes to m's tx as
+ * usual. Returns -1 if the guest halts or does not read the serial port
+ * within max_cycles. */
+int machine_boot_to_input(machine *m, unsigned long max_cycles);
+
+void machine_destroy(machine *m);
+
+#endif /* MACHINE_H */
@@ -0,0 +1,212 @@
+/*
+ * Smoke-Test Manifest
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "manifest.h"
+
+#define DEFAULT_BUDGET 10.0
+
+static char *trim(char *s) {
+    while (isspace((unsigned char)*s)) s++;
+    char *e = s + strlen(s);
+    while (e > s && isspace((unsigned char)e[-1])) e--;
+    *e = '\0';
+    return s;
+}
+
+/* Decode a value in place: "quoted" values take C escapes (\r \n \t \\ \"
+ * \xHH), bare values are used as-is. Returns the decoded length or -1. */
+static long decode_value(char *s) {
+    if (*s != '"') return (long)strlen(s);
+
+    char *out = s;
+    const char *p = s + 1;
+    while (*p && *p != '"') {
+        if (*p != '\\') {
+            *out++ = *p++;
+            continue;
+        }
+        p++;
+        switch (*p) {
+        case 'r':  *out++ = '\r'; p++; break;
+        case 'n':  *out++ = '\n'; p++; break;
+        case 't':  *out++ = '\t'; p++; break;
+        case '\\': *out++ = '\\'; p++; break;
+        case '"':  *out++ = '"';  p++; break;
+        case 'x': {
+            char hex[3] = {0};
+            char *end;
+            strncpy(hex, p + 1, 2);
+            *out++ = (char)strtoul(hex, &end, 16);
+            if (end == hex) return -1;
+            p += 1 + (end - hex);
+            break;
+        }
+        default:
+            return -1;
+        }
+    }
+    if (*p != '"') return -1;
+    return out - s;
+}
+
+static int read_file(const char *path, uint8_t **data, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    size_t cap = 4096, n = 0;
+    uint8_t *buf = malloc(cap);
+    while (buf) {
+        n += fread(buf + n, 1, cap - n, f);
+        if (n < cap) break;
+        cap *= 2;
+        uint8_t *nb = realloc(buf, cap);
+        if (!nb) {
+            free(buf);
+            buf = NULL;
+        } else {
+            buf = nb;
+        }
+    }
+    fclose(f);
+    if (!buf) return -1;
+    *data = buf;
+    *len = n;
+    return 0;
+}
+
+static void resolve(char *dst, const char *dir, const char *path) {
+    if (path[0] == '/' || dir[0] == '\0') {
+        snprintf(dst, MANIFEST_PATH_LEN, "%s", path);
+    } else {
+        snprintf(dst, MANIFEST_PATH_LEN, "%s/%s", dir, path);
+    }
+}
+
+int manifest_load(const char *path, manifest *m) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    char dir[MANIFEST_PATH_LEN] = "";
+    const char *slash = strrchr(path, '/');
+    if (slash) snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path), path);
+
+    size_t cap = 8;
+    m->entries = calloc(cap, sizeof(manifest_entry));
+    m->count = 0;
+    if (!m->entries) {
+        fclose(f);
+        return -1;
+    }
+
+    char line[4096];
+    int lineno = 0;
+    manifest_entry *cur = NULL;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *s = trim(line);
+        if (*s == '\0' || *s == '#' || *s == ';') continue;
+
+        if (*s == '[') {
+            char *close = strchr(s, ']');
+            if (!close) goto bad;
+            *close = '\0';
+            if (m->count == cap) {
+                manifest_entry *n = realloc(m->entries, 2 * cap * sizeof(manifest_entry));
+                if (!n) goto fail;
+                memset(n + cap, 0, cap * sizeof(manifest_entry));
+                m->entries = n;
+                cap *= 2;
+            }
+            cur = &m->entries[m->count++];
+            snprintf(cur->name, sizeof(cur->name), "%s", trim(s + 1));
+            cur->budget = DEFAULT_BUDGET;
+            continue;
+        }
+
+        char *eq = strchr(s, '=');
+        if (!cur || !eq) goto bad;
+        *eq = '\0';
+        char *key = trim(s);
+        char *val = trim(eq + 1);
+        long len = decode_value(val);
+        if (len < 0) goto bad;
+
+        if (strcmp(key, "rom") == 0) {
+            resolve(cur->rom, dir, val);
+        } else if (strcmp(key, "send") == 0) {
+            free(cur->input);
+            cur->input = malloc(len ? len : 1);
+            if (!cur->input) goto fail;
+            memcpy(cur->input, val, len);
+            cur->input_len = len;
+        } else if (strcmp(key, "input") == 0) {
+            char full[MANIFEST_PATH_LEN];
+            resolve(full, dir, val);
+            free(cur->input);
+            cur->input = NULL;
+            if (read_file(full, &cur->input, &cur->input_len) < 0) goto fail;
+        } else if (strcmp(key, "expect") == 0) {
+            /* An empty expect would pass before the guest ran at all */
+            if (len == 0) {
+                fprintf(stderr, "%s:%d: empty expect\n", path, lineno);
+                goto fail;
+            }
+            free(cur->expect);
+            cur->expect = malloc(len + 1);
+            if (!cur->expect) goto fail;
+            memcpy(cur->expect, val, len);
+            cur->expect[len] = '\0';
+            cur->expect_len = len;
+        } else if (strcmp(key, "budget") == 0) {
+            cur->budget = atof(val);
+        } else if (strcmp(key, "cycles") == 0) {
+            cur->cycles = strtoul(val, NULL, 0);
+        } else if (strcmp(key, "mhz") == 0) {
+            cur->mhz = atof(val);
+        } else {
+            goto bad;
+        }
+    }
+    fclose(f);
+
+    for (size_t i = 0; i < m->count; i++) {
+        if (m->entries[i].rom[0] == '\0') {
+            fprintf(stderr, "%s: [%s] has no rom\n", path, m->entries[i].name);
+            manifest_free(m);
+            return -1;
+        }
+    }
+    return 0;
+
+bad:
+    fprintf(stderr, "%s:%d: cannot parse: %s\n", path, lineno, line);
+fail:
+    fclose(f);
+    manifest_free(m);
+    return -1;
+}
+
+void manifest_free(manifest *m) {
+    for (size_t i = 0; i < m->count; i++) {
+        free(m->entries[i].input);
+        free(m->entries[i].expect);
+    }
+    free(m->entries);
+    m->entries = NULL;
+    m->count = 0;
+}
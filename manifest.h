@@ -0,0 +1,49 @@
+/*
+ * Smoke-Test Manifest - Header
+ * INI-style list of ROM sessions:
+ *
+ *   [mint]
+ *   rom    = ../firmware/mint.z80.bin
+ *   send   = "1 2 +.\r"           (or: input = file)
+ *   expect = "3"
+ *   budget = 10                   (seconds of wall time)
+ *   cycles = 50000000             (0 = unlimited)
+ *   mhz    = 4                    (emulated speed cap, 0 = none)
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MANIFEST_NAME_LEN 64
+#define MANIFEST_PATH_LEN 1024
+
+typedef struct {
+    char name[MANIFEST_NAME_LEN];
+    char rom[MANIFEST_PATH_LEN];
+    uint8_t *input;          /* Bytes sent to the guest */
+    size_t input_len;
+    char *expect;            /* Output substring that ends the session; NULL = run to halt */
+    size_t expect_len;       /* May contain NULs from \x00 escapes */
+    double budget;           /* Wall-clock seconds */
+    unsigned long cycles;    /* Cycle limit, 0 = unlimited */
+    double mhz;              /* Speed cap, 0 = unlimited */
+} manifest_entry;
+
+typedef struct {
+    manifest_entry *entries;
+    size_t count;
+} manifest;
+
+/* Parse a manifest file; relative rom/input paths are resolved against the
+ * manifest's directory. Returns -1 and prints the offending line on error. */
+int manifest_load(const char *path, manifest *m);
+
+void manifest_free(manifest *m);
+
+#endif /* MANIFEST_H */
@@ -0,0 +1,181 @@
+/*
+ * Guest Memory Checks
+ * A reported address is marked initialised, so each one is reported once
+ * and later reads take the fast path.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "memcheck.h"
+
+#define MAX_PRINTED 50   /* Individual reports before only counting */
+
+bool memcheck_enabled = false;
+uint8_t memcheck_page[256];
+uint8_t memcheck_init[0x10000 / 8];
+uint16_t memcheck_pc = 0;
+unsigned long memcheck_cyc = 0;
+bool memcheck_stack = false;
+uint16_t memcheck_stack_lo = 0, memcheck_stack_hi = 0xFFFF;
+bool memcheck_break = false;
+bool memcheck_abort = false;
+
+static bool uninit_on = false;
+static unsigned long uninit_reads = 0;
+static uint16_t first_addr, first_pc;
+static unsigned long uninit_fetches = 0;
+static uint16_t first_fetch;
+
+static memcheck_action actions[MC_NKINDS];
+static unsigned long violations[MC_NKINDS];
+static bool stack_armed = false;    /* SP has been inside the window */
+static bool stack_outside = false;
+
+static const char *kind_names[MC_NKINDS] = { "ROM write", "exec", "stack" };
+
+void memcheck_mark(uint32_t start, uint32_t end) {
+    for (uint32_t a = start; a < end && a < 0x10000; a++) {
+        memcheck_write((uint16_t)a);
+    }
+}
+
+void memcheck_uninit_enable(uint16_t ram_start, uint32_t init_end) {
+    for (unsigned p = ram_start >> 8; p < 256; p++) {
+        memcheck_page[p] |= MC_PAGE_UNINIT;
+    }
+    memcheck_mark(ram_start, init_end);
+    uninit_on = true;
+    memcheck_enabled = true;
+}
+
+void memcheck_report_uninit(uint16_t addr) {
+    /* Initialised code never gets here, so an uninitialised byte inside the
+     * instruction (4 bytes at most) was fetched as code, not read as data */
+    if ((uint16_t)(addr - memcheck_pc) < 4) {
+        if (uninit_fetches == 0) first_fetch = addr;
+        if (uninit_fetches < MAX_PRINTED) {
+            fprintf(stderr, "[memcheck] executing uninitialised $%04X (instruction at $%04X), cycle %lu\n",
+                    addr, memcheck_pc, memcheck_cyc);
+        }
+        uninit_fetches++;
+        memcheck_write(addr);
+        return;
+    }
+    if (uninit_reads == 0) {
+        first_addr = addr;
+        first_pc = memcheck_pc;
+    }
+    if (uninit_reads < MAX_PRINTED) {
+        fprintf(stderr, "[memcheck] read of uninitialised $%04X at PC=$%04X, cycle %lu\n",
+                addr, memcheck_pc, memcheck_cyc);
+    }
+    uninit_reads++;
+    memcheck_write(addr);
+}
+
+static int parse_range(const char *s, uint16_t *lo, uint16_t *hi) {
+    char *end;
+    unsigned long a = strtoul(s, &end, 16);
+    if (end == s || *end != '-') return -1;
+    const char *p = end + 1;
+    unsigned long b = strtoul(p, &end, 16);
+    if (end == p || (*end != '\0' && *end != '=') || a > b || b > 0xFFFF) return -1;
+    *lo = (uint16_t)a;
+    *hi = (uint16_t)b;
+    return 0;
+}
+
+int memcheck_protect(const char *spec, uint16_t rom_size) {
+    memcheck_action action = MC_WARN;
+    const char *eq = strchr(spec, '=');
+    if (eq) {
+        if (strcmp(eq + 1, "warn") == 0) action = MC_WARN;
+        else if (strcmp(eq + 1, "break") == 0) action = MC_BREAK;
+        else if (strcmp(eq + 1, "abort") == 0) action = MC_ABORT;
+        else return -1;
+    }
+
+    uint16_t lo, hi;
+    size_t len = eq ? (size_t)(eq - spec) : strlen(spec);
+    if (len == 3 && strncmp(spec, "rom", 3) == 0) {
+        for (unsigned p = 0; p < (unsigned)rom_size >> 8; p++) {
+            memcheck_page[p] |= MC_PAGE_ROM;
+        }
+        actions[MC_ROM_WRITE] = action;
+    } else if (strncmp(spec, "exec:", 5) == 0 && parse_range(spec + 5, &lo, &hi) == 0) {
+        /* Whole pages: the page map is the only check on the fetch path */
+        for (unsigned p = lo >> 8; p <= (unsigned)hi >> 8; p++) {
+            memcheck_page[p] |= MC_PAGE_NOEXEC;
+        }
+        actions[MC_EXEC] = action;
+    } else if (strncmp(spec, "stack:", 6) == 0 && parse_range(spec + 6, &lo, &hi) == 0) {
+        memcheck_stack = true;
+        memcheck_stack_lo = lo;
+        memcheck_stack_hi = hi;
+        actions[MC_STACK] = action;
+    } else {
+        return -1;
+    }
+    memcheck_enabled = true;
+    return 0;
+}
+
+void memcheck_violation(memcheck_kind kind, uint16_t addr, uint8_t val) {
+    if (violations[kind]++ < MAX_PRINTED || actions[kind] != MC_WARN) {
+        switch (kind) {
+        case MC_ROM_WRITE:
+            fprintf(stderr, "[memcheck] ROM write $%04X=$%02X at PC=$%04X, cycle %lu\n",
+                    addr, val, memcheck_pc, memcheck_cyc);
+            break;
+        case MC_EXEC:
+            fprintf(stderr, "[memcheck] exec from no-exec $%04X, cycle %lu\n",
+                    addr, memcheck_cyc);
+            break;
+        default:
+            fprintf(stderr, "[memcheck] SP=$%04X left stack window $%04X-$%04X at PC=$%04X, cycle %lu\n",
+                    addr, memcheck_stack_lo, memcheck_stack_hi, memcheck_pc, memcheck_cyc);
+            break;
+        }
+    }
+    /* Both stop the run at the end of this instruction, so the trace and
+     * hash files that explain the violation are closed properly */
+    if (actions[kind] == MC_ABORT) memcheck_abort = true;
+    if (actions[kind] != MC_WARN) memcheck_break = true;
+}
+
+void memcheck_stack_check(uint16_t sp) {
+    bool inside = sp >= memcheck_stack_lo && sp <= memcheck_stack_hi;
+    /* Ignore SP until firmware has set it up; report leaving, not staying out */
+    if (inside) {
+        stack_armed = true;
+        stack_outside = false;
+    } else if (stack_armed && !stack_outside) {
+        stack_outside = true;
+        memcheck_violation(MC_STACK, sp, 0);
+    }
+}
+
+void memcheck_report(FILE *f) {
+    fprintf(f, "\nMemcheck:\n");
+    if (uninit_on) {
+        fprintf(f, "  %lu uninitialised address%s read", uninit_reads,
+                uninit_reads == 1 ? "" : "es");
+        if (uninit_reads > 0) {
+            fprintf(f, ", first $%04X at PC=$%04X", first_addr, first_pc);
+        }
+        fprintf(f, "\n");
+        if (uninit_fetches > 0) {
+            fprintf(f, "  %lu uninitialised address%s executed, first $%04X\n", uninit_fetches,
+                    uninit_fetches == 1 ? "" : "es", first_fetch);
+        }
+    }
+    for (int k = 0; k < MC_NKINDS; k++) {
+        if (violations[k]) {
+            fprintf(f, "  %lu %s violation%s\n", violations[k], kind_names[k],
+                    violations[k] == 1 ? "" : "s");
+        }
+    }
+}
@@ -0,0 +1,89 @@
+/*
+ * Guest Memory Checks - Header
+ * A 256-entry page map says which 256-byte pages need checking on access;
+ * pages with no flags cost one table load. Flagged RAM pages are tested
+ * against a 64 Kbit "initialised" shadow so reads of never-written RAM are
+ * reported, once per address, with the PC of the instruction.
+ *
+ * Protection rules add ROM-write and no-execute page flags and a stack
+ * window for SP; each rule warns, breaks (stops the run) or aborts.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef MEMCHECK_H
+#define MEMCHECK_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Page flags */
+#define MC_PAGE_UNINIT 0x01   /* Track initialisation of this RAM page */
+#define MC_PAGE_ROM    0x02   /* Report writes to this page */
+#define MC_PAGE_NOEXEC 0x04   /* Report opcode fetches from this page */
+
+/* Protection rule kinds and what a violation does */
+typedef enum { MC_ROM_WRITE, MC_EXEC, MC_STACK, MC_NKINDS } memcheck_kind;
+typedef enum { MC_WARN, MC_BREAK, MC_ABORT } memcheck_action;
+
+extern bool memcheck_enabled;                /* Any page flagged */
+extern uint8_t memcheck_page[256];
+extern uint8_t memcheck_init[0x10000 / 8];   /* Shadow: 1 = written */
+extern uint16_t memcheck_pc;                 /* PC of the current instruction */
+extern unsigned long memcheck_cyc;           /* Cycle it started at */
+extern bool memcheck_stack;                  /* Stack window rule active */
+extern uint16_t memcheck_stack_lo, memcheck_stack_hi;
+extern bool memcheck_break;                  /* A MC_BREAK or MC_ABORT rule fired */
+extern bool memcheck_abort;                  /* ...and it was MC_ABORT */
+
+/* Track RAM from ram_start up; bytes below init_end (loaded from the ROM
+ * image) count as already written */
+void memcheck_uninit_enable(uint16_t ram_start, uint32_t init_end);
+
+/* Mark a range as written (snapshot restore, host-side loads) */
+void memcheck_mark(uint32_t start, uint32_t end);
+
+/* Slow path: first read of an uninitialised address. Opcode and operand
+ * fetches are reported apart from data reads. */
+void memcheck_report_uninit(uint16_t addr);
+
+static inline void memcheck_read(uint16_t addr) {
+    if ((memcheck_page[addr >> 8] & MC_PAGE_UNINIT) &&
+        !(memcheck_init[addr >> 3] & (1 << (addr & 7)))) {
+        memcheck_report_uninit(addr);
+    }
+}
+
+static inline void memcheck_write(uint16_t addr) {
+    memcheck_init[addr >> 3] |= (uint8_t)(1 << (addr & 7));
+}
+
+/* Add a protection rule: "rom", "exec:START-END" (no-execute range) or
+ * "stack:LO-HI" (SP window), each optionally followed by
+ * "=warn|break|abort". rom_size bounds the "rom" rule. Returns 0 or -1. */
+int memcheck_protect(const char *spec, uint16_t rom_size);
+
+/* Slow paths */
+void memcheck_violation(memcheck_kind kind, uint16_t addr, uint8_t val);
+void memcheck_stack_check(uint16_t sp);
+
+/* Per-instruction hook, before z80_step(); only when memcheck_enabled */
+static inline void memcheck_begin(uint16_t pc, unsigned long cyc) {
+    memcheck_pc = pc;
+    memcheck_cyc = cyc;
+    if (memcheck_page[pc >> 8] & MC_PAGE_NOEXEC) {
+        memcheck_violation(MC_EXEC, pc, 0);
+    }
+}
+
+/* After z80_step() */
+static inline void memcheck_end(uint16_t sp) {
+    if (memcheck_stack) memcheck_stack_check(sp);
+}
+
+/* Totals at exit */
+void memcheck_report(FILE *f);
+
+#endif /* MEMCHECK_H */
@@ -0,0 +1,319 @@
+/*
+ * OpenMetrics Endpoint
+ * One server thread accepts scrapes one at a time and closes each
+ * connection after the response. Rates are sampled by the same thread
+ * once a second, so they don't depend on how often anyone scrapes.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include "metrics.h"
+#include "version.h"
+
+#define REQUEST_MAX  4096
+#define REQUEST_MS   1000     /* A client gets this long to send its request */
+#define RATE_MS      1000
+
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL   /* A client hanging up must not kill us */
+#else
+#define SEND_FLAGS 0
+#endif
+
+bool metrics_enabled = false;
+metrics_counters metrics;
+
+static int listen_fd = -1;
+static int wake_pipe[2] = {-1, -1};
+static pthread_t server;
+static char rom_label[256];
+static double start_time;
+
+/* Owned by the server thread */
+static double rate_t;
+static uint64_t rate_instr, rate_cyc;
+static double ips, cps;
+
+typedef struct {
+    char *data;
+    size_t len, cap;
+} text;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t load(const uint64_t *c) {
+    return __atomic_load_n(c, __ATOMIC_RELAXED);
+}
+
+static void put(text *t, const char *fmt, ...) {
+    for (;;) {
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(t->data + t->len, t->cap - t->len, fmt, ap);
+        va_end(ap);
+        if (n < 0) return;
+        if ((size_t)n < t->cap - t->len) {
+            t->len += n;
+            return;
+        }
+        size_t cap = (t->cap + n) * 2;
+        char *d = realloc(t->data, cap);
+        if (!d) return;
+        t->data = d;
+        t->cap = cap;
+    }
+}
+
+static void family(text *t, const char *name, const char *type, const char *help) {
+    put(t, "# TYPE %s %s\n# HELP %s %s\n", name, type, name, help);
+}
+
+static void sample_rates(void) {
+    double t = now_sec();
+    uint64_t instr = load(&metrics.instructions);
+    uint64_t cyc = load(&metrics.cycles);
+    if (t > rate_t) {
+        ips = (instr - rate_instr) / (t - rate_t);
+        cps = (cyc - rate_cyc) / (t - rate_t);
+    }
+    rate_t = t;
+    rate_instr = instr;
+    rate_cyc = cyc;
+}
+
+static uint64_t resident_bytes(void) {
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f) {
+        unsigned long size, resident;
+        int ok = fscanf(f, "%lu %lu", &size, &resident) == 2;
+        fclose(f);
+        if (ok) return (uint64_t)resident * (uint64_t)sysconf(_SC_PAGESIZE);
+    }
+    /* No procfs: peak RSS is the best available */
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+    return (uint64_t)ru.ru_maxrss;
+#else
+    return (uint64_t)ru.ru_maxrss * 1024;
+#endif
+}
+
+static void render(text *t) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    double cpu = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+                 ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+
+    family(t, "retroshield_build", "info", "Emulator version and ROM image.");
+    put(t, "retroshield_build_info{version=\"%s\",rom=\"%s\"} 1\n", VERSION, rom_label);
+
+    family(t, "retroshield_cycles", "counter", "Emulated Z80 T-states.");
+    put(t, "retroshield_cycles_total %llu\n", (unsigned long long)load(&metrics.cycles));
+    family(t, "retroshield_instructions", "counter", "Z80 instructions executed.");
+    put(t, "retroshield_instructions_total %llu\n", (unsigned long long)load(&metrics.instructions));
+    family(t, "retroshield_instructions_per_second", "gauge", "Instructions over the last second.");
+    put(t, "retroshield_instructions_per_second %.0f\n", ips);
+    family(t, "retroshield_cycles_per_second", "gauge", "Effective clock over the last second.");
+    put(t, "retroshield_cycles_per_second %.0f\n", cps);
+    family(t, "retroshield_interrupts", "counter", "Serial input interrupts raised.");
+    put(t, "retroshield_interrupts_total %llu\n", (unsigned long long)load(&metrics.interrupts));
+
+    family(t, "retroshield_port_reads", "counter", "IN instructions per port.");
+    for (int p = 0; p < 256; p++) {
+        uint64_t n = load(&metrics.port_reads[p]);
+        if (n) put(t, "retroshield_port_reads_total{port=\"0x%02X\"} %llu\n", p, (unsigned long long)n);
+    }
+    family(t, "retroshield_port_writes", "counter", "OUT instructions per port.");
+    for (int p = 0; p < 256; p++) {
+        uint64_t n = load(&metrics.port_writes[p]);
+        if (n) put(t, "retroshield_port_writes_total{port=\"0x%02X\"} %llu\n", p, (unsigned long long)n);
+    }
+
+    family(t, "retroshield_sd_bytes", "counter", "SD card file data transferred.");
+    put(t, "retroshield_sd_bytes_total{direction=\"read\"} %llu\n", (unsigned long long)load(&metrics.sd_read));
+    put(t, "retroshield_sd_bytes_total{direction=\"write\"} %llu\n", (unsigned long long)load(&metrics.sd_written));
+    family(t, "retroshield_input_bytes", "counter", "Host input bytes read by the guest.");
+    put(t, "retroshield_input_bytes_total %llu\n", (unsigned long long)load(&metrics.input_bytes));
+    family(t, "retroshield_input_queue_bytes", "gauge", "Host input waiting for the guest.");
+    put(t, "retroshield_input_queue_bytes %llu\n", (unsigned long long)load(&metrics.input_queued));
+
+    family(t, "process_cpu_seconds", "counter", "Host CPU time, user and system.");
+    put(t, "process_cpu_seconds_total %.3f\n", cpu);
+    family(t, "process_resident_memory_bytes", "gauge", "Host resident set size.");
+    put(t, "process_resident_memory_bytes %llu\n", (unsigned long long)resident_bytes());
+    family(t, "retroshield_uptime_seconds", "gauge", "Seconds since the emulator started.");
+    put(t, "retroshield_uptime_seconds %.3f\n", now_sec() - start_time);
+    put(t, "# EOF\n");
+}
+
+static void reply(int fd, const char *status, const char *type, const char *body, size_t len) {
+    char head[256];
+    int n = snprintf(head, sizeof(head),
+                     "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n"
+                     "Connection: close\r\n\r\n", status, type, len);
+    if (send(fd, head, n, SEND_FLAGS) < 0) return;
+    while (len > 0) {
+        ssize_t w = send(fd, body, len, SEND_FLAGS);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return;
+        body += w;
+        len -= w;
+    }
+}
+
+static void serve(int fd) {
+    char req[REQUEST_MAX + 1];
+    size_t len = 0;
+    double deadline = now_sec() + REQUEST_MS / 1000.0;
+
+    /* Only the request line matters, but read the headers so the client
+     * doesn't see a reset */
+    while (len < REQUEST_MAX) {
+        struct pollfd p = {fd, POLLIN, 0};
+        int left = (int)((deadline - now_sec()) * 1000);
+        if (left <= 0 || poll(&p, 1, left) <= 0) break;
+        ssize_t n = recv(fd, req + len, REQUEST_MAX - len, 0);
+        if (n <= 0) break;
+        len += n;
+        req[len] = '\0';
+        if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n")) break;
+    }
+    req[len] = '\0';
+
+    static const char not_found[] = "Not found; try /metrics\n";
+    if (strncmp(req, "GET ", 4) != 0) {
+        reply(fd, "405 Method Not Allowed", "text/plain", "", 0);
+    } else if (strncmp(req + 4, "/metrics", 8) != 0 ||
+               (req[12] != ' ' && req[12] != '?')) {
+        reply(fd, "404 Not Found", "text/plain", not_found, sizeof(not_found) - 1);
+    } else {
+        text t = {0};
+        render(&t);
+        reply(fd, "200 OK", "application/openmetrics-text; version=1.0.0; charset=utf-8",
+              t.data ? t.data : "", t.len);
+        free(t.data);
+    }
+}
+
+static void *server_thread(void *arg) {
+    (void)arg;
+    double next_rate = now_sec() + RATE_MS / 1000.0;
+
+    for (;;) {
+        struct pollfd p[2] = {{listen_fd, POLLIN, 0}, {wake_pipe[0], POLLIN, 0}};
+        int wait = (int)((next_rate - now_sec()) * 1000);
+        int n = poll(p, 2, wait > 0 ? wait : 0);
+
+        if (now_sec() >= next_rate) {
+            sample_rates();
+            next_rate += RATE_MS / 1000.0;
+        }
+        if (n <= 0) continue;
+        if (p[1].revents) break;
+        if (p[0].revents & POLLIN) {
+            int fd = accept(listen_fd, NULL, NULL);
+            if (fd >= 0) {
+                serve(fd);
+                close(fd);
+            }
+        }
+    }
+    return NULL;
+}
+
+int metrics_listen(const char *spec, const char *rom) {
+    char host[256];
+    const char *port = strrchr(spec, ':');
+    if (port) {
+        snprintf(host, sizeof(host), "%.*s", (int)(port - spec), spec);
+        port++;
+    } else {
+        host[0] = '\0';
+        port = spec;
+    }
+    /* [::1]:9100 */
+    if (host[0] == '[' && host[strlen(host) - 1] == ']') {
+        memmove(host, host + 1, strlen(host));
+        host[strlen(host) - 1] = '\0';
+    }
+
+    struct addrinfo hints = {0}, *ai;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    int err = getaddrinfo(host[0] ? host : NULL, port, &hints, &ai);
+    if (err) {
+        fprintf(stderr, "--metrics-listen %s: %s\n", spec, gai_strerror(err));
+        return -1;
+    }
+    for (struct addrinfo *a = ai; a && listen_fd < 0; a = a->ai_next) {
+        int one = 1;
+        listen_fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (listen_fd < 0) continue;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(listen_fd, a->ai_addr, a->ai_addrlen) < 0 || listen(listen_fd, 16) < 0) {
+            close(listen_fd);
+            listen_fd = -1;
+        }
+    }
+    freeaddrinfo(ai);
+    if (listen_fd < 0) {
+        fprintf(stderr, "--metrics-listen %s: %s\n", spec, strerror(errno));
+        return -1;
+    }
+
+    /* Label values escape backslash, quote and newline */
+    const char *base = strrchr(rom, '/');
+    base = base ? base + 1 : rom;
+    size_t o = 0;
+    for (; *base && o + 3 < sizeof(rom_label); base++) {
+        if (*base == '\\' || *base == '"') rom_label[o++] = '\\';
+        if (*base == '\n') {
+            rom_label[o++] = '\\';
+            rom_label[o++] = 'n';
+            continue;
+        }
+        rom_label[o++] = *base;
+    }
+    rom_label[o] = '\0';
+
+    start_time = rate_t = now_sec();
+    if (pipe(wake_pipe) < 0 || pthread_create(&server, NULL, server_thread, NULL) != 0) {
+        perror("--metrics-listen");
+        close(listen_fd);
+        listen_fd = -1;
+        return -1;
+    }
+    metrics_enabled = true;
+    return 0;
+}
+
+void metrics_close(void) {
+    if (!metrics_enabled) return;
+    if (write(wake_pipe[1], "", 1) == 1) pthread_join(server, NULL);
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
+    close(listen_fd);
+    listen_fd = -1;
+    metrics_enabled = false;
+}
@@ -0,0 +1,51 @@
+/*
+ * OpenMetrics Endpoint - Header
+ * --metrics-listen ADDR:PORT serves GET /metrics from a background thread.
+ * The run loop is the only writer of these counters and publishes them
+ * with relaxed atomic stores (no read-modify-write, no locks); the server
+ * thread reads them with relaxed loads, so a scrape never stalls emulation
+ * and at worst sees values a few instructions apart.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define METRICS_PUBLISH_EVERY 1024   /* Instructions between cycle/depth updates */
+
+typedef struct {
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t interrupts;             /* Serial INTs raised */
+    uint64_t input_bytes;            /* Host bytes read by the guest */
+    uint64_t input_queued;           /* Host bytes waiting for the guest */
+    uint64_t sd_read, sd_written;    /* SD card file data */
+    uint64_t port_reads[256];
+    uint64_t port_writes[256];
+} metrics_counters;
+
+extern bool metrics_enabled;
+extern metrics_counters metrics;
+
+/* Bind spec ("ADDR:PORT" or "PORT") and start the server thread; rom is
+ * reported as an info label. Returns 0 or -1 with a message printed. */
+int metrics_listen(const char *spec, const char *rom);
+
+/* Stop the server thread */
+void metrics_close(void);
+
+/* Single-writer update: plain load and store, never a locked add */
+static inline void metrics_add(uint64_t *c, uint64_t n) {
+    __atomic_store_n(c, __atomic_load_n(c, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+static inline void metrics_set(uint64_t *c, uint64_t v) {
+    __atomic_store_n(c, v, __ATOMIC_RELAXED);
+}
+
+#endif /* METRICS_H */
@@ -0,0 +1,322 @@
+/*
+ * Input Minimiser
+ * Each ddmin round has up to 2n candidates: the n chunks, then the n
+ * complements. Threads take candidates in that order. The round adopts
+ * the lowest-numbered candidate that fails, so a candidate is cancelled
+ * only once a lower one has failed, and the result is the same whatever
+ * the thread count or timing.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "machine.h"
+#include "minimize.h"
+
+#define SLICE_CYCLES 100000
+#define BOOT_MAX     50000000    /* Give up if the guest never reads serial */
+#define MATCH_MAX    256
+
+typedef struct {
+    const char *want;
+    size_t len;
+    char tail[MATCH_MAX];
+    size_t n;
+    bool hit;
+} out_match;
+
+typedef struct {
+    pthread_t thread;
+    machine *m;
+    uint8_t *buf;                /* Candidate input */
+    unsigned long runs;
+} worker;
+
+static const minimize_predicate *pred;
+static unsigned long settle_cycles, cycle_limit;
+static machine *warm;
+static uint8_t *boot_out;
+static size_t boot_len, boot_cap;
+
+/* Current input and round */
+static uint8_t *cur;
+static size_t cur_len;
+static size_t chunks, candidates;
+static size_t next_cand;         /* Atomic */
+static size_t best;              /* Atomic; lowest failing candidate so far */
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+bool minimize_predicate_set(const minimize_predicate *p) {
+    return p->output || p->pc >= 0 || p->watchdog || p->halt;
+}
+
+static void match_byte(out_match *o, uint8_t c) {
+    if (!o->want || o->hit) return;
+    if (o->n == o->len) {
+        memmove(o->tail, o->tail + 1, o->n - 1);
+        o->n--;
+    }
+    o->tail[o->n++] = (char)c;
+    o->hit = o->n == o->len && memcmp(o->tail, o->want, o->len) == 0;
+}
+
+static void on_tx(void *ctx, uint8_t c) {
+    match_byte(ctx, c);
+}
+
+static void on_boot_tx(void *ctx, uint8_t c) {
+    (void)ctx;
+    if (boot_len == boot_cap) {
+        size_t cap = boot_cap ? boot_cap * 2 : 4096;
+        uint8_t *n = realloc(boot_out, cap);
+        if (!n) return;
+        boot_out = n;
+        boot_cap = cap;
+    }
+    boot_out[boot_len++] = c;
+}
+
+/* Run one candidate from the warm state; true if the failure shows up */
+static bool fails(machine *m, const uint8_t *input, size_t len, size_t cand) {
+    out_match o = {0};
+    o.want = pred->output;
+    o.len = pred->output ? strlen(pred->output) : 0;
+    for (size_t i = 0; i < boot_len; i++) match_byte(&o, boot_out[i]);
+
+    machine_copy_state(m, warm);
+    rxq_drain(&m->rx);
+    m->tx = on_tx;
+    m->tx_ctx = &o;
+    m->break_pc = pred->pc;
+    machine_feed(m, input, len);
+
+    size_t pending = len;
+    uint64_t polls = m->rx_polls;
+    unsigned long last_take = m->cpu.cyc, last_poll = m->cpu.cyc;
+
+    for (;;) {
+        unsigned long cyc = m->cpu.cyc;
+        if (o.hit || (pred->pc >= 0 && m->cpu.pc == pred->pc)) return true;
+        /* A HALT waiting on an interrupt the pending input will raise is not the end */
+        if (m->cpu.halted && !(machine_can_wake(m) && machine_rx_pending(m) > 0)) return pred->halt;
+        if (__atomic_load_n(&best, __ATOMIC_RELAXED) < cand) return false;
+        if (cycle_limit && cyc >= cycle_limit) return false;
+
+        if (m->rx_polls != polls) {
+            polls = m->rx_polls;
+            last_poll = cyc;
+        } else if (pred->watchdog && cyc - last_poll >= pred->watchdog) {
+            return true;
+        }
+        size_t p = machine_rx_pending(m);
+        if (p != pending) {
+            pending = p;
+            last_take = cyc;
+        }
+        if (cyc - last_take >= settle_cycles) return false;
+
+        unsigned long until = cyc + SLICE_CYCLES;
+        if (cycle_limit && until > cycle_limit) until = cycle_limit;
+        machine_run(m, until);
+    }
+}
+
+/* Candidate k: chunk k, or for k >= chunks the input without chunk k - chunks */
+static size_t build(size_t k, uint8_t *out) {
+    size_t c = k % chunks;
+    size_t lo = c * cur_len / chunks, hi = (c + 1) * cur_len / chunks;
+    if (k < chunks) {
+        memcpy(out, cur + lo, hi - lo);
+        return hi - lo;
+    }
+    memcpy(out, cur, lo);
+    memcpy(out + lo, cur + hi, cur_len - hi);
+    return cur_len - (hi - lo);
+}
+
+static void *worker_thread(void *arg) {
+    worker *w = arg;
+    for (;;) {
+        size_t k = __atomic_fetch_add(&next_cand, 1, __ATOMIC_RELAXED);
+        if (k >= candidates || k > __atomic_load_n(&best, __ATOMIC_RELAXED)) break;
+        size_t len = build(k, w->buf);
+        w->runs++;
+        if (fails(w->m, w->buf, len, k)) {
+            size_t b = __atomic_load_n(&best, __ATOMIC_RELAXED);
+            while (k < b && !__atomic_compare_exchange_n(&best, &b, k, false,
+                                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+        }
+    }
+    return NULL;
+}
+
+static void run_round(worker *ws, int nthreads) {
+    next_cand = 0;
+    best = SIZE_MAX;
+    for (int t = 0; t < nthreads; t++) {
+        if (pthread_create(&ws[t].thread, NULL, worker_thread, &ws[t]) != 0) {
+            /* Fewer threads only makes the round slower */
+            ws[t].thread = 0;
+            if (t == 0) worker_thread(&ws[0]);
+        }
+    }
+    for (int t = 0; t < nthreads; t++) {
+        if (ws[t].thread) pthread_join(ws[t].thread, NULL);
+    }
+}
+
+static int read_script(const char *path, uint8_t **data, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    size_t cap = 4096;
+    *len = 0;
+    *data = malloc(cap);
+    size_t n;
+    while (*data && (n = fread(*data + *len, 1, cap - *len, f)) > 0) {
+        *len += n;
+        if (*len == cap) {
+            uint8_t *d = realloc(*data, cap *= 2);
+            if (!d) {
+                free(*data);
+                *data = NULL;
+            } else {
+                *data = d;
+            }
+        }
+    }
+    fclose(f);
+    if (!*data) {
+        fprintf(stderr, "%s: out of memory\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static void print_escaped(const uint8_t *s, size_t len) {
+    fputc('"', stderr);
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] == '\r') fputs("\\r", stderr);
+        else if (s[i] == '\n') fputs("\\n", stderr);
+        else if (s[i] == '"' || s[i] == '\\') fprintf(stderr, "\\%c", s[i]);
+        else if (s[i] < 0x20 || s[i] >= 0x7F) fprintf(stderr, "\\x%02x", s[i]);
+        else fputc(s[i], stderr);
+    }
+    fputs("\"\n", stderr);
+}
+
+int minimize_run(const char *rom, const char *script, const minimize_predicate *p,
+                 unsigned long settle, unsigned long max_cycles) {
+    size_t orig_len;
+    int rc = 1;
+
+    pred = p;
+    cycle_limit = max_cycles;
+    /* The watchdog must get the chance to fire before a run counts as quiet */
+    settle_cycles = settle;
+    if (p->watchdog && settle_cycles < p->watchdog + SLICE_CYCLES) {
+        settle_cycles = p->watchdog + SLICE_CYCLES;
+    }
+    if (p->output && (strlen(p->output) == 0 || strlen(p->output) > MATCH_MAX)) {
+        fprintf(stderr, "--fail-output text must be 1-%d bytes\n", MATCH_MAX);
+        return 1;
+    }
+    if (read_script(script, &cur, &cur_len) < 0) return 1;
+    orig_len = cur_len;
+
+    warm = machine_create(rom);
+    if (!warm) return 1;
+    warm->tx = on_boot_tx;
+    if (machine_boot_to_input(warm, BOOT_MAX) < 0) {
+        fprintf(stderr, "%s: %s before reading the serial port\n", rom,
+                warm->cpu.halted ? "halted" : "ran 50M cycles");
+        machine_destroy(warm);
+        return 1;
+    }
+    warm->tx = NULL;
+
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int nthreads = ncpu > 0 ? (int)ncpu : 1;
+    worker *ws = calloc(nthreads, sizeof(worker));
+    if (!ws) goto out;
+    for (int t = 0; t < nthreads; t++) {
+        ws[t].m = machine_create(rom);
+        ws[t].buf = malloc(cur_len ? cur_len : 1);
+        if (!ws[t].m || !ws[t].buf) goto out;
+    }
+
+    double start = now_sec();
+    unsigned long runs = 1;
+    if (!fails(ws[0].m, cur, cur_len, 0)) {
+        fprintf(stderr, "minimize: %s does not reproduce the failure\n", script);
+        goto out;
+    }
+    fprintf(stderr, "minimize: %zu bytes fail; %d threads\n", cur_len, nthreads);
+
+    chunks = 2;
+    while (cur_len >= 2) {
+        if (chunks > cur_len) chunks = cur_len;
+        /* With two chunks the complements are the chunks again */
+        candidates = chunks == 2 ? 2 : chunks * 2;
+        run_round(ws, nthreads);
+
+        if (best != SIZE_MAX) {
+            size_t k = best;
+            uint8_t *tmp = ws[0].buf;
+            cur_len = build(k, tmp);
+            memcpy(cur, tmp, cur_len);
+            chunks = k < chunks ? 2 : (chunks > 3 ? chunks - 1 : 2);
+            fprintf(stderr, "minimize: %zu bytes\n", cur_len);
+        } else if (chunks >= cur_len) {
+            break;
+        } else {
+            chunks = chunks * 2 < cur_len ? chunks * 2 : cur_len;
+        }
+    }
+    for (int t = 0; t < nthreads; t++) runs += ws[t].runs;
+    double wall = now_sec() - start;
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s.min", script);
+    FILE *f = fopen(path, "wb");
+    if (!f || fwrite(cur, 1, cur_len, f) != cur_len) {
+        perror(path);
+        if (f) fclose(f);
+        goto out;
+    }
+    fclose(f);
+
+    fprintf(stderr, "minimize: %zu -> %zu bytes in %lu runs, %.2f s (%.0f runs/s), wrote %s\n",
+            orig_len, cur_len, runs, wall, wall > 0 ? runs / wall : 0.0, path);
+    if (cur_len <= 200) print_escaped(cur, cur_len);
+    rc = 0;
+
+out:
+    if (ws) {
+        for (int t = 0; t < nthreads; t++) {
+            machine_destroy(ws[t].m);
+            free(ws[t].buf);
+        }
+    }
+    free(ws);
+    machine_destroy(warm);
+    free(cur);
+    free(boot_out);
+    return rc;
+}
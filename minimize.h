@@ -0,0 +1,39 @@
+/*
+ * Input Minimiser - Header
+ * --minimize SCRIPT shrinks a failing input script with ddmin: it tries
+ * chunks of the input and their complements, keeps any that still fail,
+ * and refines the chunks until no single byte can be removed. The
+ * candidates of each round run in parallel on every CPU, each starting
+ * from a copy of one warm machine booted up to its first serial read.
+ *
+ * Candidates run on the reentrant machine (machine.c): ACIA and 8251
+ * serial only, no SD card or clock ports.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef MINIMIZE_H
+#define MINIMIZE_H
+
+#include <stdbool.h>
+
+#define MINIMIZE_SETTLE 20000000   /* Default cycles of quiet after the last input byte */
+
+/* What counts as the failure; any condition that is set */
+typedef struct {
+    const char *output;           /* Guest printed this; NULL = not checked */
+    int pc;                       /* PC reached this address; -1 = not checked */
+    unsigned long watchdog;       /* Serial port not polled for this many cycles; 0 = off */
+    bool halt;                    /* CPU halted */
+} minimize_predicate;
+
+bool minimize_predicate_set(const minimize_predicate *p);
+
+/* A candidate passes once the guest has gone settle cycles without taking
+ * input, or at max_cycles (0 = no limit). Writes SCRIPT.min and returns
+ * the process exit status. */
+int minimize_run(const char *rom, const char *script, const minimize_predicate *p,
+                 unsigned long settle, unsigned long max_cycles);
+
+#endif /* MINIMIZE_H */
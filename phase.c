@@ -0,0 +1,81 @@
+/*
+ * Host-Time Phase Profiler
+ * Ticks are converted to seconds at report time, from the tick and
+ * CLOCK_MONOTONIC deltas over the whole run.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <string.h>
+#include <time.h>
+#include "phase.h"
+
+bool phase_enabled = false;
+phase_id phase_cur = PH_CORE;
+uint64_t phase_since;
+uint64_t phase_ticks_in[PH_COUNT];
+uint64_t phase_entries[PH_COUNT];
+
+static uint64_t start_ticks;
+static double start_sec;
+
+static const char *const names[PH_COUNT] = { "core", "device", "host I/O", "render", "idle" };
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+uint64_t phase_clock_fallback(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void phase_start(void) {
+    phase_enabled = true;
+    phase_cur = PH_CORE;
+    memset(phase_ticks_in, 0, sizeof(phase_ticks_in));
+    memset(phase_entries, 0, sizeof(phase_entries));
+    start_sec = now_sec();
+    start_ticks = phase_since = phase_ticks();
+}
+
+void phase_sample(uint64_t ticks[PH_COUNT]) {
+    for (int p = 0; p < PH_COUNT; p++) ticks[p] = phase_ticks_in[p];
+    if (phase_enabled) ticks[phase_cur] += phase_ticks() - phase_since;
+}
+
+const char *phase_name(phase_id p) {
+    return p < PH_COUNT ? names[p] : "?";
+}
+
+void phase_report(FILE *f) {
+    uint64_t ticks[PH_COUNT], total = 0;
+    phase_sample(ticks);
+    for (int p = 0; p < PH_COUNT; p++) total += ticks[p];
+
+    double wall = now_sec() - start_sec;
+    uint64_t span = phase_ticks() - start_ticks;
+    double sec_per_tick = span ? wall / span : 0.0;
+
+    fprintf(f, "\nHost time by phase (%.3f s wall, %.2f GHz tick):\n",
+            wall, sec_per_tick > 0 ? 1e-9 / sec_per_tick : 0.0);
+    fprintf(f, "  %-10s %10s %7s %12s %10s\n", "phase", "seconds", "share", "entries", "ns/entry");
+    for (int p = 0; p < PH_COUNT; p++) {
+        if (ticks[p] == 0 && phase_entries[p] == 0) continue;
+        double sec = ticks[p] * sec_per_tick;
+        fprintf(f, "  %-10s %10.3f %6.1f%%", names[p], sec,
+                total ? 100.0 * ticks[p] / total : 0.0);
+        if (p != PH_CORE && phase_entries[p] > 0) {
+            fprintf(f, " %12llu %10.0f\n", (unsigned long long)phase_entries[p],
+                    sec * 1e9 / phase_entries[p]);
+        } else {
+            fprintf(f, " %12s %10s\n", "-", "-");
+        }
+    }
+}
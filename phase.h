@@ -0,0 +1,83 @@
+/*
+ * Host-Time Phase Profiler - Header
+ * Splits the emulator's wall time into phases: the CPU core, device
+ * callbacks (port_in/port_out), host I/O system calls, TUI rendering and
+ * time blocked waiting for input.
+ * The front-end marks phase changes with phase_enter()/phase_leave(); each
+ * change costs one timestamp counter read. Nothing is timed per
+ * instruction: whatever is not inside a marked phase counts as core.
+ * Phases nest, so a write() inside port_out is host I/O, not device time.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef PHASE_H
+#define PHASE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    PH_CORE,          /* Instruction execution and the main loop */
+    PH_DEVICE,        /* Port callbacks, less any host I/O they do */
+    PH_HOSTIO,        /* select, read, write, fflush, fgetc ... */
+    PH_RENDER,        /* TUI drawing and notcurses_render */
+    PH_IDLE,          /* Blocked waiting for input (TUI poll timeout) */
+    PH_COUNT
+} phase_id;
+
+extern bool phase_enabled;                 /* Set before phase_start() */
+extern phase_id phase_cur;
+extern uint64_t phase_since;               /* Ticks when phase_cur began */
+extern uint64_t phase_ticks_in[PH_COUNT];  /* Ticks spent so far, closed spans only */
+extern uint64_t phase_entries[PH_COUNT];
+
+uint64_t phase_clock_fallback(void);
+
+/* Cheap monotonic tick: TSC / virtual counter where there is one */
+static inline uint64_t phase_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+    uint64_t t;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(t));
+    return t;
+#else
+    return phase_clock_fallback();
+#endif
+}
+
+/* Switch to phase p; returns the phase to hand back to phase_leave() */
+static inline phase_id phase_enter(phase_id p) {
+    phase_id old = phase_cur;
+    if (!phase_enabled) return old;
+    uint64_t t = phase_ticks();
+    phase_ticks_in[phase_cur] += t - phase_since;
+    phase_since = t;
+    phase_cur = p;
+    phase_entries[p]++;
+    return old;
+}
+
+static inline void phase_leave(phase_id old) {
+    if (!phase_enabled) return;
+    uint64_t t = phase_ticks();
+    phase_ticks_in[phase_cur] += t - phase_since;
+    phase_since = t;
+    phase_cur = old;
+}
+
+/* Start timing from zero, in PH_CORE; also sets phase_enabled */
+void phase_start(void);
+
+/* Ticks per phase up to now, including the open span */
+void phase_sample(uint64_t ticks[PH_COUNT]);
+
+const char *phase_name(phase_id p);
+
+/* Per-phase seconds, share and entry counts */
+void phase_report(FILE *f);
+
+#endif /* PHASE_H */
@@ -7,11 +7,14 @@
  * SPDX-License-Identifier: MIT
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
+#include <limits.h>
 #include <unistd.h>
 #include <termios.h>
 #include <fcntl.h>
@@ -19,6 +22,22 @@
 
 #include "z80.h"
 #include "version.h"
+#include "trace.h"
+#include "statehash.h"
+#include "snapshot.h"
+#include "latency.h"
+#include "guestprof.h"
+#include "hostin.h"
+#include "rxqueue.h"
+#include "cycport.h"
+#include "iostats.h"
+#include "memcheck.h"
+#include "loopff.h"
+#include "btrace.h"
+#include "metrics.h"
+#include "dlog.h"
+#include "minimize.h"
+#include "phase.h"
 #include <dirent.h>
 #include <sys/stat.h>
 #include <errno.h>
@@ -84,26 +103,110 @@ static bool uses_8251 = false;     /* Track if ROM uses 8251 (for interrupt supp
 
 static uint8_t memory[MEM_SIZE];
 static z80 cpu;
-static bool debug_mode = false;
 static int max_cycles = 0;
 static bool stdin_eof = false;  /* Track if we've hit EOF on stdin */
 static bool dump_memory = false;
 static uint16_t dump_addr = 0;
 static uint16_t dump_len = 256;
+static const char *trace_path = NULL;
+static const char *btrace_path = NULL;
+
+/* Checkpointing and replay */
+static uint64_t total_instr = 0;       /* Instructions executed */
+static uint64_t input_consumed = 0;    /* Host input bytes read by the guest */
+static bool int_pending = false;       /* INT raised for current input */
+static const char *hash_path = NULL;
+static uint64_t hash_every = 0;
+static const char *snap_prefix = NULL;
+static uint64_t snap_every = 0;
+static uint64_t snap_next = 0;
+static snapshot_run snap_run;           /* Options recorded in every snapshot */
+static const char *restore_path = NULL;
+static uint64_t stop_instr = 0;
+static const char *gprof_spec = NULL;   /* NULL = built-in config for ROM */
+static bool memcheck_uninit = false;
+static const char *metrics_spec = NULL;
+static const char *log_path = NULL;
+static const char *protect_specs[16];
+static int protect_count = 0;
+
+/* --minimize */
+static const char *minimize_path = NULL;
+static minimize_predicate fail_pred = { NULL, -1, 0, false };
+static unsigned long settle_cycles = MINIMIZE_SETTLE;
+
+/* Piped / file input */
+static unsigned long rx_pace = 0;       /* Cycles between delivered bytes */
+static hostin_eof_policy eof_policy = HOSTIN_EOF_IDLE;
+
+/* Terminal input: whatever one read() returns is queued, so the guest's
+ * status polls only reach select() once the queue is empty */
+static rxqueue tty_queue;
+
+/* Move available terminal bytes into tty_queue; waits for input if block */
+static void tty_fill(bool block) {
+    uint8_t buf[256];
+    if (stdin_eof) return;
+    if (!block) {
+        struct timeval tv = {0, 0};
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(STDIN_FILENO, &fds);
+        phase_id ph = phase_enter(PH_HOSTIO);
+        int ready = select(STDIN_FILENO + 1, &fds, NULL, NULL, &tv);
+        phase_leave(ph);
+        if (ready <= 0) return;
+    }
+    phase_id ph = phase_enter(PH_HOSTIO);
+    ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+    phase_leave(ph);
+    if (n > 0) {
+        /* Every queued key is stamped, not just the first of a burst */
+        size_t queued = rxq_push(&tty_queue, buf, (size_t)n);
+        if (latency_enabled) {
+            for (size_t i = 0; i < queued; i++) latency_key();
+        }
+    } else if (n == 0 || errno != EINTR) {
+        stdin_eof = true;
+    }
+}
 
 /* Check if input available on stdin (non-blocking) */
 static int kbhit(void) {
-    if (stdin_eof) return 0;  /* No more input after EOF */
-    struct timeval tv = {0, 0};
-    fd_set fds;
-    FD_ZERO(&fds);
-    FD_SET(STDIN_FILENO, &fds);
-    return select(STDIN_FILENO + 1, &fds, NULL, NULL, &tv) > 0;
+    int ready;
+    if (hostin_active) {
+        ready = hostin_ready(cpu.cyc);  /* File or pipe: served from memory */
+    } else {
+        if (!rxq_ready(&tty_queue)) tty_fill(false);
+        ready = rxq_ready(&tty_queue);
+    }
+    /* File or pipe input releases one byte at a time, so the first sight
+     * of the next byte is its arrival; terminal keys are stamped as
+     * tty_fill() queues them */
+    if (ready && hostin_active && latency_enabled && latency_pending_reads() == 0) {
+        latency_key();
+    }
+    return ready;
+}
+
+/* kbhit() for the guest's serial status/data reads, the only polls that
+ * may end the run under --eof stop */
+static int guest_kbhit(void) {
+    int ready = kbhit();
+    if (!ready && hostin_active) hostin_guest_poll_empty();
+    return ready;
+}
+
+/* Take the byte kbhit() reported */
+static int read_input(void) {
+    if (hostin_active) return hostin_getc(cpu.cyc);
+    return rxq_getc(&tty_queue);
 }
 
 /* Memory read callback */
 static uint8_t mem_read(void *userdata, uint16_t addr) {
     (void)userdata;
+    if (memcheck_page[addr >> 8]) memcheck_read(addr);
     return memory[addr];
 }
 
@@ -113,28 +216,32 @@ static void mem_write(void *userdata, uint16_t addr, uint8_t val) {
     /* Protect ROM area */
     if (addr >= rom_size) {
         memory[addr] = val;
+        if (memcheck_page[addr >> 8]) memcheck_write(addr);
+        if (trace_enabled) trace_write(addr, val);
+        if (statehash_enabled) statehash_dirty(addr);
+    } else {
+        if (memcheck_page[addr >> 8] & MC_PAGE_ROM) memcheck_violation(MC_ROM_WRITE, addr, val);
+        DLOG(DLOG_MEM, DLOG_DEBUG, "Write %02X to ROM at %04X ignored", val, addr, 0);
     }
 }
 
-/* I/O port read callback */
-static uint8_t port_in(z80 *z, uint8_t port) {
-    (void)z;
-
+/* I/O port read */
+static uint8_t port_read(uint8_t port) {
     /* MC6850 ACIA (ports $80/$81) */
     if (port == ACIA_CTRL) {
         uint8_t status = ACIA_TDRE;  /* Always ready to transmit */
-        if (kbhit()) {
+        if (guest_kbhit()) {
             status |= ACIA_RDRF;  /* Data available */
         }
         return status;
     }
     else if (port == ACIA_DATA) {
-        if (kbhit()) {
-            int c = getchar();
-            if (c == EOF) {
-                stdin_eof = true;
-                return 0;
-            }
+        if (guest_kbhit()) {
+            int c = read_input();
+            if (c == EOF) return 0;
+            input_consumed++;
+            latency_guest_read();
+            DLOG(DLOG_ACIA, DLOG_TRACE, "RX %02X", c, 0, 0);
             return (uint8_t)c;
         }
         return 0;
@@ -142,23 +249,25 @@ static uint8_t port_in(z80 *z, uint8_t port) {
 
     /* Intel 8251 USART (ports $00/$01) */
     else if (port == USART_CTRL) {
+        if (!uses_8251) DLOG(DLOG_8251, DLOG_INFO, "8251 in use, RX interrupts enabled", 0, 0, 0);
         uses_8251 = true;  /* ROM uses 8251, enable interrupt support */
         uint8_t status = USART_STATUS_INIT;  /* TxRDY + TxE + DSR */
-        if (kbhit()) {
+        if (guest_kbhit()) {
             status |= STAT_8251_RxRDY;  /* Data available */
         }
         return status;
     }
     else if (port == USART_DATA) {
+        if (!uses_8251) DLOG(DLOG_8251, DLOG_INFO, "8251 in use, RX interrupts enabled", 0, 0, 0);
         uses_8251 = true;  /* ROM uses 8251, enable interrupt support */
-        if (kbhit()) {
-            int c = getchar();
-            if (c == EOF) {
-                stdin_eof = true;
-                return 0;
-            }
+        if (guest_kbhit()) {
+            int c = read_input();
+            if (c == EOF) return 0;
+            input_consumed++;
+            latency_guest_read();
             /* Convert lowercase to uppercase like Arduino does */
             if (c >= 'a' && c <= 'z') c = c - 'a' + 'A';
+            DLOG(DLOG_8251, DLOG_TRACE, "RX %02X", c, 0, 0);
             return (uint8_t)c;
         }
         return 0;
@@ -175,13 +284,17 @@ static uint8_t port_in(z80 *z, uint8_t port) {
     }
     else if (port == SD_DATA_PORT) {
         if (sd_file) {
+            phase_id ph = phase_enter(PH_HOSTIO);
             int c = fgetc(sd_file);
+            phase_leave(ph);
             if (c == EOF) {
                 fclose(sd_file);
                 sd_file = NULL;
                 sd_status = SD_STATUS_READY;  /* No more data */
                 return 0;
             }
+            if (metrics_enabled) metrics_add(&metrics.sd_read, 1);
+            DLOG(DLOG_SD, DLOG_TRACE, "Read %02X", c, 0, 0);
             return (uint8_t)c;
         } else if (sd_dir) {
             /* Return directory entry character by character */
@@ -211,28 +324,60 @@ static uint8_t port_in(z80 *z, uint8_t port) {
         return 0;
     }
 
+    /* Guest clock ports (--clock-port) */
+    else if (cycport_enabled && cycport_claims(port)) {
+        return cycport_read(port, cpu.cyc);
+    }
+
     return 0xFF;
 }
 
+/* I/O port read callback. Every IN form is two bytes long, so the
+ * instruction's address is PC - 2 by the time the port is read. */
+static uint8_t port_in(z80 *z, uint8_t port) {
+    phase_id ph = phase_enter(PH_DEVICE);
+    uint8_t val = port_read(port);
+    if (iostats_enabled) iostats_in(port, (uint16_t)(z->pc - 2), val, z->cyc);
+    if (btrace_enabled) btrace_in(port, val);
+    if (metrics_enabled) metrics_add(&metrics.port_reads[port], 1);
+    phase_leave(ph);
+    return val;
+}
+
 /* I/O port write callback */
-static void port_out(z80 *z, uint8_t port, uint8_t val) {
-    (void)z;
+static void port_write(z80 *z, uint8_t port, uint8_t val) {
+    if (iostats_enabled) iostats_out(port, (uint16_t)(z->pc - 2));
+    if (metrics_enabled) metrics_add(&metrics.port_writes[port], 1);
 
     /* MC6850 ACIA control (port $80) */
     if (port == ACIA_CTRL) {
         acia_control = val;
+        DLOG(DLOG_ACIA, DLOG_DEBUG, "Control %02X", val, 0, 0);
     }
     /* MC6850 ACIA data (port $81) */
     else if (port == ACIA_DATA) {
+        DLOG(DLOG_ACIA, DLOG_TRACE, "TX %02X", val, 0, 0);
+        phase_id ph = phase_enter(PH_HOSTIO);
         putchar(val);
+        latency_tx();
         fflush(stdout);
+        phase_leave(ph);
+        latency_frame();
     }
     /* Intel 8251 USART data (port $00) */
     else if (port == USART_DATA) {
+        DLOG(DLOG_8251, DLOG_TRACE, "TX %02X", val, 0, 0);
+        phase_id ph = phase_enter(PH_HOSTIO);
         putchar(val);
+        latency_tx();
         fflush(stdout);
+        phase_leave(ph);
+        latency_frame();
     }
     /* Control/mode register writes ignored */
+    else if (port == USART_CTRL) {
+        DLOG(DLOG_8251, DLOG_DEBUG, "Mode/command %02X", val, 0, 0);
+    }
 
     /* SD Card emulation ports */
     else if (port == SD_CMD_PORT) {
@@ -253,14 +398,10 @@ static void port_out(z80 *z, uint8_t port, uint8_t val) {
 
                 if (sd_file) {
                     sd_status = SD_STATUS_READY;
-                    if (debug_mode) {
-                        fprintf(stderr, "[SD] Opened for read: %s\n", fullpath);
-                    }
+                    DLOG_STR(DLOG_SD, DLOG_DEBUG, "Opened for read: %s", fullpath, 0, 0);
                 } else {
                     sd_status = SD_STATUS_ERROR | SD_STATUS_READY;
-                    if (debug_mode) {
-                        fprintf(stderr, "[SD] Failed to open: %s (%s)\n", fullpath, strerror(errno));
-                    }
+                    dlog_text(DLOG_SD, DLOG_WARN, "Failed to open: %s (%s)", fullpath, strerror(errno));
                 }
                 break;
             }
@@ -281,14 +422,10 @@ static void port_out(z80 *z, uint8_t port, uint8_t val) {
 
                 if (sd_file) {
                     sd_status = SD_STATUS_READY;
-                    if (debug_mode) {
-                        fprintf(stderr, "[SD] Created: %s\n", fullpath);
-                    }
+                    DLOG_STR(DLOG_SD, DLOG_DEBUG, "Created: %s", fullpath, 0, 0);
                 } else {
                     sd_status = SD_STATUS_ERROR | SD_STATUS_READY;
-                    if (debug_mode) {
-                        fprintf(stderr, "[SD] Failed to create: %s (%s)\n", fullpath, strerror(errno));
-                    }
+                    dlog_text(DLOG_SD, DLOG_WARN, "Failed to create: %s (%s)", fullpath, strerror(errno));
                 }
                 break;
             }
@@ -306,14 +443,10 @@ static void port_out(z80 *z, uint8_t port, uint8_t val) {
                 if (sd_file) {
                     fseek(sd_file, 0, SEEK_END);
                     sd_status = SD_STATUS_READY;
-                    if (debug_mode) {
-                        fprintf(stderr, "[SD] Opened for append: %s\n", fullpath);
-                    }
+                    DLOG_STR(DLOG_SD, DLOG_DEBUG, "Opened for append: %s", fullpath, 0, 0);
                 } else {
                     sd_status = SD_STATUS_ERROR | SD_STATUS_READY;
-                    if (debug_mode) {
-                        fprintf(stderr, "[SD] Failed to open for append: %s (%s)\n", fullpath, strerror(errno));
-                    }
+                    dlog_text(DLOG_SD, DLOG_WARN, "Failed to open for append: %s (%s)", fullpath, strerror(errno));
                 }
                 break;
             }
@@ -321,9 +454,7 @@ static void port_out(z80 *z, uint8_t port, uint8_t val) {
                 if (sd_file) {
                     fseek(sd_file, 0, SEEK_SET);
                     sd_status = SD_STATUS_READY;
-                    if (debug_mode) {
-                        fprintf(stderr, "[SD] Seeked to start\n");
-                    }
+                    DLOG(DLOG_SD, DLOG_DEBUG, "Seeked to start", 0, 0, 0);
                 } else {
                     sd_status = SD_STATUS_ERROR | SD_STATUS_READY;
                 }
@@ -341,14 +472,10 @@ static void port_out(z80 *z, uint8_t port, uint8_t val) {
                 sd_file = fopen(fullpath, "r+b");
                 if (sd_file) {
                     sd_status = SD_STATUS_READY;
-                    if (debug_mode) {
-                        fprintf(stderr, "[SD] Opened for read/write: %s\n", fullpath);
-                    }
+                    DLOG_STR(DLOG_SD, DLOG_DEBUG, "Opened for read/write: %s", fullpath, 0, 0);
                 } else {
                     sd_status = SD_STATUS_ERROR | SD_STATUS_READY;
-                    if (debug_mode) {
-                        fprintf(stderr, "[SD] Failed to open for read/write: %s (%s)\n", fullpath, strerror(errno));
-                    }
+                    dlog_text(DLOG_SD, DLOG_WARN, "Failed to open for read/write: %s (%s)", fullpath, strerror(errno));
                 }
                 break;
             }
@@ -356,9 +483,7 @@ static void port_out(z80 *z, uint8_t port, uint8_t val) {
                 if (sd_file) {
                     fclose(sd_file);
                     sd_file = NULL;
-                    if (debug_mode) {
-                        fprintf(stderr, "[SD] Closed file\n");
-                    }
+                    DLOG(DLOG_SD, DLOG_DEBUG, "Closed file", 0, 0, 0);
                 }
                 if (sd_dir) {
                     closedir(sd_dir);
@@ -381,9 +506,7 @@ static void port_out(z80 *z, uint8_t port, uint8_t val) {
 
                 if (sd_dir) {
                     sd_status = SD_STATUS_READY;
-                    if (debug_mode) {
-                        fprintf(stderr, "[SD] DIR: %s\n", sd_storage_dir);
-                    }
+                    DLOG_STR(DLOG_SD, DLOG_DEBUG, "DIR: %s", sd_storage_dir, 0, 0);
                 } else {
                     sd_status = SD_STATUS_ERROR | SD_STATUS_READY;
                 }
@@ -394,9 +517,7 @@ static void port_out(z80 *z, uint8_t port, uint8_t val) {
                 if (sd_file) {
                     fseek(sd_file, sd_seek_pos, SEEK_SET);
                     sd_status = SD_STATUS_READY;
-                    if (debug_mode) {
-                        fprintf(stderr, "[SD] Seeked to position %d\n", sd_seek_pos);
-                    }
+                    DLOG(DLOG_SD, DLOG_DEBUG, "Seeked to position %u", sd_seek_pos, 0, 0);
                 } else {
                     sd_status = SD_STATUS_ERROR | SD_STATUS_READY;
                 }
@@ -405,7 +526,11 @@ static void port_out(z80 *z, uint8_t port, uint8_t val) {
     }
     else if (port == SD_DATA_PORT) {
         if (sd_file) {
+            phase_id ph = phase_enter(PH_HOSTIO);
             fputc(val, sd_file);
+            phase_leave(ph);
+            if (metrics_enabled) metrics_add(&metrics.sd_written, 1);
+            DLOG(DLOG_SD, DLOG_TRACE, "Write %02X", val, 0, 0);
         }
     }
     else if (port == SD_FNAME_PORT) {
@@ -413,27 +538,27 @@ static void port_out(z80 *z, uint8_t port, uint8_t val) {
             /* Null terminator - filename complete */
             sd_filename[sd_filename_pos] = '\0';
             sd_filename_pos = 0;
-            if (debug_mode) {
-                fprintf(stderr, "[SD] Filename set: %s\n", sd_filename);
-            }
+            DLOG_STR(DLOG_SD, DLOG_DEBUG, "Filename set: %s", sd_filename, 0, 0);
         } else if (sd_filename_pos < (int)sizeof(sd_filename) - 1) {
             sd_filename[sd_filename_pos++] = (char)val;
         }
     }
     else if (port == SD_SEEK_LO) {
         sd_seek_pos = (sd_seek_pos & 0xFF00) | val;
-        if (debug_mode) {
-            fprintf(stderr, "[SD] Seek position low: %d (pos=%d)\n", val, sd_seek_pos);
-        }
+        DLOG(DLOG_SD, DLOG_TRACE, "Seek position low: %u (pos=%u)", val, sd_seek_pos, 0);
     }
     else if (port == SD_SEEK_HI) {
         sd_seek_pos = (sd_seek_pos & 0x00FF) | ((uint16_t)val << 8);
-        if (debug_mode) {
-            fprintf(stderr, "[SD] Seek position high: %d (pos=%d)\n", val, sd_seek_pos);
-        }
+        DLOG(DLOG_SD, DLOG_TRACE, "Seek position high: %u (pos=%u)", val, sd_seek_pos, 0);
     }
 }
 
+static void port_out(z80 *z, uint8_t port, uint8_t val) {
+    phase_id ph = phase_enter(PH_DEVICE);
+    port_write(z, port, val);
+    phase_leave(ph);
+}
+
 /* Configure ROM size based on ROM type */
 static void configure_rom(const char *filename) {
     const char *basename = strrchr(filename, '/');
@@ -442,16 +567,18 @@ static void configure_rom(const char *filename) {
     /* MINT: small ROM (~2KB), rest is RAM */
     if (strstr(basename, "mint") != NULL) {
         rom_size = 0x0800;  /* 2KB ROM */
-        if (debug_mode) fprintf(stderr, "MINT ROM: %d bytes protected\n", rom_size);
+        dlog_text(DLOG_CORE, DLOG_INFO, "MINT ROM: %d bytes protected", rom_size);
     }
     /* Default: 8KB ROM */
     else {
         rom_size = 0x2000;
-        if (debug_mode) fprintf(stderr, "Default ROM: %d bytes protected\n", rom_size);
+        dlog_text(DLOG_CORE, DLOG_INFO, "Default ROM: %d bytes protected", rom_size);
     }
 }
 
 /* Load binary ROM file */
+static size_t rom_bytes = 0;   /* Image size; bytes past rom_size preload RAM */
+
 static int load_rom(const char *filename) {
     FILE *f = fopen(filename, "rb");
     if (!f) {
@@ -462,15 +589,14 @@ static int load_rom(const char *filename) {
     /* Read up to full 64KB - some ROMs include RAM initialization */
     size_t bytes = fread(memory, 1, MEM_SIZE, f);
     fclose(f);
+    rom_bytes = bytes;
 
     if (bytes == 0) {
         fprintf(stderr, "Failed to read ROM file\n");
         return -1;
     }
 
-    if (debug_mode) {
-        fprintf(stderr, "Loaded %zu bytes from %s\n", bytes, filename);
-    }
+    dlog_text(DLOG_CORE, DLOG_INFO, "Loaded %zu bytes from %s", bytes, filename);
 
     return 0;
 }
@@ -498,6 +624,148 @@ static void set_raw_mode(void) {
     }
 }
 
+/* Record the options a later run needs to repeat this one */
+/* Relative paths are recorded against the working directory, so the run
+ * can be repeated from elsewhere */
+static void absolute_path(char *out, size_t size, const char *path) {
+    size_t n = 0;
+    if (path[0] != '/' && getcwd(out, size)) {
+        n = strlen(out);
+        if (n + 1 < size) out[n++] = '/';
+    }
+    snprintf(out + n, size - n, "%s", path);
+}
+
+static void record_run_options(const char *rom_file) {
+    absolute_path(snap_run.rom, sizeof(snap_run.rom), rom_file);
+    absolute_path(snap_run.storage, sizeof(snap_run.storage), sd_storage_dir);
+    struct stat st;
+    if (fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode)) {
+        ssize_t n = readlink("/proc/self/fd/0", snap_run.input, sizeof(snap_run.input) - 1);
+        snap_run.input[n > 0 ? n : 0] = '\0';
+    }
+    snap_run.max_cycles = max_cycles > 0 ? (uint64_t)max_cycles : 0;
+    snap_run.rx_pace = (uint32_t)rx_pace;
+    snap_run.eof_policy = (uint8_t)eof_policy;
+    snap_run.clock_port = cycport_enabled ? cycport_base : 0;
+}
+
+/* Save a snapshot named <prefix>.<instructions>.snap */
+static void save_snapshot(void) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s.%llu.snap", snap_prefix,
+             (unsigned long long)total_instr);
+
+    /* An open host file or directory cannot be restored; skip this one */
+    if (sd_file || sd_dir) {
+        dlog_text(DLOG_CORE, DLOG_WARN, "Snapshot %s skipped: SD %s open", path,
+                  sd_file ? "file" : "directory listing");
+        return;
+    }
+
+    snapshot_extra extra = {
+        .instructions = total_instr,
+        .input_consumed = input_consumed,
+        .acia_control = acia_control,
+        .uses_8251 = uses_8251,
+        .int_pending = int_pending,
+        .sd_status = sd_status,
+        .sd_seek_pos = sd_seek_pos,
+        .sd_filename_pos = (uint16_t)sd_filename_pos,
+        .run = snap_run,
+    };
+    memcpy(extra.sd_filename, sd_filename, sizeof(sd_filename));
+    if (snapshot_save(path, &cpu, memory, &extra) == 0) {
+        dlog_text(DLOG_CORE, DLOG_INFO, "Snapshot: %s", path);
+    }
+}
+
+/* Restore a snapshot and skip the host input it had already consumed */
+static int restore_snapshot(const char *path) {
+    snapshot_extra extra;
+    if (snapshot_load(path, &cpu, memory, &extra) < 0) {
+        return -1;
+    }
+    total_instr = extra.instructions;
+    if (memcheck_enabled) {
+        memcheck_mark(0, MEM_SIZE);  /* The snapshot carries no shadow */
+    }
+    acia_control = extra.acia_control;
+    uses_8251 = extra.uses_8251;
+    int_pending = extra.int_pending;
+    sd_status = extra.sd_status;
+    sd_seek_pos = extra.sd_seek_pos;
+    sd_filename_pos = extra.sd_filename_pos < sizeof(sd_filename) ? extra.sd_filename_pos : 0;
+    memcpy(sd_filename, extra.sd_filename, sizeof(sd_filename));
+
+    if (hostin_active) {
+        input_consumed = hostin_skip(extra.input_consumed);
+    }
+    /* Skipped keys are not timed */
+    bool timing = latency_enabled;
+    latency_enabled = false;
+    while (input_consumed < extra.input_consumed) {
+        if (!rxq_ready(&tty_queue)) {
+            tty_fill(true);
+            if (stdin_eof) break;
+            continue;
+        }
+        rxq_getc(&tty_queue);
+        input_consumed++;
+    }
+    latency_enabled = timing;
+
+    dlog_text(DLOG_CORE, DLOG_INFO, "Restored %s at instruction %llu, cycle %lu",
+              path, (unsigned long long)total_instr, cpu.cyc);
+    return 0;
+}
+
+/* Shorten the bound b to keep the next event at 'next' instructions exact */
+static void clamp_instr(uint64_t *b, uint64_t next) {
+    uint64_t room = next > total_instr + 1 ? next - total_instr - 1 : 0;
+    if (room < *b) *b = room;
+}
+
+/* Advance a recognised loop at cpu.pc. Skipped instructions never cross a
+ * checkpoint, snapshot, stop point or a possible 8251 interrupt. */
+static void fast_forward(void) {
+    loopff_limits lim = { ULONG_MAX, UINT64_MAX, rom_size };
+
+    if (cpu.int_pending || cpu.nmi_pending) return;
+    if (uses_8251 && cpu.iff1) {
+        if (kbhit()) return;
+        if (hostin_active && hostin_pos < hostin_len && hostin_next > cpu.cyc) {
+            lim.max_cyc = hostin_next - 1;   /* Paced byte becomes visible */
+        }
+    }
+    if (max_cycles > 0) {
+        unsigned long last = (unsigned long)max_cycles - 1;
+        if (last < lim.max_cyc) lim.max_cyc = last;
+    }
+    if (stop_instr > 0) clamp_instr(&lim.max_instr, stop_instr);
+    if (statehash_enabled) clamp_instr(&lim.max_instr, statehash_next);
+    if (snap_prefix && snap_every > 0) clamp_instr(&lim.max_instr, snap_next);
+
+    uint16_t wr_start = 0;
+    uint32_t wr_len = 0;
+    uint64_t skipped = loopff_try(&cpu, memory, &lim, &wr_start, &wr_len);
+    total_instr += skipped;
+    if (statehash_enabled && wr_len > 0) {
+        for (uint32_t a = wr_start & 0xFF00; a < (uint32_t)wr_start + wr_len; a += 256) {
+            statehash_dirty((uint16_t)a);
+        }
+    }
+}
+
+/* Hand the run loop's counters to the metrics thread */
+static void publish_metrics(void) {
+    metrics_set(&metrics.cycles, cpu.cyc);
+    metrics_set(&metrics.instructions, total_instr);
+    metrics_set(&metrics.input_bytes, input_consumed);
+    metrics_set(&metrics.input_queued, hostin_active ? hostin_len - hostin_pos
+                                                     : rxq_pending(&tty_queue));
+}
+
 int main(int argc, char *argv[]) {
     const char *rom_file = NULL;
 
@@ -505,16 +773,43 @@ int main(int argc, char *argv[]) {
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
             fprintf(stderr, "RetroShield Z80 Emulator v%s\n\n", VERSION);
-            fprintf(stderr, "Usage: %s [-d] [-c cycles] [-m addr [len]] [-s dir] <rom.bin>\n", argv[0]);
+            fprintf(stderr, "Usage: %s [-d] [-c cycles] [-m addr [len]] [-s dir] [-t file] <rom.bin>\n", argv[0]);
             fprintf(stderr, "  -h, --help      Show this help message\n");
-            fprintf(stderr, "  -d, --debug     Debug mode\n");
+            fprintf(stderr, "  -d, --debug     Debug mode (same as --log core,sd)\n");
             fprintf(stderr, "  -c cycles       Max cycles to run (0 = unlimited)\n");
             fprintf(stderr, "  -m addr [len]   Dump memory at addr after run\n");
             fprintf(stderr, "  -s, --storage   SD card storage directory (default: storage)\n");
+            fprintf(stderr, "  -t, --trace f   Write indexed execution trace to f (query with retroshield_trace)\n");
+            fprintf(stderr, "  --branch-trace f     Write compact branch/input trace to f (replay with retroshield_replay)\n");
+            fprintf(stderr, "  --hash-every N f     Write a state-hash checkpoint to f every N instructions\n");
+            fprintf(stderr, "  --snapshot-every N p Save snapshot p.<instr>.snap every N instructions\n");
+            fprintf(stderr, "  --restore f          Start from snapshot f\n");
+            fprintf(stderr, "  --stop-instr N       Stop after instruction N\n");
+            fprintf(stderr, "  --latency            Report keystroke-to-echo latency at exit\n");
+            fprintf(stderr, "  --gprof [spec]       Profile by guest BASIC line / Forth word\n");
+            fprintf(stderr, "                       spec: var:ADDR[:IDLE] or pc:ADDR:bc|de|hl|ix|iy\n");
+            fprintf(stderr, "  --rx-pace N          Deliver piped/file input at most one byte per N cycles\n");
+            fprintf(stderr, "  --eof stop|idle|poll At end of piped/file input: stop, run on (default), or keep polling\n");
+            fprintf(stderr, "  --clock-port BASE    Map guest cycle counter / host usec clock at ports BASE..BASE+15\n");
+            fprintf(stderr, "  --io-stats           Report per-port / per-PC I/O counts and polling loops at exit\n");
+            fprintf(stderr, "  --memcheck           Report reads of RAM that was never written\n");
+            fprintf(stderr, "  --protect rule[=act] rom | exec:START-END | stack:LO-HI (hex); act = warn|break|abort\n");
+            fprintf(stderr, "  --loop-ff            Fast-forward recognised delay/fill/search loops\n");
+            fprintf(stderr, "  --log cat[:lvl],...  Log categories core|sd|acia|8251|int|mem|all at\n");
+            fprintf(stderr, "                       error|warn|info|debug (default)|trace\n");
+            fprintf(stderr, "  --log-file f         Write the log to f instead of stderr\n");
+            fprintf(stderr, "  --metrics-listen A   Serve OpenMetrics at http://A/metrics (A = [addr:]port)\n");
+            fprintf(stderr, "  --phases             Report host time by phase (core/device/host I/O) at exit\n");
+            fprintf(stderr, "  --minimize f         Shrink input script f to f.min, keeping the failure below\n");
+            fprintf(stderr, "  --fail-output TEXT   Failure: the guest prints TEXT\n");
+            fprintf(stderr, "  --fail-pc ADDR       Failure: PC reaches ADDR (hex)\n");
+            fprintf(stderr, "  --fail-watchdog N    Failure: serial port not polled for N cycles\n");
+            fprintf(stderr, "  --fail-halt          Failure: the CPU halts\n");
+            fprintf(stderr, "  --settle N           A run passes after N cycles without taking input (default 20M)\n");
             return 0;
         }
         else if (strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--debug") == 0) {
-            debug_mode = true;
+            dlog_parse("core,sd");
         }
         else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
             max_cycles = atoi(argv[++i]);
@@ -529,17 +824,124 @@ int main(int argc, char *argv[]) {
         else if ((strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "--storage") == 0) && i + 1 < argc) {
             sd_storage_dir = argv[++i];
         }
+        else if ((strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--trace") == 0) && i + 1 < argc) {
+            trace_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--branch-trace") == 0 && i + 1 < argc) {
+            btrace_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--hash-every") == 0 && i + 2 < argc) {
+            hash_every = strtoull(argv[++i], NULL, 0);
+            hash_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--snapshot-every") == 0 && i + 2 < argc) {
+            snap_every = strtoull(argv[++i], NULL, 0);
+            snap_prefix = argv[++i];
+        }
+        else if (strcmp(argv[i], "--restore") == 0 && i + 1 < argc) {
+            restore_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--stop-instr") == 0 && i + 1 < argc) {
+            stop_instr = strtoull(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--latency") == 0) {
+            latency_enabled = true;
+        }
+        else if (strcmp(argv[i], "--gprof") == 0) {
+            guestprof_enabled = true;
+            if (i + 1 < argc && (strncmp(argv[i+1], "var:", 4) == 0 ||
+                                 strncmp(argv[i+1], "pc:", 3) == 0)) {
+                gprof_spec = argv[++i];
+            }
+        }
+        else if (strcmp(argv[i], "--rx-pace") == 0 && i + 1 < argc) {
+            rx_pace = strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--eof") == 0 && i + 1 < argc) {
+            if (hostin_parse_eof(argv[++i], &eof_policy) < 0) {
+                fprintf(stderr, "--eof takes stop, idle or poll\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--memcheck") == 0) {
+            memcheck_uninit = true;
+        }
+        else if (strcmp(argv[i], "--protect") == 0 && i + 1 < argc) {
+            if (protect_count == (int)(sizeof(protect_specs) / sizeof(protect_specs[0]))) {
+                fprintf(stderr, "Too many --protect rules\n");
+                return 1;
+            }
+            protect_specs[protect_count++] = argv[++i];
+        }
+        else if (strcmp(argv[i], "--loop-ff") == 0) {
+            loopff_enabled = true;
+        }
+        else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+            if (dlog_parse(argv[++i]) < 0) {
+                fprintf(stderr, "Bad --log spec: %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--log-file") == 0 && i + 1 < argc) {
+            log_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--metrics-listen") == 0 && i + 1 < argc) {
+            metrics_spec = argv[++i];
+        }
+        else if (strcmp(argv[i], "--phases") == 0) {
+            phase_enabled = true;
+        }
+        else if (strcmp(argv[i], "--io-stats") == 0) {
+            iostats_enabled = true;
+        }
+        else if (strcmp(argv[i], "--clock-port") == 0 && i + 1 < argc) {
+            if (cycport_map(strtoul(argv[++i], NULL, 0)) < 0) {
+                fprintf(stderr, "--clock-port needs a multiple of 0x10 clear of $00, $10 and $80\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--minimize") == 0 && i + 1 < argc) {
+            minimize_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--fail-output") == 0 && i + 1 < argc) {
+            fail_pred.output = argv[++i];
+        }
+        else if (strcmp(argv[i], "--fail-pc") == 0 && i + 1 < argc) {
+            fail_pred.pc = (int)(strtoul(argv[++i], NULL, 16) & 0xFFFF);
+        }
+        else if (strcmp(argv[i], "--fail-watchdog") == 0 && i + 1 < argc) {
+            fail_pred.watchdog = strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--fail-halt") == 0) {
+            fail_pred.halt = true;
+        }
+        else if (strcmp(argv[i], "--settle") == 0 && i + 1 < argc) {
+            settle_cycles = strtoul(argv[++i], NULL, 0);
+        }
         else if (argv[i][0] != '-') {
             rom_file = argv[i];
         }
     }
 
     if (!rom_file) {
-        fprintf(stderr, "Usage: %s [-d] [-c cycles] [-m addr [len]] [-s dir] <rom.bin>\n", argv[0]);
+        fprintf(stderr, "Usage: %s [-d] [-c cycles] [-m addr [len]] [-s dir] [-t file] <rom.bin>\n", argv[0]);
         fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
         return 1;
     }
 
+    if (minimize_path) {
+        if (!minimize_predicate_set(&fail_pred)) {
+            fprintf(stderr, "--minimize needs --fail-output, --fail-pc, --fail-watchdog or --fail-halt\n");
+            return 1;
+        }
+        return minimize_run(rom_file, minimize_path, &fail_pred, settle_cycles,
+                            max_cycles > 0 ? (unsigned long)max_cycles : 0);
+    }
+
+    if (dlog_open(log_path) < 0) {
+        return 1;
+    }
+
     /* Initialize memory */
     memset(memory, 0, sizeof(memory));
 
@@ -551,31 +953,116 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    /* Shadow RAM initialisation; the image's RAM part counts as written */
+    if (memcheck_uninit) {
+        memcheck_uninit_enable(rom_size, rom_bytes);
+    }
+    for (int r = 0; r < protect_count; r++) {
+        if (memcheck_protect(protect_specs[r], rom_size) < 0) {
+            fprintf(stderr, "Bad --protect rule: %s\n", protect_specs[r]);
+            return 1;
+        }
+    }
+
     /* Initialize CPU */
     z80_init(&cpu);
     cpu.read_byte = mem_read;
     cpu.write_byte = mem_write;
     cpu.port_in = port_in;
     cpu.port_out = port_out;
+    dlog_attach(&cpu);
+
+    /* Serve piped or file input from memory, terminal input via tty_queue */
+    if (rxq_init(&tty_queue, RXQ_DEFAULT_SIZE) < 0) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    if (hostin_open(STDIN_FILENO, rx_pace, eof_policy) < 0) {
+        return 1;
+    }
+
+    if (snap_prefix) record_run_options(rom_file);
+
+    /* Resume from a snapshot */
+    if (restore_path && restore_snapshot(restore_path) < 0) {
+        return 1;
+    }
+
+    if (metrics_spec && metrics_listen(metrics_spec, rom_file) < 0) {
+        return 1;
+    }
+
+    /* Configure guest-language profiler */
+    if (guestprof_enabled) {
+        if (gprof_spec ? guestprof_configure_spec(gprof_spec) < 0
+                       : guestprof_configure_rom(rom_file) < 0) {
+            fprintf(stderr, "No guest profiler configuration for %s; use --gprof var:ADDR or pc:ADDR:REG\n",
+                    gprof_spec ? gprof_spec : rom_file);
+            return 1;
+        }
+        guestprof_last_cyc = cpu.cyc;
+    }
+
+    /* Open execution trace */
+    if (trace_path && trace_open(trace_path) < 0) {
+        return 1;
+    }
+    if (btrace_path && btrace_open(btrace_path, rom_size, cpu.cyc, total_instr) < 0) {
+        return 1;
+    }
+
+    /* Open state-hash stream and schedule snapshots */
+    if (hash_path) {
+        if (statehash_open(hash_path, hash_every, total_instr) < 0) {
+            return 1;
+        }
+        for (uint32_t a = rom_size; a < MEM_SIZE; a += 256) {
+            statehash_dirty((uint16_t)a);
+        }
+    }
+    if (snap_prefix && snap_every > 0) {
+        snap_next = (total_instr / snap_every + 1) * snap_every;
+    }
+
+    /* Traces and memcheck need to see every access */
+    if (loopff_enabled && (trace_path || btrace_path || memcheck_enabled)) {
+        dlog_text(DLOG_CORE, DLOG_INFO, "Loop fast-forward disabled by --trace/--branch-trace/--memcheck/--protect");
+        loopff_enabled = false;
+    }
 
     /* Set terminal to raw mode for character-by-character input */
     set_raw_mode();
 
-    if (debug_mode) {
-        fprintf(stderr, "Starting Z80 emulation...\n");
-    }
+    dlog_text(DLOG_CORE, DLOG_INFO, "Starting Z80 emulation...");
+    if (phase_enabled) phase_start();
 
     /* Main emulation loop */
     unsigned long total_cycles = 0;
-    bool int_pending = false;
+    unsigned metrics_countdown = 1;
 
     while (1) {
+        uint16_t step_pc = cpu.pc;
+        if (loopff_enabled && loopff_idiom[step_pc] > LF_NONE) fast_forward();
+        if (memcheck_enabled) memcheck_begin(cpu.pc, cpu.cyc);
+        if (trace_enabled) trace_begin(cpu.cyc, cpu.pc, memory);
+        if (btrace_enabled) btrace_step_cyc = cpu.cyc;
         z80_step(&cpu);
+        if (trace_enabled) trace_end();
+        if (btrace_enabled) btrace_step(step_pc, cpu.pc);
+        if (memcheck_enabled) memcheck_end(cpu.sp);
+        if (loopff_enabled && cpu.pc <= step_pc && !loopff_idiom[cpu.pc]) {
+            loopff_learn(cpu.pc, memory, rom_size);
+        }
         total_cycles = cpu.cyc;
+        total_instr++;
+        if (guestprof_enabled) guestprof_step(&cpu, memory);
 
         /* Trigger interrupt when input is available (for 8251-based ROMs only) */
         if (uses_8251 && kbhit() && cpu.iff1 && !int_pending && cpu.iff_delay == 0) {
             z80_gen_int(&cpu, 0xFF);  /* RST 38H vector for IM 1 */
+            if (btrace_enabled) btrace_int(cpu.cyc, 0xFF);
+            if (metrics_enabled) metrics_add(&metrics.interrupts, 1);
+            DLOG(DLOG_INT, DLOG_DEBUG, "INT raised for input, vector %02X", 0xFF, 0, 0);
             int_pending = true;
         }
 
@@ -584,23 +1071,74 @@ int main(int argc, char *argv[]) {
             int_pending = false;
         }
 
+        if (metrics_enabled && --metrics_countdown == 0) {
+            publish_metrics();
+            metrics_countdown = METRICS_PUBLISH_EVERY;
+        }
+
+        /* Checkpoints land on instruction boundaries, after interrupt latching */
+        if (statehash_enabled && total_instr >= statehash_next) {
+            statehash_checkpoint(&cpu, memory, total_instr);
+        }
+        if (snap_prefix && snap_every > 0 && total_instr >= snap_next) {
+            save_snapshot();
+            snap_next = total_instr + snap_every;
+        }
+
+        if (memcheck_break) {
+            dlog_text(DLOG_CORE, DLOG_INFO, "Protection %s at PC=%04X after %lu cycles",
+                      memcheck_abort ? "abort" : "break", cpu.pc, total_cycles);
+            break;
+        }
+
+        if (hostin_done) {
+            dlog_text(DLOG_CORE, DLOG_INFO, "End of input at PC=%04X after %lu cycles", cpu.pc, total_cycles);
+            break;
+        }
+
+        if (stop_instr > 0 && total_instr >= stop_instr) {
+            dlog_text(DLOG_CORE, DLOG_INFO, "Stopped at PC=%04X after %llu instructions",
+                      cpu.pc, (unsigned long long)total_instr);
+            break;
+        }
+
         if (max_cycles > 0 && total_cycles >= (unsigned long)max_cycles) {
-            if (debug_mode) {
-                fprintf(stderr, "Stopped at PC=%04X after %lu cycles\n", cpu.pc, total_cycles);
-            }
+            dlog_text(DLOG_CORE, DLOG_INFO, "Stopped at PC=%04X after %lu cycles", cpu.pc, total_cycles);
             break;
         }
 
         /* Check for HALT instruction */
         if (cpu.halted) {
-            if (debug_mode) {
-                fprintf(stderr, "\nCPU halted at PC=%04X after %lu cycles\n",
-                        cpu.pc, total_cycles);
-            }
+            dlog_text(DLOG_CORE, DLOG_INFO, "CPU halted at PC=%04X after %lu cycles", cpu.pc, total_cycles);
             break;
         }
     }
 
+    /* Flush trace and write its index */
+    trace_close();
+    btrace_close(cpu.cyc, total_instr);
+    statehash_close();
+    metrics_close();
+
+    if (latency_enabled) {
+        latency_report(stderr);
+    }
+    if (guestprof_enabled) {
+        guestprof_report(stderr, 20);
+    }
+    if (iostats_enabled) {
+        iostats_report(stderr, total_cycles, 20);
+    }
+    if (memcheck_enabled) {
+        memcheck_report(stderr);
+    }
+    if (loopff_enabled) {
+        loopff_report(stderr);
+    }
+    if (phase_enabled) {
+        phase_report(stderr);
+    }
+
     /* Dump memory if requested */
     if (dump_memory) {
         fprintf(stderr, "\nMemory dump at 0x%04X:\n", dump_addr);
@@ -613,5 +1151,6 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    return 0;
+    dlog_close();
+    return memcheck_abort ? 2 : memcheck_break ? 1 : 0;
 }
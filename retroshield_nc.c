@@ -11,6 +11,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
 #include <locale.h>
 #include <time.h>
 #include <unistd.h>
@@ -21,6 +23,10 @@
 #include <notcurses/notcurses.h>
 #include "z80.h"
 #include "z80_disasm.h"
+#include "latency.h"
+#include "rxqueue.h"
+#include "cpuview.h"
+#include "phase.h"
 
 /* Memory configuration */
 #define MEM_SIZE 0x10000      /* Full 64KB address space */
@@ -55,9 +61,6 @@ static uint16_t ram_end = 0x37FF;
 #define TERM_ROWS 24
 #define TERM_BUF_SIZE (TERM_COLS * TERM_ROWS)
 
-/* Input buffer for emulated system */
-#define INPUT_BUF_SIZE 256
-
 /* Global state */
 static uint8_t memory[MEM_SIZE];
 static z80 cpu;
@@ -67,18 +70,29 @@ static char term_buffer[TERM_BUF_SIZE];
 static int term_cursor_x = 0;
 static int term_cursor_y = 0;
 
-/* Input buffer (keys to send to emulated system) */
-static char input_buffer[INPUT_BUF_SIZE];
-static int input_head = 0;
-static int input_tail = 0;
+/* Input queue (keys to send to emulated system) */
+static rxqueue input_queue;
 static bool int_signaled = false;  /* Track if interrupt was signaled for current input */
 static bool uses_8251 = false;     /* Track if ROM uses 8251 (for interrupt support) */
 
+/* Pasted text, fed to the guest one byte at a time: a byte goes in once
+ * the guest has read the previous one and a short gap has passed, with a
+ * longer gap after each line so an interpreter can digest it. A burst of
+ * PASTE_BURST or more characters in one poll is taken to be a paste. */
+#define PASTE_BURST       4
+#define PASTE_CHAR_CYCLES 2000
+#define PASTE_LINE_CYCLES 50000
+#define PASTE_MAX         (1 << 20)
+#define KEY_BATCH         4096
+static uint8_t *paste_buf = NULL;
+static size_t paste_len = 0, paste_pos = 0, paste_cap = 0;
+static unsigned long paste_due = 0;    /* Cycle the next byte may go in */
+static size_t paste_dropped = 0;       /* Bytes lost to PASTE_MAX, shown on the status bar */
+
 /* Emulator state */
 static bool running = false;
 static bool paused = true;
 static int cycles_per_frame = 50000;
-static unsigned long total_cycles = 0;
 static uint16_t mem_view_addr = 0x0000;
 
 /* Notcurses state */
@@ -97,6 +111,32 @@ static struct timespec last_metrics_time;
 static unsigned long last_cycles = 0;
 static double cycles_per_sec = 0.0;
 static double cpu_percent = 0.0;
+static latency_summary lat_summary;
+static uint64_t phase_last[PH_COUNT];
+static double phase_share[PH_COUNT];   /* Over the last metrics interval */
+
+/* Hotspots: while running, every HOT_SAMPLE_STEPS instructions the cycles
+ * since the previous sample are charged to the current PC. Weights decay
+ * by a quarter at each metrics update, so the panel shows roughly the
+ * last couple of seconds. */
+#define HOT_SAMPLE_STEPS 61     /* Prime, so it does not beat with guest loops */
+#define HOT_TOP 16
+static uint32_t hot_weight[MEM_SIZE];
+static int hot_countdown = HOT_SAMPLE_STEPS;
+static unsigned long hot_last_cyc = 0;
+static uint16_t hot_pc[HOT_TOP];
+static uint32_t hot_pc_weight[HOT_TOP];
+static int hot_count = 0;
+static uint64_t hot_total = 0;
+static bool show_hot = false;   /* Hotspots panel in place of Memory */
+
+/* Symbols (--sym), sorted by address */
+typedef struct {
+    uint16_t addr;
+    char name[24];
+} symbol;
+static symbol *symbols = NULL;
+static int symbol_count = 0;
 
 /* Colors */
 #define COL_BORDER    0x4488cc
@@ -117,10 +157,17 @@ static double cpu_percent = 0.0;
 #define COL_HELP_KEY  0xffcc44
 #define COL_HELP_DESC 0xaaaaaa
 
-/* Previous register values for change highlighting */
-static uint16_t prev_pc, prev_sp, prev_ix, prev_iy;
-static uint8_t prev_a, prev_b, prev_c, prev_d, prev_e, prev_h, prev_l;
-static uint8_t prev_flags;
+/* State published by the run loop at slice boundaries. Panels draw from
+ * cur (read once per frame) and highlight changes against prev (the state
+ * before the slice); each remembers what it last drew and is left as is
+ * when that has not changed. */
+static cpuview view;
+static cpu_view cur, prev;
+static bool reg_valid = false, dis_valid = false, mem_valid = false;
+static cpu_view reg_cur, reg_prev;
+static uint16_t dis_pc;
+static uint32_t dis_gen, mem_gen;
+static uint16_t mem_addr, mem_pc, mem_sp;
 
 /* Forward declarations */
 static void term_putchar(char c);
@@ -138,10 +185,11 @@ static void mem_write(void *userdata, uint16_t addr, uint8_t val) {
     /* Protect ROM area */
     if (addr >= rom_size) {
         memory[addr] = val;
+        cpuview_touch(&view, addr);
     }
 }
 
-static uint8_t port_in(z80 *z, uint8_t port) {
+static uint8_t port_read(z80 *z, uint8_t port) {
     (void)z;
     /* MC6850 ACIA (ports $80/$81) */
     if (port == ACIA_CTRL) {
@@ -172,15 +220,17 @@ static uint8_t port_in(z80 *z, uint8_t port) {
     return 0xFF;
 }
 
-static void port_out(z80 *z, uint8_t port, uint8_t val) {
+static void port_write(z80 *z, uint8_t port, uint8_t val) {
     (void)z;
     /* MC6850 ACIA (port $81) */
     if (port == ACIA_DATA) {
         term_putchar(val);
+        latency_tx();
     }
     /* Intel 8251 USART (port $00) - data */
     else if (port == USART_DATA) {
         term_putchar(val);
+        latency_tx();
     }
     /* Intel 8251 USART (port $01) - mode/command register */
     else if (port == USART_CTRL) {
@@ -190,6 +240,20 @@ static void port_out(z80 *z, uint8_t port, uint8_t val) {
     }
 }
 
+/* Port callbacks, timed as device work with --phases */
+static uint8_t port_in(z80 *z, uint8_t port) {
+    phase_id ph = phase_enter(PH_DEVICE);
+    uint8_t val = port_read(z, port);
+    phase_leave(ph);
+    return val;
+}
+
+static void port_out(z80 *z, uint8_t port, uint8_t val) {
+    phase_id ph = phase_enter(PH_DEVICE);
+    port_write(z, port, val);
+    phase_leave(ph);
+}
+
 /* Terminal emulation */
 static void term_clear(void) {
     memset(term_buffer, ' ', TERM_BUF_SIZE);
@@ -232,23 +296,72 @@ static void term_putchar(char c) {
 
 /* Input buffer */
 static bool input_available(void) {
-    return input_head != input_tail;
+    return rxq_ready(&input_queue);
 }
 
 static char input_getchar(void) {
-    if (input_head == input_tail) return 0;
-    char c = input_buffer[input_tail];
-    input_tail = (input_tail + 1) % INPUT_BUF_SIZE;
+    int c = rxq_getc(&input_queue);
+    if (c < 0) return 0;
     int_signaled = false;  /* Allow new interrupt for next character */
-    return c;
+    latency_guest_read();
+    return (char)c;
 }
 
 static void input_putchar(char c) {
-    int next = (input_head + 1) % INPUT_BUF_SIZE;
-    if (next != input_tail) {
-        input_buffer[input_head] = c;
-        input_head = next;
+    if (rxq_putc(&input_queue, (uint8_t)c)) {
         int_signaled = false;  /* New input, allow interrupt */
+        latency_key();
+    }
+}
+
+static bool paste_pending(void) {
+    return paste_pos < paste_len;
+}
+
+static void paste_append(const uint8_t *data, size_t len) {
+    if (paste_pos == paste_len) {
+        paste_pos = paste_len = 0;
+        paste_dropped = 0;     /* A fresh paste clears the old warning */
+    }
+    if (paste_len + len > paste_cap && paste_pos > 0) {
+        /* Reclaim what the guest has already taken before growing */
+        memmove(paste_buf, paste_buf + paste_pos, paste_len - paste_pos);
+        paste_len -= paste_pos;
+        paste_pos = 0;
+    }
+    if (paste_len + len > paste_cap && paste_cap < PASTE_MAX) {
+        size_t cap = paste_cap ? paste_cap : 4096;
+        while (cap < paste_len + len && cap < PASTE_MAX) cap *= 2;
+        if (cap > PASTE_MAX) cap = PASTE_MAX;
+        uint8_t *b = realloc(paste_buf, cap);
+        if (b) {
+            paste_buf = b;
+            paste_cap = cap;
+        }
+    }
+    if (paste_len + len > paste_cap) {
+        paste_dropped += paste_len + len - paste_cap;
+        len = paste_cap - paste_len;
+    }
+    memcpy(paste_buf + paste_len, data, len);
+    paste_len += len;
+}
+
+/* From the run loop: hand the guest the next pasted byte when it is due */
+static inline void paste_tick(void) {
+    if (!paste_pending() || cpu.cyc < paste_due || input_available()) return;
+    uint8_t c = paste_buf[paste_pos++];
+    if (rxq_putc(&input_queue, c)) int_signaled = false;
+    paste_due = cpu.cyc + (c == '\r' ? PASTE_LINE_CYCLES : PASTE_CHAR_CYCLES);
+}
+
+/* Characters taken in one poll: keys if few, a paste if many, and behind
+ * any paste still being fed so the order holds */
+static void take_typed(const uint8_t *data, size_t len) {
+    if (len >= PASTE_BURST || paste_pending()) {
+        paste_append(data, len);
+    } else {
+        for (size_t i = 0; i < len; i++) input_putchar((char)data[i]);
     }
 }
 
@@ -276,10 +389,144 @@ static int load_rom(const char *filename) {
     return (bytes > 0) ? 0 : -1;
 }
 
-/* Get flags as byte */
-static uint8_t get_flags(void) {
-    return (cpu.sf << 7) | (cpu.zf << 6) | (cpu.yf << 5) | (cpu.hf << 4) |
-           (cpu.xf << 3) | (cpu.pf << 2) | (cpu.nf << 1) | cpu.cf;
+/* Parse a symbol value: $1234, 0x1234, 1234h or plain hex */
+static bool parse_sym_addr(const char *tok, uint16_t *addr) {
+    char buf[16];
+    size_t len = strlen(tok);
+    if (len == 0 || len >= sizeof(buf)) return false;
+    memcpy(buf, tok, len + 1);
+    const char *p = buf;
+    if (*p == '$') p++;
+    else if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) p += 2;
+    else if (buf[len - 1] == 'h' || buf[len - 1] == 'H') buf[len - 1] = '\0';
+    if (*p == '\0') return false;
+    char *end;
+    unsigned long v = strtoul(p, &end, 16);
+    if (*end != '\0' || v > 0xFFFF) return false;
+    *addr = (uint16_t)v;
+    return true;
+}
+
+/* Written as a number rather than a label: a $, 0x or h marker, or a
+ * leading digit */
+static bool looks_numeric(const char *tok) {
+    size_t len = strlen(tok);
+    return tok[0] == '$' || isdigit((unsigned char)tok[0]) ||
+           (len > 0 && (tok[len - 1] == 'h' || tok[len - 1] == 'H'));
+}
+
+static int cmp_symbol(const void *a, const void *b) {
+    return (int)((const symbol *)a)->addr - (int)((const symbol *)b)->addr;
+}
+
+/* Load "ADDR NAME", "NAME ADDR" or "NAME[:] EQU|= ADDR" lines (assembler
+ * .sym/.map). When both words of a pair read as hex, the second is the
+ * address unless only the first looks numeric, so "BEEF 0100" names 0100. */
+static int load_symbols(const char *filename) {
+    FILE *f = fopen(filename, "r");
+    if (!f) return -1;
+    char line[256];
+    int cap = 0;
+    while (fgets(line, sizeof(line), f)) {
+        char *semi = strchr(line, ';');
+        if (semi) *semi = '\0';
+        char *tok[3] = {0};
+        int n = 0;
+        for (char *t = strtok(line, " \t\r\n"); t && n < 3; t = strtok(NULL, " \t\r\n")) {
+            tok[n++] = t;
+        }
+        if (n < 2) continue;
+
+        const char *name;
+        uint16_t addr, addr0, addr1;
+        bool is0 = parse_sym_addr(tok[0], &addr0);
+        bool is1 = parse_sym_addr(tok[1], &addr1);
+        if (n == 3 && (strcasecmp(tok[1], "equ") == 0 || strcmp(tok[1], "=") == 0) &&
+            parse_sym_addr(tok[2], &addr)) {
+            name = tok[0];
+        } else if (is0 && (!is1 || (looks_numeric(tok[0]) && !looks_numeric(tok[1])))) {
+            addr = addr0;
+            name = tok[1];
+        } else if (is1) {
+            addr = addr1;
+            name = tok[0];
+        } else {
+            continue;
+        }
+
+        if (symbol_count == cap) {
+            cap = cap ? cap * 2 : 256;
+            symbol *v = realloc(symbols, cap * sizeof(symbol));
+            if (!v) break;
+            symbols = v;
+        }
+        symbol *sym = &symbols[symbol_count++];
+        sym->addr = addr;
+        snprintf(sym->name, sizeof(sym->name), "%.*s", (int)strcspn(name, ":"), name);
+    }
+    fclose(f);
+    qsort(symbols, symbol_count, sizeof(symbol), cmp_symbol);
+    return 0;
+}
+
+/* "name+off" for the nearest symbol at or below addr; "" if none */
+static void symbolize(uint16_t addr, char *buf, size_t size) {
+    int lo = 0, hi = symbol_count - 1, best = -1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (symbols[mid].addr <= addr) {
+            best = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    if (best < 0) {
+        buf[0] = '\0';
+    } else if (symbols[best].addr == addr) {
+        snprintf(buf, size, "%s", symbols[best].name);
+    } else {
+        snprintf(buf, size, "%s+%u", symbols[best].name, addr - symbols[best].addr);
+    }
+}
+
+/* Hotspot sampling, from the run loop */
+static inline void hot_tick(void) {
+    if (--hot_countdown > 0) return;
+    hot_countdown = HOT_SAMPLE_STEPS;
+    hot_weight[cpu.pc] += (uint32_t)(cpu.cyc - hot_last_cyc);
+    hot_last_cyc = cpu.cyc;
+}
+
+/* Pick the top PCs, then decay every weight by a quarter */
+static void hot_update(void) {
+    hot_count = 0;
+    hot_total = 0;
+    for (int pc = 0; pc < MEM_SIZE; pc++) {
+        uint32_t w = hot_weight[pc];
+        if (w == 0) continue;
+        hot_total += w;
+        if (hot_count == HOT_TOP && w <= hot_pc_weight[HOT_TOP - 1]) {
+            hot_weight[pc] = w - (w + 3) / 4;
+            continue;
+        }
+        int i = hot_count < HOT_TOP ? hot_count++ : HOT_TOP - 1;
+        while (i > 0 && hot_pc_weight[i - 1] < w) {
+            hot_pc[i] = hot_pc[i - 1];
+            hot_pc_weight[i] = hot_pc_weight[i - 1];
+            i--;
+        }
+        hot_pc[i] = (uint16_t)pc;
+        hot_pc_weight[i] = w;
+        hot_weight[pc] = w - (w + 3) / 4;
+    }
+}
+
+static void hot_reset(void) {
+    memset(hot_weight, 0, sizeof(hot_weight));
+    hot_count = 0;
+    hot_total = 0;
+    hot_last_cyc = cpu.cyc;
 }
 
 /* Draw a box with title using Unicode box-drawing chars */
@@ -315,81 +562,100 @@ static void draw_box(struct ncplane *p, const char *title) {
 
 /* Draw registers panel */
 static void draw_registers(void) {
+    cpu_view c = cur, p = prev;
+    c.cyc = p.cyc = 0;   /* Not shown here */
+    if (reg_valid && memcmp(&c, &reg_cur, sizeof(c)) == 0 &&
+        memcmp(&p, &reg_prev, sizeof(p)) == 0) {
+        return;
+    }
+    reg_cur = c;
+    reg_prev = p;
+    reg_valid = true;
+
     ncplane_erase(reg_plane);
     draw_box(reg_plane, "Registers");
 
-    uint8_t flags = get_flags();
+    uint8_t flags = cur.f;
 
     /* Main registers */
     int y = 1;
 
     ncplane_set_fg_rgb(reg_plane, COL_LABEL);
     ncplane_putstr_yx(reg_plane, y, 2, "PC");
-    ncplane_set_fg_rgb(reg_plane, (cpu.pc != prev_pc) ? COL_CHANGED : COL_PC);
-    ncplane_printf_yx(reg_plane, y, 5, "%04X", cpu.pc);
+    ncplane_set_fg_rgb(reg_plane, (cur.pc != prev.pc) ? COL_CHANGED : COL_PC);
+    ncplane_printf_yx(reg_plane, y, 5, "%04X", cur.pc);
 
     ncplane_set_fg_rgb(reg_plane, COL_LABEL);
     ncplane_putstr_yx(reg_plane, y, 11, "SP");
-    ncplane_set_fg_rgb(reg_plane, (cpu.sp != prev_sp) ? COL_CHANGED : COL_VALUE);
-    ncplane_printf_yx(reg_plane, y++, 14, "%04X", cpu.sp);
+    ncplane_set_fg_rgb(reg_plane, (cur.sp != prev.sp) ? COL_CHANGED : COL_VALUE);
+    ncplane_printf_yx(reg_plane, y++, 14, "%04X", cur.sp);
 
     ncplane_set_fg_rgb(reg_plane, COL_LABEL);
     ncplane_putstr_yx(reg_plane, y, 2, "AF");
-    ncplane_set_fg_rgb(reg_plane, (cpu.a != prev_a || flags != prev_flags) ? COL_CHANGED : COL_VALUE);
-    ncplane_printf_yx(reg_plane, y, 5, "%02X%02X", cpu.a, flags);
+    ncplane_set_fg_rgb(reg_plane, (cur.a != prev.a || flags != prev.f) ? COL_CHANGED : COL_VALUE);
+    ncplane_printf_yx(reg_plane, y, 5, "%02X%02X", cur.a, flags);
 
     ncplane_set_fg_rgb(reg_plane, COL_LABEL);
     ncplane_putstr_yx(reg_plane, y, 11, "BC");
-    ncplane_set_fg_rgb(reg_plane, (cpu.b != prev_b || cpu.c != prev_c) ? COL_CHANGED : COL_VALUE);
-    ncplane_printf_yx(reg_plane, y++, 14, "%02X%02X", cpu.b, cpu.c);
+    ncplane_set_fg_rgb(reg_plane, (cur.b != prev.b || cur.c != prev.c) ? COL_CHANGED : COL_VALUE);
+    ncplane_printf_yx(reg_plane, y++, 14, "%02X%02X", cur.b, cur.c);
 
     ncplane_set_fg_rgb(reg_plane, COL_LABEL);
     ncplane_putstr_yx(reg_plane, y, 2, "DE");
-    ncplane_set_fg_rgb(reg_plane, (cpu.d != prev_d || cpu.e != prev_e) ? COL_CHANGED : COL_VALUE);
-    ncplane_printf_yx(reg_plane, y, 5, "%02X%02X", cpu.d, cpu.e);
+    ncplane_set_fg_rgb(reg_plane, (cur.d != prev.d || cur.e != prev.e) ? COL_CHANGED : COL_VALUE);
+    ncplane_printf_yx(reg_plane, y, 5, "%02X%02X", cur.d, cur.e);
 
     ncplane_set_fg_rgb(reg_plane, COL_LABEL);
     ncplane_putstr_yx(reg_plane, y, 11, "HL");
-    ncplane_set_fg_rgb(reg_plane, (cpu.h != prev_h || cpu.l != prev_l) ? COL_CHANGED : COL_VALUE);
-    ncplane_printf_yx(reg_plane, y++, 14, "%02X%02X", cpu.h, cpu.l);
+    ncplane_set_fg_rgb(reg_plane, (cur.h != prev.h || cur.l != prev.l) ? COL_CHANGED : COL_VALUE);
+    ncplane_printf_yx(reg_plane, y++, 14, "%02X%02X", cur.h, cur.l);
 
     ncplane_set_fg_rgb(reg_plane, COL_LABEL);
     ncplane_putstr_yx(reg_plane, y, 2, "IX");
-    ncplane_set_fg_rgb(reg_plane, (cpu.ix != prev_ix) ? COL_CHANGED : COL_VALUE);
-    ncplane_printf_yx(reg_plane, y, 5, "%04X", cpu.ix);
+    ncplane_set_fg_rgb(reg_plane, (cur.ix != prev.ix) ? COL_CHANGED : COL_VALUE);
+    ncplane_printf_yx(reg_plane, y, 5, "%04X", cur.ix);
 
     ncplane_set_fg_rgb(reg_plane, COL_LABEL);
     ncplane_putstr_yx(reg_plane, y, 11, "IY");
-    ncplane_set_fg_rgb(reg_plane, (cpu.iy != prev_iy) ? COL_CHANGED : COL_VALUE);
-    ncplane_printf_yx(reg_plane, y++, 14, "%04X", cpu.iy);
+    ncplane_set_fg_rgb(reg_plane, (cur.iy != prev.iy) ? COL_CHANGED : COL_VALUE);
+    ncplane_printf_yx(reg_plane, y++, 14, "%04X", cur.iy);
 
     /* Flags */
     ncplane_set_fg_rgb(reg_plane, COL_LABEL);
     ncplane_putstr_yx(reg_plane, y, 2, "Flags:");
     ncplane_set_fg_rgb(reg_plane, COL_VALUE);
     ncplane_printf_yx(reg_plane, y, 9, "%c%c%c%c%c%c%c%c",
-        cpu.sf ? 'S' : '-', cpu.zf ? 'Z' : '-',
-        cpu.yf ? 'Y' : '-', cpu.hf ? 'H' : '-',
-        cpu.xf ? 'X' : '-', cpu.pf ? 'P' : '-',
-        cpu.nf ? 'N' : '-', cpu.cf ? 'C' : '-');
+        (flags & 0x80) ? 'S' : '-', (flags & 0x40) ? 'Z' : '-',
+        (flags & 0x20) ? 'Y' : '-', (flags & 0x10) ? 'H' : '-',
+        (flags & 0x08) ? 'X' : '-', (flags & 0x04) ? 'P' : '-',
+        (flags & 0x02) ? 'N' : '-', (flags & 0x01) ? 'C' : '-');
 }
 
 /* Draw disassembly panel */
 static void draw_disassembly(void) {
-    ncplane_erase(dis_plane);
-    draw_box(dis_plane, "Disassembly");
-
     unsigned rows, cols;
     ncplane_dim_yx(dis_plane, &rows, &cols);
 
-    uint16_t addr = cpu.pc;
+    /* At most 4 bytes per line from PC */
+    uint32_t gen = cpuview_range_gen(&view, cur.pc, (rows - 2) * 4);
+    if (dis_valid && cur.pc == dis_pc && gen == dis_gen) {
+        return;
+    }
+    dis_pc = cur.pc;
+    dis_gen = gen;
+    dis_valid = true;
+
+    ncplane_erase(dis_plane);
+    draw_box(dis_plane, "Disassembly");
+
+    uint16_t addr = cur.pc;
     char buf[64];
 
     for (unsigned y = 1; y < rows - 1 && addr < MEM_SIZE; y++) {
         int len = z80_disasm(memory, addr, buf, sizeof(buf));
 
         /* Highlight current PC */
-        bool is_pc = (addr == cpu.pc);
+        bool is_pc = (addr == cur.pc);
 
         /* Address */
         ncplane_set_fg_rgb(dis_plane, is_pc ? COL_PC : COL_ADDR);
@@ -416,12 +682,23 @@ static void draw_disassembly(void) {
 
 /* Draw memory panel */
 static void draw_memory(void) {
-    ncplane_erase(mem_plane);
-    draw_box(mem_plane, "Memory");
-
     unsigned rows, cols;
     ncplane_dim_yx(mem_plane, &rows, &cols);
 
+    uint32_t gen = cpuview_range_gen(&view, mem_view_addr, (rows - 2) * 16);
+    if (mem_valid && gen == mem_gen && mem_view_addr == mem_addr &&
+        cur.pc == mem_pc && cur.sp == mem_sp) {
+        return;
+    }
+    mem_gen = gen;
+    mem_addr = mem_view_addr;
+    mem_pc = cur.pc;
+    mem_sp = cur.sp;
+    mem_valid = true;
+
+    ncplane_erase(mem_plane);
+    draw_box(mem_plane, "Memory");
+
     uint16_t addr = mem_view_addr;
 
     for (unsigned y = 1; y < rows - 1; y++) {
@@ -433,9 +710,9 @@ static void draw_memory(void) {
         ncplane_set_fg_rgb(mem_plane, COL_HEX);
         for (int i = 0; i < 16 && (addr + i) < 0x10000; i++) {
             uint16_t a = (addr + i) & 0xFFFF;
-            if (a == cpu.pc) {
+            if (a == cur.pc) {
                 ncplane_set_fg_rgb(mem_plane, COL_PC);
-            } else if (a == cpu.sp) {
+            } else if (a == cur.sp) {
                 ncplane_set_fg_rgb(mem_plane, COL_CHANGED);
             } else {
                 ncplane_set_fg_rgb(mem_plane, COL_HEX);
@@ -458,6 +735,42 @@ static void draw_memory(void) {
     }
 }
 
+/* Draw hotspots panel (in the Memory panel's place) */
+static void draw_hotspots(void) {
+    mem_valid = false;
+    ncplane_erase(mem_plane);
+    draw_box(mem_plane, "Hotspots");
+
+    unsigned rows, cols;
+    ncplane_dim_yx(mem_plane, &rows, &cols);
+
+    if (hot_count == 0) {
+        ncplane_set_fg_rgb(mem_plane, COL_LABEL);
+        ncplane_putstr_yx(mem_plane, 1, 2, paused ? "Run (F5) to sample" : "Sampling...");
+        return;
+    }
+
+    char dis[64], sym[32];
+    for (unsigned y = 1; y < rows - 1 && (int)(y - 1) < hot_count; y++) {
+        uint16_t pc = hot_pc[y - 1];
+        double share = 100.0 * hot_pc_weight[y - 1] / hot_total;
+
+        ncplane_set_fg_rgb(mem_plane, pc == cur.pc ? COL_PC : COL_ADDR);
+        ncplane_printf_yx(mem_plane, y, 2, "%04X", pc);
+
+        ncplane_set_fg_rgb(mem_plane, share >= 10.0 ? COL_CHANGED : COL_VALUE);
+        ncplane_printf_yx(mem_plane, y, 8, "%5.1f%%", share);
+
+        symbolize(pc, sym, sizeof(sym));
+        ncplane_set_fg_rgb(mem_plane, COL_TITLE);
+        ncplane_printf_yx(mem_plane, y, 16, "%-20.20s", sym);
+
+        z80_disasm(memory, pc, dis, sizeof(dis));
+        ncplane_set_fg_rgb(mem_plane, COL_MNEMONIC);
+        ncplane_printf_yx(mem_plane, y, 38, "%-.*s", cols > 40 ? (int)cols - 40 : 0, dis);
+    }
+}
+
 /* Draw terminal panel */
 static void draw_terminal(void) {
     ncplane_erase(term_plane);
@@ -488,6 +801,7 @@ static void draw_help(void) {
         {"F8", "Reset"},
         {"PgUp/Dn", "Mem"},
         {"Home", "MemPC"},
+        {"F9", show_hot ? "Mem" : "Hot"},
         {"F12", "Quit"},
         {NULL, NULL}
     };
@@ -513,7 +827,7 @@ static void update_metrics(void) {
                      (now.tv_nsec - last_metrics_time.tv_nsec) / 1e9;
 
     if (elapsed >= 0.5) { /* Update every 500ms */
-        unsigned long cycle_diff = total_cycles - last_cycles;
+        unsigned long cycle_diff = cur.cyc - last_cycles;
         cycles_per_sec = cycle_diff / elapsed;
 
         /* Get CPU usage via rusage */
@@ -533,8 +847,21 @@ static void update_metrics(void) {
             last_stime = usage.ru_stime;
         }
 
+        latency_summarize(&lat_summary);
+
+        if (phase_enabled) {
+            uint64_t ticks[PH_COUNT], total = 0;
+            phase_sample(ticks);
+            for (int p = 0; p < PH_COUNT; p++) total += ticks[p] - phase_last[p];
+            for (int p = 0; p < PH_COUNT; p++) {
+                phase_share[p] = total ? 100.0 * (ticks[p] - phase_last[p]) / total : 0.0;
+                phase_last[p] = ticks[p];
+            }
+        }
+        if (!paused) hot_update();
+
         last_metrics_time = now;
-        last_cycles = total_cycles;
+        last_cycles = cur.cyc;
     }
 }
 
@@ -587,14 +914,14 @@ static void draw_metrics(void) {
     ncplane_set_fg_rgb(metrics_plane, COL_LABEL);
     ncplane_putstr_yx(metrics_plane, y, 2, "Cycles:");
     ncplane_set_fg_rgb(metrics_plane, COL_VALUE);
-    if (total_cycles >= 1e9) {
-        ncplane_printf_yx(metrics_plane, y++, 10, "%.2fG", total_cycles / 1e9);
-    } else if (total_cycles >= 1e6) {
-        ncplane_printf_yx(metrics_plane, y++, 10, "%.2fM", total_cycles / 1e6);
-    } else if (total_cycles >= 1e3) {
-        ncplane_printf_yx(metrics_plane, y++, 10, "%.1fK", total_cycles / 1e3);
+    if (cur.cyc >= 1e9) {
+        ncplane_printf_yx(metrics_plane, y++, 10, "%.2fG", cur.cyc / 1e9);
+    } else if (cur.cyc >= 1e6) {
+        ncplane_printf_yx(metrics_plane, y++, 10, "%.2fM", cur.cyc / 1e6);
+    } else if (cur.cyc >= 1e3) {
+        ncplane_printf_yx(metrics_plane, y++, 10, "%.1fK", cur.cyc / 1e3);
     } else {
-        ncplane_printf_yx(metrics_plane, y++, 10, "%lu", total_cycles);
+        ncplane_printf_yx(metrics_plane, y++, 10, "%lu", cur.cyc);
     }
 
     ncplane_set_fg_rgb(metrics_plane, COL_LABEL);
@@ -605,7 +932,7 @@ static void draw_metrics(void) {
     ncplane_set_fg_rgb(metrics_plane, COL_LABEL);
     ncplane_putstr_yx(metrics_plane, y, 2, "Stack:");
     ncplane_set_fg_rgb(metrics_plane, COL_VALUE);
-    int stack_depth = (0x3800 - cpu.sp) / 2; /* Assuming stack at top of RAM */
+    int stack_depth = (0x3800 - cur.sp) / 2; /* Assuming stack at top of RAM */
     if (stack_depth < 0) stack_depth = 0;
     ncplane_printf_yx(metrics_plane, y++, 9, "%d words", stack_depth);
 
@@ -623,8 +950,7 @@ static void draw_metrics(void) {
     ncplane_set_fg_rgb(metrics_plane, COL_LABEL);
     ncplane_putstr_yx(metrics_plane, y, 2, "InBuf:");
     ncplane_set_fg_rgb(metrics_plane, COL_VALUE);
-    int pending = (input_head - input_tail + INPUT_BUF_SIZE) % INPUT_BUF_SIZE;
-    ncplane_printf_yx(metrics_plane, y++, 9, "%d chars", pending);
+    ncplane_printf_yx(metrics_plane, y++, 9, "%zu chars", rxq_pending(&input_queue));
 
     ncplane_set_fg_rgb(metrics_plane, COL_LABEL);
     ncplane_putstr_yx(metrics_plane, y, 2, "Term:");
@@ -634,7 +960,18 @@ static void draw_metrics(void) {
     ncplane_set_fg_rgb(metrics_plane, COL_LABEL);
     ncplane_putstr_yx(metrics_plane, y, 2, "INT:");
     ncplane_set_fg_rgb(metrics_plane, COL_VALUE);
-    ncplane_printf_yx(metrics_plane, y++, 7, "IM%d %s", cpu.interrupt_mode, cpu.iff1 ? "EI" : "DI");
+    ncplane_printf_yx(metrics_plane, y++, 7, "IM%d %s", cur.im, cur.iff1 ? "EI" : "DI");
+
+    /* Key -> frame latency, p50/p99 */
+    ncplane_set_fg_rgb(metrics_plane, COL_LABEL);
+    ncplane_putstr_yx(metrics_plane, y, 2, "Echo:");
+    ncplane_set_fg_rgb(metrics_plane, COL_VALUE);
+    if (lat_summary.count > 0) {
+        ncplane_printf_yx(metrics_plane, y++, 8, "%.1f/%.1fms",
+                          lat_summary.p50_ms[LAT_TOTAL], lat_summary.p99_ms[LAT_TOTAL]);
+    } else {
+        ncplane_putstr_yx(metrics_plane, y++, 8, "-");
+    }
 
     y++;
 
@@ -665,7 +1002,7 @@ static void draw_status(void) {
     /* Status indicator */
     const char *status;
     uint32_t color;
-    if (cpu.halted) {
+    if (cur.halted) {
         status = "HALTED";
         color = COL_STATUS_HALT;
     } else if (paused) {
@@ -683,13 +1020,53 @@ static void draw_status(void) {
     ncplane_set_fg_rgb(status_plane, COL_LABEL);
     ncplane_printf_yx(status_plane, 0, 15, "Cycles: ");
     ncplane_set_fg_rgb(status_plane, COL_VALUE);
-    ncplane_printf_yx(status_plane, 0, 23, "%lu", total_cycles);
+    ncplane_printf_yx(status_plane, 0, 23, "%lu", cur.cyc);
 
     /* Memory view address */
     ncplane_set_fg_rgb(status_plane, COL_LABEL);
     ncplane_printf_yx(status_plane, 0, 40, "Mem: ");
     ncplane_set_fg_rgb(status_plane, COL_VALUE);
     ncplane_printf_yx(status_plane, 0, 45, "$%04X", mem_view_addr);
+
+    /* Latency stage breakdown (p50): key->read / read->TX / TX->frame */
+    if (lat_summary.count > 0) {
+        ncplane_set_fg_rgb(status_plane, COL_LABEL);
+        ncplane_printf_yx(status_plane, 0, 53, "rd/tx/fr: ");
+        ncplane_set_fg_rgb(status_plane, COL_VALUE);
+        ncplane_printf_yx(status_plane, 0, 63, "%.1f/%.1f/%.1fms",
+                          lat_summary.p50_ms[LAT_KEY_TO_READ],
+                          lat_summary.p50_ms[LAT_READ_TO_TX],
+                          lat_summary.p50_ms[LAT_TX_TO_FRAME]);
+    }
+
+    unsigned rows, cols;
+    ncplane_dim_yx(status_plane, &rows, &cols);
+    int right = (int)cols - 1;
+    int left = lat_summary.count > 0 ? 82 : 53;
+
+    /* Paste overflow warning, right-aligned; it wins over the phase shares */
+    if (paste_dropped > 0) {
+        char buf[48];
+        int len = snprintf(buf, sizeof(buf), "paste: %zu bytes dropped", paste_dropped);
+        int x = right - len;
+        if (x < left) x = left < right ? left : 0;
+        ncplane_set_fg_rgb(status_plane, COL_STATUS_HALT);
+        ncplane_putstr_yx(status_plane, 0, x, buf);
+        right = x - 2;
+    }
+
+    /* Host time by phase (--phases), right-aligned if there is room */
+    if (phase_enabled) {
+        char buf[80];
+        int len = snprintf(buf, sizeof(buf), "core %.0f%% dev %.0f%% io %.0f%% draw %.0f%% idle %.0f%%",
+                           phase_share[PH_CORE], phase_share[PH_DEVICE], phase_share[PH_HOSTIO],
+                           phase_share[PH_RENDER], phase_share[PH_IDLE]);
+        int x = right - len;
+        if (x >= left) {
+            ncplane_set_fg_rgb(status_plane, COL_LABEL);
+            ncplane_putstr_yx(status_plane, 0, x, buf);
+        }
+    }
 }
 
 /* Create planes for the TUI */
@@ -781,30 +1158,37 @@ static int create_planes(void) {
 
 /* Render all panels */
 static void render_all(void) {
+    phase_id ph = phase_enter(PH_RENDER);
+    cpuview_read(&view, &cur);
     draw_registers();
     draw_disassembly();
     draw_metrics();
-    draw_memory();
+    if (show_hot) draw_hotspots();
+    else draw_memory();
     draw_terminal();
     draw_help();
     draw_status();
     notcurses_render(nc);
+    phase_leave(ph);
+    latency_frame();
 }
 
-/* Save previous register values */
+/* Next input event; a wait with a timeout counts as idle, a poll as host I/O */
+static uint32_t get_input(const struct timespec *wait, ncinput *ni) {
+    phase_id ph = phase_enter(wait->tv_sec || wait->tv_nsec ? PH_IDLE : PH_HOSTIO);
+    uint32_t id = notcurses_get(nc, wait, ni);
+    phase_leave(ph);
+    return id;
+}
+
+/* Keep the state before a slice, for change highlighting */
 static void save_prev_regs(void) {
-    prev_pc = cpu.pc;
-    prev_sp = cpu.sp;
-    prev_ix = cpu.ix;
-    prev_iy = cpu.iy;
-    prev_a = cpu.a;
-    prev_b = cpu.b;
-    prev_c = cpu.c;
-    prev_d = cpu.d;
-    prev_e = cpu.e;
-    prev_h = cpu.h;
-    prev_l = cpu.l;
-    prev_flags = get_flags();
+    cpuview_read(&view, &prev);
+}
+
+/* End of a slice: publish the CPU state for the panels */
+static void publish_state(void) {
+    cpuview_publish(&view, &cpu);
 }
 
 /* Configure RAM based on ROM type (for metrics display) */
@@ -829,19 +1213,108 @@ static void configure_ram_for_rom(const char *rom_file) {
     }
 }
 
+/* Character for the emulated terminal, or -1 for a debugger key */
+static int key_char(uint32_t id) {
+    if (id >= 32 && id < 127) return (int)id;
+    if (id == NCKEY_ENTER || id == '\r' || id == '\n') return '\r';
+    if (id == NCKEY_BACKSPACE || id == 127) return '\b';
+    return -1;
+}
+
+/* Debugger keys; returns true if the screen needs redrawing */
+static bool handle_key(uint32_t id) {
+    switch (id) {
+        case NCKEY_F12:
+            running = false;
+            break;
+
+        case NCKEY_F05:  /* Run */
+            paused = false;
+            hot_last_cyc = cpu.cyc;
+            break;
+
+        case NCKEY_F06:  /* Step */
+            if (!cpu.halted) {
+                save_prev_regs();
+                z80_step(&cpu);
+                publish_state();
+            }
+            break;
+
+        case NCKEY_F07:  /* Pause */
+            paused = true;
+            break;
+
+        case NCKEY_F08:  /* Reset */
+            z80_init(&cpu);
+            cpu.read_byte = mem_read;
+            cpu.write_byte = mem_write;
+            cpu.port_in = port_in;
+            cpu.port_out = port_out;
+            hot_reset();
+            paste_pos = paste_len = 0;
+            paste_dropped = 0;
+            term_clear();
+            paused = true;
+            publish_state();
+            save_prev_regs();
+            break;
+
+        case NCKEY_PGUP:
+            if (mem_view_addr >= 0x80) {
+                mem_view_addr -= 0x80;
+            } else {
+                mem_view_addr = 0;
+            }
+            break;
+
+        case NCKEY_PGDOWN:
+            if (mem_view_addr + 0x80 < MEM_SIZE) {
+                mem_view_addr += 0x80;
+            }
+            break;
+
+        case NCKEY_HOME:  /* Memory view to PC */
+            mem_view_addr = cur.pc & 0xFFF0;
+            break;
+
+        case NCKEY_END:  /* Memory view to $2000 (input buffer) */
+            mem_view_addr = 0x2000;
+            break;
+
+        case NCKEY_F09:  /* Toggle Memory / Hotspots */
+            show_hot = !show_hot;
+            break;
+
+        default:
+            return false;
+    }
+
+    return true;
+}
+
 /* Main function */
 int main(int argc, char *argv[]) {
     const char *rom_file = NULL;
 
     /* Parse arguments */
     for (int i = 1; i < argc; i++) {
-        if (argv[i][0] != '-') {
+        if (strcmp(argv[i], "--phases") == 0) {
+            phase_enabled = true;
+        }
+        else if (strcmp(argv[i], "--sym") == 0 && i + 1 < argc) {
+            if (load_symbols(argv[++i]) < 0) {
+                fprintf(stderr, "Failed to load symbols: %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (argv[i][0] != '-') {
             rom_file = argv[i];
         }
     }
 
     if (!rom_file) {
-        fprintf(stderr, "Usage: %s <rom.bin>\n", argv[0]);
+        fprintf(stderr, "Usage: %s [--sym file] [--phases] <rom.bin>\n", argv[0]);
         return 1;
     }
 
@@ -887,9 +1360,13 @@ int main(int argc, char *argv[]) {
 
     stdp = notcurses_stdplane(nc);
 
-    /* Clear the emulated system's input buffer */
-    input_head = 0;
-    input_tail = 0;
+    /* Create the emulated system's input queue */
+    if (rxq_init(&input_queue, RXQ_DEFAULT_SIZE) < 0) {
+        notcurses_stop(nc);
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    latency_enabled = true;
 
     if (create_planes() < 0) {
         notcurses_stop(nc);
@@ -898,115 +1375,70 @@ int main(int argc, char *argv[]) {
     }
 
     running = true;
+    cpuview_init(&view);
+    publish_state();
     save_prev_regs();
+    if (phase_enabled) phase_start();
     clock_gettime(CLOCK_MONOTONIC, &last_metrics_time);
     render_all();
 
     /* Main loop */
     struct timespec ts = {0, 10000000}; /* 10ms timeout for input */
+    struct timespec no_wait = {0, 0};
+    static uint8_t typed[KEY_BATCH];
 
     while (running) {
+        /* Take every event already waiting, not one per frame. Wait for
+         * the first only when there is no paste to feed. */
         ncinput ni;
-        uint32_t id = notcurses_get(nc, &ts, &ni);
-
-        if (id == (uint32_t)-1) {
-            break; /* Error */
-        }
-
-        if (id == NCKEY_RESIZE) {
-            /* Handle terminal resize */
-            notcurses_refresh(nc, NULL, NULL);
-            /* Recreate planes - for now just re-render */
-            render_all();
-            continue;
-        }
-
-        if (id != 0) {
+        uint32_t id = get_input(!paused && paste_pending() ? &no_wait : &ts, &ni);
+        bool need_render = false;
+        size_t ntyped = 0;
+
+        for (; id != 0; id = get_input(&no_wait, &ni)) {
+            if (id == (uint32_t)-1) {
+                running = false; /* Error */
+                break;
+            }
             /* Only handle key press events, not releases */
             if (ni.evtype == NCTYPE_RELEASE) {
                 continue;
             }
-
-            bool need_render = true;
-
-            switch (id) {
-                case NCKEY_F12:
-                    running = false;
-                    break;
-
-                case NCKEY_F05:  /* Run */
-                    paused = false;
-                    break;
-
-                case NCKEY_F06:  /* Step */
-                    if (!cpu.halted) {
-                        save_prev_regs();
-                        z80_step(&cpu);
-                        total_cycles = cpu.cyc;
-                    }
-                    break;
-
-                case NCKEY_F07:  /* Pause */
-                    paused = true;
-                    break;
-
-                case NCKEY_F08:  /* Reset */
-                    z80_init(&cpu);
-                    cpu.read_byte = mem_read;
-                    cpu.write_byte = mem_write;
-                    cpu.port_in = port_in;
-                    cpu.port_out = port_out;
-                    total_cycles = 0;
-                    term_clear();
-                    paused = true;
-                    save_prev_regs();
-                    break;
-
-                case NCKEY_PGUP:
-                    if (mem_view_addr >= 0x80) {
-                        mem_view_addr -= 0x80;
-                    } else {
-                        mem_view_addr = 0;
-                    }
-                    break;
-
-                case NCKEY_PGDOWN:
-                    if (mem_view_addr + 0x80 < MEM_SIZE) {
-                        mem_view_addr += 0x80;
-                    }
-                    break;
-
-                case NCKEY_HOME:  /* Memory view to PC */
-                    mem_view_addr = cpu.pc & 0xFFF0;
-                    break;
-
-                case NCKEY_END:  /* Memory view to $2000 (input buffer) */
-                    mem_view_addr = 0x2000;
-                    break;
-
-                default:
-                    /* Send printable characters to the emulated system */
-                    if (id >= 32 && id < 127) {
-                        input_putchar((char)id);
-                    } else if (id == NCKEY_ENTER || id == '\r' || id == '\n') {
-                        input_putchar('\r');
-                    } else if (id == NCKEY_BACKSPACE || id == 127) {
-                        input_putchar('\b');
-                    }
-                    need_render = false;
-                    break;
+            int c = key_char(id);
+            if (c >= 0) {
+                typed[ntyped++] = (uint8_t)c;
+                if (ntyped == KEY_BATCH) {
+                    take_typed(typed, ntyped);
+                    ntyped = 0;
+                }
+                continue;
             }
-
-            if (need_render) {
-                render_all();
+            /* Keep typed text ahead of a debugger key that follows it */
+            take_typed(typed, ntyped);
+            ntyped = 0;
+            if (id == NCKEY_RESIZE) {
+                notcurses_refresh(nc, NULL, NULL);
+                need_render = true;
+            } else {
+                need_render |= handle_key(id);
             }
         }
+        take_typed(typed, ntyped);
+
+        if (!running) {
+            break;
+        }
+        if (need_render && (paused || cpu.halted)) {
+            render_all();
+        }
 
         /* Run CPU if not paused */
         if (!paused && !cpu.halted) {
             save_prev_regs();
             for (int i = 0; i < cycles_per_frame && !cpu.halted; i++) {
                 z80_step(&cpu);
+                hot_tick();
+                paste_tick();
                 /* Trigger interrupt if input available (for 8251 USART ROMs only) */
                 /* Check after step so iff_delay has been processed */
                 if (uses_8251 && input_available() && cpu.iff1 && !int_signaled && cpu.iff_delay == 0) {
@@ -1014,13 +1446,19 @@ int main(int argc, char *argv[]) {
                     int_signaled = true;
                 }
             }
-            total_cycles = cpu.cyc;
+            publish_state();
             render_all();
         }
     }
 
     /* Cleanup */
     notcurses_stop(nc);
+    if (phase_enabled) {
+        phase_report(stderr);
+    }
+    rxq_free(&input_queue);
+    free(symbols);
+    free(paste_buf);
 
     /* Drain any remaining terminal responses */
     usleep(100000); /* 100ms for terminal to finish responding */
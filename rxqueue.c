@@ -0,0 +1,102 @@
+/*
+ * Host-to-Guest Input Queue
+ * The producer never touches a segment again after linking its successor,
+ * so the consumer may free a segment once it is empty and has a next.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "rxqueue.h"
+
+static rxq_seg *seg_alloc(size_t size) {
+    rxq_seg *s = malloc(sizeof(rxq_seg) + size);
+    if (!s) return NULL;
+    memset(s, 0, sizeof(rxq_seg));
+    s->mask = size - 1;
+    return s;
+}
+
+static size_t round_pow2(size_t n) {
+    size_t size = 16;
+    while (size < n && size < RXQ_MAX_SEGMENT) size *= 2;
+    return size;
+}
+
+int rxq_init(rxqueue *q, size_t size) {
+    memset(q, 0, sizeof(*q));
+    q->rd = q->wr = seg_alloc(round_pow2(size ? size : RXQ_DEFAULT_SIZE));
+    return q->rd ? 0 : -1;
+}
+
+void rxq_free(rxqueue *q) {
+    rxq_seg *s = q->rd;
+    while (s) {
+        rxq_seg *next = s->next;
+        free(s);
+        s = next;
+    }
+    q->rd = q->wr = NULL;
+}
+
+size_t rxq_push(rxqueue *q, const uint8_t *data, size_t len) {
+    size_t done = 0;
+
+    while (done < len) {
+        rxq_seg *s = q->wr;
+        size_t size = s->mask + 1;
+        size_t space = size - (s->tail - s->head_cache);
+        if (space < len - done) {
+            s->head_cache = __atomic_load_n(&s->head, __ATOMIC_ACQUIRE);
+            space = size - (s->tail - s->head_cache);
+        }
+
+        if (space == 0) {
+            /* Full: chain a bigger ring rather than drop input */
+            rxq_seg *n = seg_alloc(round_pow2(size * 2 > len - done ? size * 2 : len - done));
+            if (!n) break;
+            __atomic_store_n(&s->next, n, __ATOMIC_RELEASE);
+            q->wr = n;
+            continue;
+        }
+
+        size_t take = len - done < space ? len - done : space;
+        size_t off = s->tail & s->mask;
+        size_t first = size - off < take ? size - off : take;
+        memcpy(s->data + off, data + done, first);
+        memcpy(s->data, data + done + first, take - first);
+        __atomic_store_n(&s->tail, s->tail + take, __ATOMIC_RELEASE);
+        done += take;
+    }
+
+    __atomic_store_n(&q->pushed, q->pushed + done, __ATOMIC_RELAXED);
+    return done;
+}
+
+bool rxq_refresh(rxqueue *q) {
+    for (;;) {
+        rxq_seg *s = q->rd;
+        s->tail_cache = __atomic_load_n(&s->tail, __ATOMIC_ACQUIRE);
+        if (s->head != s->tail_cache) return true;
+
+        rxq_seg *n = __atomic_load_n(&s->next, __ATOMIC_ACQUIRE);
+        if (!n) return false;
+
+        /* The producer's last writes to s happened before it linked n */
+        s->tail_cache = __atomic_load_n(&s->tail, __ATOMIC_ACQUIRE);
+        if (s->head != s->tail_cache) return true;
+        q->rd = n;
+        free(s);
+    }
+}
+
+void rxq_drain(rxqueue *q) {
+    while (rxq_ready(q)) {
+        rxq_seg *s = q->rd;
+        size_t n = s->tail_cache - s->head;
+        __atomic_store_n(&s->head, s->tail_cache, __ATOMIC_RELEASE);
+        __atomic_store_n(&q->popped, q->popped + n, __ATOMIC_RELAXED);
+    }
+}
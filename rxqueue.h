@@ -0,0 +1,98 @@
+/*
+ * Host-to-Guest Input Queue - Header
+ * Single-producer / single-consumer byte queue between a host input source
+ * (keyboard, UI thread, socket, replay script) and the thread running the
+ * CPU. No locks: each side owns one index and publishes it with
+ * release/acquire atomics.
+ *
+ * Storage is a power-of-two ring. When the producer finds it full it chains
+ * a larger segment instead of dropping bytes; the consumer finishes the old
+ * ring, frees it and continues in the new one. Steady-state traffic stays
+ * in one ring with no allocation.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef RXQUEUE_H
+#define RXQUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define RXQ_CACHE_LINE 64
+#define RXQ_DEFAULT_SIZE 256
+#define RXQ_MAX_SEGMENT 0x100000  /* Larger pastes chain 1MB segments */
+
+typedef struct rxq_seg {
+    /* Consumer side */
+    size_t head;                  /* Next byte to read (free-running) */
+    size_t tail_cache;            /* Last tail the consumer saw */
+    char pad0[RXQ_CACHE_LINE - 2 * sizeof(size_t)];
+
+    /* Producer side */
+    size_t tail;                  /* Next byte to write (free-running) */
+    size_t head_cache;            /* Last head the producer saw */
+    struct rxq_seg *next;         /* Set once, when this ring filled up */
+    char pad1[RXQ_CACHE_LINE - 2 * sizeof(size_t) - sizeof(void *)];
+
+    size_t mask;
+    uint8_t data[];
+} rxq_seg;
+
+typedef struct rxqueue {
+    rxq_seg *rd;                  /* Consumer's segment */
+    size_t popped;
+    char pad0[RXQ_CACHE_LINE - sizeof(void *) - sizeof(size_t)];
+
+    rxq_seg *wr;                  /* Producer's segment */
+    size_t pushed;
+    char pad1[RXQ_CACHE_LINE - sizeof(void *) - sizeof(size_t)];
+} rxqueue;
+
+/* Set up an empty queue; size is rounded up to a power of two.
+ * Returns 0 or -1 if the first segment cannot be allocated. */
+int rxq_init(rxqueue *q, size_t size);
+
+/* Release all segments; neither side may be using the queue */
+void rxq_free(rxqueue *q);
+
+/* Producer: append bytes. Returns the count queued, which is short of len
+ * only if a new segment could not be allocated. */
+size_t rxq_push(rxqueue *q, const uint8_t *data, size_t len);
+
+static inline bool rxq_putc(rxqueue *q, uint8_t c) {
+    return rxq_push(q, &c, 1) == 1;
+}
+
+/* Consumer slow path: re-read the producer's tail, step to a chained segment */
+bool rxq_refresh(rxqueue *q);
+
+/* Consumer: is a byte waiting? */
+static inline bool rxq_ready(rxqueue *q) {
+    rxq_seg *s = q->rd;
+    return s->head != s->tail_cache || rxq_refresh(q);
+}
+
+/* Consumer: take the next byte, or -1 if the queue is empty */
+static inline int rxq_getc(rxqueue *q) {
+    if (!rxq_ready(q)) return -1;
+    rxq_seg *s = q->rd;
+    uint8_t c = s->data[s->head & s->mask];
+    __atomic_store_n(&s->head, s->head + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&q->popped, q->popped + 1, __ATOMIC_RELAXED);
+    return c;
+}
+
+/* Consumer: discard everything queued so far */
+void rxq_drain(rxqueue *q);
+
+/* Bytes queued and not yet read; safe from either side (approximate while
+ * the other side is running) */
+static inline size_t rxq_pending(const rxqueue *q) {
+    size_t popped = __atomic_load_n(&q->popped, __ATOMIC_RELAXED);
+    return __atomic_load_n(&q->pushed, __ATOMIC_RELAXED) - popped;
+}
+
+#endif /* RXQUEUE_H */
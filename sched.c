@@ -0,0 +1,340 @@
+/*
+ * Cycle-Quota Scheduler
+ * Each thread pops machines from its own run queue and steals from the
+ * head of another thread's queue when its own is empty; a stolen machine
+ * stays with the thief. State changes between slices (requeue, park,
+ * sleep, retire) are made under one scheduler lock, taken once per slice,
+ * so a wake from another thread cannot slip in between "nothing to read"
+ * and parking. Parked and sleeping machines sit off the queues; whichever
+ * thread next finishes a slice or goes idle after their wake time puts
+ * them back.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "sched.h"
+
+#define PARK_RETRY      0.1     /* Seconds before a parked machine is tried anyway */
+#define IDLE_POLL_RATIO 16      /* Waiting for input: an empty serial poll per <= 16 instructions */
+
+typedef enum { T_QUEUED, T_PARKED, T_SLEEPING, T_DONE } task_state;
+
+struct sched_task {
+    sched *s;
+    machine *m;
+    sched_ops ops;
+    void *ctx;
+    unsigned long cycle_limit;
+    double max_hz;
+
+    int home;                   /* Run queue it goes back to */
+    task_state state;           /* Guarded by s->lock */
+    double wake_at;             /* PARKED, SLEEPING */
+    bool wake_pending;          /* Atomic; set by sched_wake() */
+    bool input_closed;          /* Atomic */
+
+    double started;             /* Wall time and cycle count at first slice */
+    unsigned long start_cyc;
+    sched_stats st;
+    sched_task *next;
+};
+
+typedef struct {
+    pthread_mutex_t lock;
+    sched_task *head, *tail;
+} runq;
+
+typedef struct {
+    sched *s;
+    int id;
+} worker_arg;
+
+struct sched {
+    int nthreads;
+    unsigned long quota;
+    runq *q;
+    pthread_t *threads;
+    worker_arg *args;
+    int running;                /* Threads started */
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;        /* Idle threads */
+    sched_task **tasks;
+    size_t count, cap;
+    size_t live;                /* Not yet retired */
+    size_t queued;              /* Atomic; tasks on any run queue */
+    double next_due;            /* Earliest wake_at off the queues */
+};
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double thread_cpu_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static sched_task *rq_pop(sched *s, runq *q) {
+    pthread_mutex_lock(&q->lock);
+    sched_task *t = q->head;
+    if (t) {
+        q->head = t->next;
+        if (!q->head) q->tail = NULL;
+        __atomic_sub_fetch(&s->queued, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return t;
+}
+
+/* Caller holds s->lock */
+static void enqueue(sched *s, sched_task *t) {
+    runq *q = &s->q[t->home];
+    t->state = T_QUEUED;
+    t->next = NULL;
+    pthread_mutex_lock(&q->lock);
+    if (q->tail) q->tail->next = t;
+    else q->head = t;
+    q->tail = t;
+    __atomic_add_fetch(&s->queued, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&q->lock);
+    pthread_cond_signal(&s->cond);
+}
+
+/* Caller holds s->lock: requeue parked/sleeping tasks whose time has come */
+static void promote_due(sched *s, double now) {
+    s->next_due = INFINITY;
+    for (size_t i = 0; i < s->count; i++) {
+        sched_task *t = s->tasks[i];
+        if (t->state != T_PARKED && t->state != T_SLEEPING) continue;
+        if (t->wake_at <= now) enqueue(s, t);
+        else if (t->wake_at < s->next_due) s->next_due = t->wake_at;
+    }
+}
+
+/* Spinning on an empty serial port without sending anything */
+static bool waiting_for_input(const machine *m, uint64_t instr, uint64_t idle, uint64_t tx) {
+    uint64_t ran = m->instructions - instr;
+    return ran > 0 && m->tx_bytes == tx && machine_rx_pending(m) == 0 &&
+           (m->rx_idle_polls - idle) * IDLE_POLL_RATIO >= ran;
+}
+
+static void run_slice(sched *s, sched_task *t, int self) {
+    machine *m = t->m;
+    double cpu0 = thread_cpu_sec();
+
+    __atomic_store_n(&t->wake_pending, false, __ATOMIC_RELAXED);
+    bool closed = __atomic_load_n(&t->input_closed, __ATOMIC_RELAXED);
+    bool go = t->ops.service(t->ctx);
+
+    uint64_t instr = m->instructions, idle = m->rx_idle_polls, tx = m->tx_bytes;
+    if (go) {
+        if (t->st.slices == 0) {
+            t->started = now_sec();
+            t->start_cyc = m->cpu.cyc;
+        }
+        unsigned long until = m->cpu.cyc + s->quota;
+        if (t->cycle_limit && until > t->cycle_limit) until = t->cycle_limit;
+        machine_run(m, until);
+    }
+    if (t->ops.flush) t->ops.flush(t->ctx);
+
+    t->st.cpu_sec += thread_cpu_sec() - cpu0;
+    t->st.slices++;
+    if (t->home != self) {
+        t->st.steals++;
+        t->home = self;
+    }
+
+    double now = now_sec();
+    task_state next = T_QUEUED;
+    double wake_at = 0;
+    if (!go || (t->cycle_limit && m->cpu.cyc >= t->cycle_limit)) {
+        next = T_DONE;
+    } else if (m->cpu.halted) {
+        if (machine_rx_pending(m) > 0 && machine_can_wake(m)) next = T_QUEUED;
+        else next = machine_can_wake(m) && !closed ? T_PARKED : T_DONE;
+    } else if ((!closed || !t->cycle_limit) && waiting_for_input(m, instr, idle, tx)) {
+        /* With input closed only a cycle limit can end the wait; run to it */
+        next = T_PARKED;
+    } else if (t->max_hz > 0) {
+        double due = t->started + (m->cpu.cyc - t->start_cyc) / t->max_hz;
+        if (due > now) {
+            next = T_SLEEPING;
+            wake_at = due;
+        }
+    }
+
+    if (next == T_DONE) t->ops.done(t->ctx);
+
+    pthread_mutex_lock(&s->lock);
+    if (next == T_PARKED && __atomic_load_n(&t->wake_pending, __ATOMIC_RELAXED)) next = T_QUEUED;
+    switch (next) {
+    case T_QUEUED:
+        enqueue(s, t);
+        break;
+    case T_PARKED:
+        wake_at = now + PARK_RETRY;
+        t->st.parks++;
+        /* fall through */
+    case T_SLEEPING:
+        t->state = next;
+        t->wake_at = wake_at;
+        if (wake_at < s->next_due) s->next_due = wake_at;
+        break;
+    case T_DONE:
+        t->state = T_DONE;
+        if (--s->live == 0) pthread_cond_broadcast(&s->cond);
+        break;
+    }
+    if (now >= s->next_due) promote_due(s, now);
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void *worker(void *arg) {
+    sched *s = ((worker_arg *)arg)->s;
+    int self = ((worker_arg *)arg)->id;
+
+    for (;;) {
+        sched_task *t = rq_pop(s, &s->q[self]);
+        for (int k = 1; !t && k < s->nthreads; k++) {
+            t = rq_pop(s, &s->q[(self + k) % s->nthreads]);
+        }
+        if (t) {
+            run_slice(s, t, self);
+            continue;
+        }
+
+        pthread_mutex_lock(&s->lock);
+        double now = now_sec();
+        if (now >= s->next_due) promote_due(s, now);
+        if (__atomic_load_n(&s->queued, __ATOMIC_RELAXED) == 0) {
+            if (s->live == 0) {
+                pthread_mutex_unlock(&s->lock);
+                break;
+            }
+            double wait = s->next_due - now;
+            if (wait > 1.0) wait = 1.0;
+            struct timespec abs;
+            clock_gettime(CLOCK_REALTIME, &abs);
+            long ns = abs.tv_nsec + (long)(wait * 1e9);
+            abs.tv_sec += ns / 1000000000L;
+            abs.tv_nsec = ns % 1000000000L;
+            pthread_cond_timedwait(&s->cond, &s->lock, &abs);
+        }
+        pthread_mutex_unlock(&s->lock);
+    }
+    return NULL;
+}
+
+sched *sched_create(int threads, unsigned long quota) {
+    if (threads <= 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = n > 0 ? (int)n : 1;
+    }
+    sched *s = calloc(1, sizeof(sched));
+    if (!s) return NULL;
+    s->nthreads = threads;
+    s->quota = quota ? quota : SCHED_QUOTA;
+    s->next_due = INFINITY;
+    s->q = calloc(threads, sizeof(runq));
+    s->threads = calloc(threads, sizeof(pthread_t));
+    s->args = calloc(threads, sizeof(worker_arg));
+    if (!s->q || !s->threads || !s->args) {
+        sched_destroy(s);
+        return NULL;
+    }
+    for (int i = 0; i < threads; i++) pthread_mutex_init(&s->q[i].lock, NULL);
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    return s;
+}
+
+sched_task *sched_add(sched *s, machine *m, const sched_ops *ops, void *ctx,
+                      unsigned long cycle_limit, double max_mhz) {
+    if (s->count == s->cap) {
+        size_t cap = s->cap ? s->cap * 2 : 16;
+        sched_task **v = realloc(s->tasks, cap * sizeof(sched_task *));
+        if (!v) return NULL;
+        s->tasks = v;
+        s->cap = cap;
+    }
+    sched_task *t = calloc(1, sizeof(sched_task));
+    if (!t) return NULL;
+    t->s = s;
+    t->m = m;
+    t->ops = *ops;
+    t->ctx = ctx;
+    t->cycle_limit = cycle_limit;
+    t->max_hz = max_mhz * 1e6;
+    t->home = (int)(s->count % s->nthreads);
+    s->tasks[s->count++] = t;
+    return t;
+}
+
+int sched_start(sched *s) {
+    pthread_mutex_lock(&s->lock);
+    s->live = s->count;
+    for (size_t i = 0; i < s->count; i++) enqueue(s, s->tasks[i]);
+    pthread_mutex_unlock(&s->lock);
+
+    for (int i = 0; i < s->nthreads; i++) {
+        s->args[i].s = s;
+        s->args[i].id = i;
+        if (pthread_create(&s->threads[i], NULL, worker, &s->args[i]) != 0) {
+            perror("sched");
+            break;
+        }
+        s->running++;
+    }
+    return s->running > 0 ? 0 : -1;
+}
+
+void sched_wake(sched_task *t) {
+    sched *s = t->s;
+    pthread_mutex_lock(&s->lock);
+    __atomic_store_n(&t->wake_pending, true, __ATOMIC_RELAXED);
+    if (t->state == T_PARKED) enqueue(s, t);
+    pthread_mutex_unlock(&s->lock);
+}
+
+void sched_input_closed(sched_task *t) {
+    __atomic_store_n(&t->input_closed, true, __ATOMIC_RELAXED);
+    sched_wake(t);
+}
+
+void sched_join(sched *s) {
+    for (int i = 0; i < s->running; i++) pthread_join(s->threads[i], NULL);
+    s->running = 0;
+}
+
+void sched_task_stats(const sched_task *t, sched_stats *st) {
+    *st = t->st;
+}
+
+int sched_threads(const sched *s) {
+    return s->nthreads;
+}
+
+void sched_destroy(sched *s) {
+    if (!s) return;
+    for (size_t i = 0; i < s->count; i++) free(s->tasks[i]);
+    free(s->tasks);
+    free(s->q);
+    free(s->threads);
+    free(s->args);
+    free(s);
+}
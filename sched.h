@@ -0,0 +1,71 @@
+/*
+ * Cycle-Quota Scheduler - Header
+ * Runs many machines on a few host threads. Each thread has its own run
+ * queue and takes machines from the others' queues when its own is empty.
+ * A machine runs for at most one quota of cycles before going to the back
+ * of the queue, so a guest stuck in a loop gets the same share as the
+ * rest. A machine that is busy-waiting on an empty serial port, or halted
+ * waiting for an 8251 interrupt, is parked off the queues until
+ * sched_wake(). A machine with a MHz cap sleeps once it gets ahead of its
+ * cap.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdbool.h>
+#include "machine.h"
+
+#define SCHED_QUOTA 100000   /* Default cycles per slice */
+
+typedef struct sched sched;
+typedef struct sched_task sched_task;
+
+/* Host I/O for one machine, called on the scheduler thread running it.
+ * service() runs before every slice (pull input) and returns false to
+ * retire the machine; flush() (may be NULL) runs after every slice;
+ * done() runs once when the machine retires. */
+typedef struct {
+    bool (*service)(void *ctx);
+    void (*flush)(void *ctx);
+    void (*done)(void *ctx);
+} sched_ops;
+
+typedef struct {
+    double cpu_sec;          /* Host CPU time spent in slices */
+    unsigned long slices;
+    unsigned long parks;
+    unsigned long steals;    /* Slices run by a thread other than its home */
+} sched_stats;
+
+/* threads <= 0 = one per online CPU; quota 0 = SCHED_QUOTA */
+sched *sched_create(int threads, unsigned long quota);
+
+/* Add a machine before sched_start(). It retires when it halts for good or
+ * reaches cycle_limit (0 = none). max_mhz 0 = uncapped. */
+sched_task *sched_add(sched *s, machine *m, const sched_ops *ops, void *ctx,
+                      unsigned long cycle_limit, double max_mhz);
+
+int sched_start(sched *s);
+
+/* Something changed for the task (input queued, told to stop): run it
+ * again if it is parked. Safe from any thread. */
+void sched_wake(sched_task *t);
+
+/* No more input will come; a machine with a cycle limit that waits for
+ * input now runs to the limit instead of parking */
+void sched_input_closed(sched_task *t);
+
+/* Wait until every task has retired and stop the threads */
+void sched_join(sched *s);
+
+void sched_task_stats(const sched_task *t, sched_stats *st);
+
+int sched_threads(const sched *s);
+
+void sched_destroy(sched *s);
+
+#endif /* SCHED_H */
@@ -0,0 +1,168 @@
+/*
+ * Machine Snapshots
+ * Registers are stored field by field so the file layout does not depend
+ * on the z80 struct's bitfields or callback pointers.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "snapshot.h"
+
+#define MEM_SIZE 0x10000
+
+/* On-disk register file */
+typedef struct {
+    uint64_t cyc;
+    uint16_t pc, sp, ix, iy, mem_ptr;
+    uint8_t a, b, c, d, e, h, l, f;
+    uint8_t a_, b_, c_, d_, e_, h_, l_, f_;
+    uint8_t i, r;
+    uint8_t iff_delay, interrupt_mode, int_data;
+    uint8_t iff1, iff2, halted, int_pending, nmi_pending;
+} snapshot_regs;
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    snapshot_regs regs;
+    uint64_t instructions;
+    uint64_t input_consumed;
+    uint8_t  acia_control;
+    uint8_t  uses_8251;
+    uint8_t  int_pending;
+    uint8_t  sd_status;
+    uint16_t sd_seek_pos;
+    uint16_t sd_filename_pos;
+    char     sd_filename[SNAPSHOT_PATH];
+    snapshot_run run;
+} snapshot_header;
+
+static uint8_t pack_flags(const z80 *cpu) {
+    return (cpu->sf << 7) | (cpu->zf << 6) | (cpu->yf << 5) | (cpu->hf << 4) |
+           (cpu->xf << 3) | (cpu->pf << 2) | (cpu->nf << 1) | cpu->cf;
+}
+
+static void unpack_flags(z80 *cpu, uint8_t f) {
+    cpu->sf = (f >> 7) & 1;
+    cpu->zf = (f >> 6) & 1;
+    cpu->yf = (f >> 5) & 1;
+    cpu->hf = (f >> 4) & 1;
+    cpu->xf = (f >> 3) & 1;
+    cpu->pf = (f >> 2) & 1;
+    cpu->nf = (f >> 1) & 1;
+    cpu->cf = f & 1;
+}
+
+int snapshot_save(const char *path, const z80 *cpu, const uint8_t *mem,
+                  const snapshot_extra *extra) {
+    snapshot_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    h.version = SNAPSHOT_VERSION;
+
+    snapshot_regs *r = &h.regs;
+    r->cyc = cpu->cyc;
+    r->pc = cpu->pc; r->sp = cpu->sp; r->ix = cpu->ix; r->iy = cpu->iy;
+    r->mem_ptr = cpu->mem_ptr;
+    r->a = cpu->a; r->b = cpu->b; r->c = cpu->c; r->d = cpu->d;
+    r->e = cpu->e; r->h = cpu->h; r->l = cpu->l; r->f = pack_flags(cpu);
+    r->a_ = cpu->a_; r->b_ = cpu->b_; r->c_ = cpu->c_; r->d_ = cpu->d_;
+    r->e_ = cpu->e_; r->h_ = cpu->h_; r->l_ = cpu->l_; r->f_ = cpu->f_;
+    r->i = cpu->i; r->r = cpu->r;
+    r->iff_delay = cpu->iff_delay;
+    r->interrupt_mode = cpu->interrupt_mode;
+    r->int_data = cpu->int_data;
+    r->iff1 = cpu->iff1; r->iff2 = cpu->iff2; r->halted = cpu->halted;
+    r->int_pending = cpu->int_pending; r->nmi_pending = cpu->nmi_pending;
+
+    h.instructions = extra->instructions;
+    h.input_consumed = extra->input_consumed;
+    h.acia_control = extra->acia_control;
+    h.uses_8251 = extra->uses_8251;
+    h.int_pending = extra->int_pending;
+    h.sd_status = extra->sd_status;
+    h.sd_seek_pos = extra->sd_seek_pos;
+    h.sd_filename_pos = extra->sd_filename_pos;
+    memcpy(h.sd_filename, extra->sd_filename, SNAPSHOT_PATH);
+    h.run = extra->run;
+    h.run.rom[SNAPSHOT_PATH - 1] = '\0';
+    h.run.input[SNAPSHOT_PATH - 1] = '\0';
+    h.run.storage[SNAPSHOT_PATH - 1] = '\0';
+
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        perror("Failed to write snapshot");
+        return -1;
+    }
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+              fwrite(mem, 1, MEM_SIZE, f) == MEM_SIZE;
+    if (fclose(f) != 0) ok = false;
+    return ok ? 0 : -1;
+}
+
+/* Open a snapshot and read its header; mem may be NULL */
+static int read_snapshot(const char *path, snapshot_header *h, uint8_t *mem) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror("Failed to open snapshot");
+        return -1;
+    }
+    if (fread(h, sizeof(*h), 1, f) != 1 ||
+        memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+        h->version != SNAPSHOT_VERSION ||
+        (mem && fread(mem, 1, MEM_SIZE, f) != MEM_SIZE)) {
+        fprintf(stderr, "%s: not a valid snapshot\n", path);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    h->sd_filename[SNAPSHOT_PATH - 1] = '\0';
+    h->run.rom[SNAPSHOT_PATH - 1] = '\0';
+    h->run.input[SNAPSHOT_PATH - 1] = '\0';
+    h->run.storage[SNAPSHOT_PATH - 1] = '\0';
+    return 0;
+}
+
+int snapshot_read_run(const char *path, snapshot_run *run) {
+    snapshot_header h;
+    if (read_snapshot(path, &h, NULL) < 0) return -1;
+    *run = h.run;
+    return 0;
+}
+
+int snapshot_load(const char *path, z80 *cpu, uint8_t *mem,
+                  snapshot_extra *extra) {
+    snapshot_header h;
+    if (read_snapshot(path, &h, mem) < 0) return -1;
+
+    const snapshot_regs *r = &h.regs;
+    cpu->cyc = r->cyc;
+    cpu->pc = r->pc; cpu->sp = r->sp; cpu->ix = r->ix; cpu->iy = r->iy;
+    cpu->mem_ptr = r->mem_ptr;
+    cpu->a = r->a; cpu->b = r->b; cpu->c = r->c; cpu->d = r->d;
+    cpu->e = r->e; cpu->h = r->h; cpu->l = r->l; unpack_flags(cpu, r->f);
+    cpu->a_ = r->a_; cpu->b_ = r->b_; cpu->c_ = r->c_; cpu->d_ = r->d_;
+    cpu->e_ = r->e_; cpu->h_ = r->h_; cpu->l_ = r->l_; cpu->f_ = r->f_;
+    cpu->i = r->i; cpu->r = r->r;
+    cpu->iff_delay = r->iff_delay;
+    cpu->interrupt_mode = r->interrupt_mode;
+    cpu->int_data = r->int_data;
+    cpu->iff1 = r->iff1; cpu->iff2 = r->iff2; cpu->halted = r->halted;
+    cpu->int_pending = r->int_pending; cpu->nmi_pending = r->nmi_pending;
+
+    extra->instructions = h.instructions;
+    extra->input_consumed = h.input_consumed;
+    extra->acia_control = h.acia_control;
+    extra->uses_8251 = h.uses_8251;
+    extra->int_pending = h.int_pending;
+    extra->sd_status = h.sd_status;
+    extra->sd_seek_pos = h.sd_seek_pos;
+    extra->sd_filename_pos = h.sd_filename_pos;
+    memcpy(extra->sd_filename, h.sd_filename, SNAPSHOT_PATH);
+    extra->run = h.run;
+    return 0;
+}
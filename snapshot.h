@@ -0,0 +1,59 @@
+/*
+ * Machine Snapshots - Header
+ * Save and restore CPU registers, memory and front-end device state
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "z80.h"
+
+#define SNAPSHOT_MAGIC   "Z80SNP1"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_PATH    256
+
+/* Options the run was started with, so a tool can repeat it from here */
+typedef struct {
+    char     rom[SNAPSHOT_PATH];
+    char     input[SNAPSHOT_PATH];    /* Host input file; "" if not a file */
+    char     storage[SNAPSHOT_PATH];  /* SD card directory */
+    uint64_t max_cycles;              /* -c; 0 = none */
+    uint32_t rx_pace;                 /* --rx-pace */
+    uint8_t  eof_policy;              /* --eof, as hostin_eof_policy */
+    uint8_t  clock_port;              /* --clock-port base; 0 = not mapped */
+    uint8_t  pad[2];
+} snapshot_run;
+
+/* Front-end state saved alongside the CPU. An open SD file or directory
+ * listing is host state the snapshot cannot carry; the front end does not
+ * snapshot while one is open. */
+typedef struct {
+    uint64_t instructions;     /* Instructions executed so far */
+    uint64_t input_consumed;   /* Host input bytes delivered to the guest */
+    uint8_t  acia_control;
+    bool     uses_8251;
+    bool     int_pending;      /* Front-end interrupt latch */
+    uint8_t  sd_status;
+    uint16_t sd_seek_pos;
+    uint16_t sd_filename_pos;
+    char     sd_filename[SNAPSHOT_PATH];
+    snapshot_run run;
+} snapshot_extra;
+
+/* Write a snapshot; returns 0 on success */
+int snapshot_save(const char *path, const z80 *cpu, const uint8_t *mem,
+                  const snapshot_extra *extra);
+
+/* Load a snapshot; callbacks and userdata in 'cpu' are left untouched */
+int snapshot_load(const char *path, z80 *cpu, uint8_t *mem,
+                  snapshot_extra *extra);
+
+/* Read only the run options; returns 0 on success */
+int snapshot_read_run(const char *path, snapshot_run *run);
+
+#endif /* SNAPSHOT_H */
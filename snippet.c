@@ -0,0 +1,106 @@
+/*
+ * Snippet Execution
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <string.h>
+#include "snippet.h"
+
+static uint8_t snip_read(void *userdata, uint16_t addr) {
+    snippet *s = userdata;
+    if (addr < s->len) return s->code[addr];
+    s->touched = true;
+    return 0;
+}
+
+static void snip_write(void *userdata, uint16_t addr, uint8_t val) {
+    snippet *s = userdata;
+    (void)addr;
+    (void)val;
+    s->touched = true;
+}
+
+static uint8_t snip_in(z80 *z, uint8_t port) {
+    snippet *s = z->userdata;
+    (void)port;
+    s->touched = true;
+    return 0xFF;
+}
+
+static void snip_out(z80 *z, uint8_t port, uint8_t val) {
+    snippet *s = z->userdata;
+    (void)port;
+    (void)val;
+    s->touched = true;
+}
+
+void snippet_init(snippet *s) {
+    memset(s, 0, sizeof(*s));
+    z80_init(&s->cpu);
+    s->cpu.read_byte = snip_read;
+    s->cpu.write_byte = snip_write;
+    s->cpu.port_in = snip_in;
+    s->cpu.port_out = snip_out;
+    s->cpu.userdata = s;
+}
+
+int snippet_load(snippet *s, const uint8_t *code, size_t len) {
+    if (len > SNIPPET_MAX) return -1;
+    memcpy(s->code, code, len);
+    s->len = len;
+    return 0;
+}
+
+/* Same bit layout as get_f()/set_f() in z80.c */
+static inline void put_f(z80 *z, uint8_t v) {
+    z->cf = v & 1;
+    z->nf = (v >> 1) & 1;
+    z->pf = (v >> 2) & 1;
+    z->xf = (v >> 3) & 1;
+    z->hf = (v >> 4) & 1;
+    z->yf = (v >> 5) & 1;
+    z->zf = (v >> 6) & 1;
+    z->sf = (v >> 7) & 1;
+}
+
+static inline uint8_t take_f(const z80 *z) {
+    return (uint8_t)(z->cf | z->nf << 1 | z->pf << 2 | z->xf << 3 |
+                     z->hf << 4 | z->yf << 5 | z->zf << 6 | z->sf << 7);
+}
+
+int snippet_run(snippet *s, snippet_regs *r) {
+    z80 *z = &s->cpu;
+
+    z->a = r->r[SR_A];
+    put_f(z, r->r[SR_F]);
+    z->b = r->r[SR_B];
+    z->c = r->r[SR_C];
+    z->d = r->r[SR_D];
+    z->e = r->r[SR_E];
+    z->h = r->r[SR_H];
+    z->l = r->r[SR_L];
+    /* State outside the register file starts the same every run */
+    z->a_ = z->b_ = z->c_ = z->d_ = z->e_ = z->h_ = z->l_ = z->f_ = 0;
+    z->ix = z->iy = z->sp = 0;
+    z->pc = 0;
+    z->cyc = 0;
+    z->halted = 0;
+    z->iff_delay = 0;
+    s->touched = false;
+
+    /* Every instruction is at least one byte, so len steps always suffice */
+    for (size_t n = 0; z->pc < s->len && n < s->len && !s->touched; n++) z80_step(z);
+
+    r->r[SR_A] = z->a;
+    r->r[SR_F] = take_f(z);
+    r->r[SR_B] = z->b;
+    r->r[SR_C] = z->c;
+    r->r[SR_D] = z->d;
+    r->r[SR_E] = z->e;
+    r->r[SR_H] = z->h;
+    r->r[SR_L] = z->l;
+    if (s->touched || z->pc != s->len || z->halted) return -1;
+    return (int)z->cyc;
+}
@@ -0,0 +1,49 @@
+/*
+ * Snippet Execution - Header
+ * Runs a few bytes of straight-line Z80 code on the z80.c core from a
+ * given register state, with no machine around it: the code sits at
+ * address 0, any other memory access or I/O port use marks the run as
+ * touching the outside world, and the cost is whatever t-states the core
+ * charged. Setup per run is copying eight registers in and out, so a
+ * search can afford millions of runs per second.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SNIPPET_H
+#define SNIPPET_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "z80.h"
+
+#define SNIPPET_MAX 64       /* Code bytes */
+
+/* Register file in the order used for masks and hashing */
+enum { SR_A, SR_F, SR_B, SR_C, SR_D, SR_E, SR_H, SR_L, SR_COUNT };
+
+typedef union {
+    uint8_t r[SR_COUNT];
+    uint64_t all;
+} snippet_regs;
+
+typedef struct {
+    z80 cpu;
+    uint8_t code[SNIPPET_MAX];
+    size_t len;
+    bool touched;            /* Memory outside the code or an I/O port */
+} snippet;
+
+void snippet_init(snippet *s);
+
+/* Install code for the following runs; returns -1 if too long */
+int snippet_load(snippet *s, const uint8_t *code, size_t len);
+
+/* Run the loaded code from r, leaving the result in r. Returns t-states,
+ * or -1 if it touched memory or ports, or did not fall through to the
+ * end of the code. */
+int snippet_run(snippet *s, snippet_regs *r);
+
+#endif /* SNIPPET_H */
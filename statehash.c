@@ -0,0 +1,107 @@
+/*
+ * Rolling State-Hash Checkpoints
+ * Each 256-byte page keeps a cached FNV-1a hash that is only recomputed
+ * when the page was written since the last checkpoint; the memory hash is
+ * the XOR of the mixed page hashes, so a checkpoint costs one pass over
+ * the dirtied pages plus the register file.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "statehash.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+
+bool statehash_enabled = false;
+uint64_t statehash_next = 0;
+uint8_t statehash_dirty_pages[256];
+
+static FILE *hash_file = NULL;
+static uint64_t hash_every = 0;
+static uint64_t page_hash[256];
+static uint64_t mem_hash = 0;
+
+static uint64_t fnv1a(const uint8_t *p, size_t n, uint64_t h) {
+    for (size_t i = 0; i < n; i++) {
+        h ^= p[i];
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+/* splitmix64 finaliser: spreads a page hash before it is XORed in */
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+int statehash_open(const char *path, uint64_t every, uint64_t first) {
+    if (every == 0) every = 1;
+
+    hash_file = fopen(path, "wb");
+    if (!hash_file) {
+        perror("Failed to open hash stream");
+        return -1;
+    }
+
+    statehash_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, STATEHASH_MAGIC, sizeof(STATEHASH_MAGIC));
+    h.version = STATEHASH_VERSION;
+    h.every = every;
+    fwrite(&h, sizeof(h), 1, hash_file);
+
+    /* Only pages the caller marks dirty are hashed, so ROM is left out */
+    memset(statehash_dirty_pages, 0, sizeof(statehash_dirty_pages));
+    memset(page_hash, 0, sizeof(page_hash));
+    mem_hash = 0;
+
+    hash_every = every;
+    statehash_next = (first / every + 1) * every;
+    statehash_enabled = true;
+    return 0;
+}
+
+void statehash_checkpoint(const z80 *cpu, const uint8_t *mem, uint64_t instructions) {
+    for (int p = 0; p < 256; p++) {
+        if (!statehash_dirty_pages[p]) continue;
+        statehash_dirty_pages[p] = 0;
+
+        uint64_t h = mix(fnv1a(mem + p * 256, 256, FNV_OFFSET) + (uint64_t)p);
+        mem_hash ^= page_hash[p] ^ h;
+        page_hash[p] = h;
+    }
+
+    uint8_t regs[26] = {
+        cpu->pc >> 8, cpu->pc & 0xFF, cpu->sp >> 8, cpu->sp & 0xFF,
+        cpu->ix >> 8, cpu->ix & 0xFF, cpu->iy >> 8, cpu->iy & 0xFF,
+        cpu->a, cpu->b, cpu->c, cpu->d, cpu->e, cpu->h, cpu->l,
+        (cpu->sf << 7) | (cpu->zf << 6) | (cpu->yf << 5) | (cpu->hf << 4) |
+        (cpu->xf << 3) | (cpu->pf << 2) | (cpu->nf << 1) | cpu->cf,
+        cpu->a_, cpu->b_, cpu->c_, cpu->d_, cpu->e_, cpu->h_, cpu->l_, cpu->f_,
+        cpu->i,
+        (cpu->iff1 << 7) | (cpu->iff2 << 6) | (cpu->halted << 5) |
+        (cpu->interrupt_mode & 3)
+    };
+
+    statehash_record rec;
+    rec.instructions = instructions;
+    rec.cyc = cpu->cyc;
+    rec.hash = fnv1a(regs, sizeof(regs), FNV_OFFSET) ^ mem_hash;
+    fwrite(&rec, sizeof(rec), 1, hash_file);
+
+    statehash_next = instructions + hash_every;
+}
+
+void statehash_close(void) {
+    if (!statehash_enabled) return;
+    statehash_enabled = false;
+    fclose(hash_file);
+    hash_file = NULL;
+}
@@ -0,0 +1,52 @@
+/*
+ * Rolling State-Hash Checkpoints - Header
+ * Compact hash of registers plus memory, emitted every N instructions
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef STATEHASH_H
+#define STATEHASH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "z80.h"
+
+#define STATEHASH_MAGIC   "Z80HSH1"
+#define STATEHASH_VERSION 1
+
+/* Hash stream header, followed by statehash_record entries */
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t every;            /* Instructions between checkpoints */
+} statehash_header;
+
+typedef struct {
+    uint64_t instructions;     /* Instruction count at the checkpoint */
+    uint64_t cyc;
+    uint64_t hash;
+} statehash_record;
+
+extern bool statehash_enabled;
+extern uint64_t statehash_next;   /* Instruction count of next checkpoint */
+extern uint8_t statehash_dirty_pages[256];
+
+/* Start a hash stream; 'first' is the current instruction count.
+ * Mark the writable pages dirty afterwards so their initial contents are
+ * included; pages never marked (ROM) do not contribute to the hash. */
+int statehash_open(const char *path, uint64_t every, uint64_t first);
+
+/* Mark the page holding 'addr' as dirty (call from the write callback) */
+static inline void statehash_dirty(uint16_t addr) {
+    statehash_dirty_pages[addr >> 8] = 1;
+}
+
+/* Rehash dirtied pages and emit a checkpoint */
+void statehash_checkpoint(const z80 *cpu, const uint8_t *mem, uint64_t instructions);
+
+void statehash_close(void);
+
+#endif /* STATEHASH_H */
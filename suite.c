@@ -0,0 +1,452 @@
+/*
+ * Parallel Smoke-Test Suite
+ * Runs every session of a manifest concurrently on the cycle-quota
+ * scheduler (sched.c), -j threads shared by all machines. Each machine
+ * talks to the host through a pair of pipes; a single I/O worker
+ * multiplexes all of them with epoll (poll elsewhere), feeds the scripted
+ * input, records transcripts and enforces the time budgets.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+#include "machine.h"
+#include "manifest.h"
+#include "sched.h"
+
+#define TX_CHUNK     4096
+#define TICK_MS      20       /* Budget check interval */
+
+typedef enum { ST_RUNNING, ST_PASS, ST_FAIL, ST_TIMEOUT, ST_ERROR } status;
+
+static const char *status_names[] = {"RUN", "PASS", "FAIL", "TIMEOUT", "ERROR"};
+
+typedef struct {
+    const manifest_entry *e;
+    machine *m;
+    sched_task *task;
+    bool started;
+
+    int in_rd, in_wr;       /* Host -> guest */
+    int out_rd, out_wr;     /* Guest -> host */
+
+    /* Scheduler side */
+    uint8_t tx[TX_CHUNK];
+    size_t tx_len;
+    int stop;               /* Set by the I/O worker */
+    unsigned long cycles;   /* Where expect matched, else where the run stopped */
+    bool halted;
+    char *tail;             /* Last expect_len bytes of output */
+    size_t tail_len;
+    bool matched;
+
+    /* I/O worker side */
+    size_t sent;
+    char *transcript;
+    size_t t_len, t_cap;
+    status st;
+    double end;
+} session;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* ---------- Scheduler callbacks ---------- */
+
+static void tx_flush(session *s) {
+    size_t off = 0;
+    while (off < s->tx_len) {
+        ssize_t n = write(s->out_wr, s->tx + off, s->tx_len - off);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;  /* Worker went away */
+        }
+        off += n;
+    }
+    s->tx_len = 0;
+}
+
+/* Note the cycle of the byte that completes the expect text, as
+ * retroshield_farm does, so both tools report the same count */
+static void match_byte(session *s, uint8_t c) {
+    size_t xl = s->e->expect_len;
+    if (s->tail_len == xl) memmove(s->tail, s->tail + 1, --s->tail_len);
+    s->tail[s->tail_len++] = (char)c;
+    if (s->tail_len == xl && memcmp(s->tail, s->e->expect, xl) == 0) {
+        s->matched = true;
+        s->cycles = s->m->cpu.cyc;
+    }
+}
+
+static void tx_byte(void *ctx, uint8_t c) {
+    session *s = ctx;
+    if (s->tail && !s->matched) match_byte(s, c);
+    s->tx[s->tx_len++] = c;
+    if (s->tx_len == TX_CHUNK) tx_flush(s);
+}
+
+static bool session_service(void *ctx) {
+    session *s = ctx;
+    uint8_t buf[TX_CHUNK];
+
+    if (__atomic_load_n(&s->stop, __ATOMIC_RELAXED)) return false;
+
+    ssize_t n = -1;
+    while (s->in_rd >= 0 && (n = read(s->in_rd, buf, sizeof(buf))) != 0) {
+        if (n < 0) break;   /* EAGAIN: nothing new */
+        machine_feed(s->m, buf, n);
+    }
+    if (n == 0 && s->in_rd >= 0) {
+        close(s->in_rd);
+        s->in_rd = -1;
+        sched_input_closed(s->task);
+    }
+    return true;
+}
+
+static void session_flush(void *ctx) {
+    tx_flush(ctx);
+}
+
+static void session_done(void *ctx) {
+    session *s = ctx;
+    if (!s->matched) s->cycles = s->m->cpu.cyc;
+    s->halted = s->m->cpu.halted;
+    close(s->out_wr);   /* EOF tells the worker this session is over */
+}
+
+static const sched_ops session_ops = {session_service, session_flush, session_done};
+
+/* ---------- Host I/O worker ---------- */
+
+/* Event tags: session index * 2, +1 for the input side */
+#define TAG_OUT(i) ((i) * 2)
+#define TAG_IN(i)  ((i) * 2 + 1)
+
+#ifdef __linux__
+static int io_fd = -1;
+
+static int io_init(size_t nsessions) {
+    (void)nsessions;
+    io_fd = epoll_create1(0);
+    return io_fd < 0 ? -1 : 0;
+}
+
+static void io_add(int fd, bool out, int tag) {
+    struct epoll_event ev = {0};
+    ev.events = out ? EPOLLOUT : EPOLLIN;
+    ev.data.u32 = tag;
+    epoll_ctl(io_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static void io_del(int fd, int tag) {
+    (void)tag;
+    epoll_ctl(io_fd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+static int io_wait(int *tags, int max, int timeout_ms) {
+    struct epoll_event ev[64];
+    int n = epoll_wait(io_fd, ev, max < 64 ? max : 64, timeout_ms);
+    for (int i = 0; i < n; i++) tags[i] = ev[i].data.u32;
+    return n;
+}
+#else
+static struct pollfd *io_fds;
+static size_t io_nfds;
+
+static int io_init(size_t nsessions) {
+    io_fds = calloc(nsessions * 2, sizeof(struct pollfd));
+    io_nfds = nsessions * 2;
+    for (size_t i = 0; i < io_nfds; i++) io_fds[i].fd = -1;
+    return io_fds ? 0 : -1;
+}
+
+static void io_add(int fd, bool out, int tag) {
+    io_fds[tag].fd = fd;
+    io_fds[tag].events = out ? POLLOUT : POLLIN;
+}
+
+static void io_del(int fd, int tag) {
+    (void)fd;
+    io_fds[tag].fd = -1;
+}
+
+static int io_wait(int *tags, int max, int timeout_ms) {
+    int n = 0;
+    if (poll(io_fds, io_nfds, timeout_ms) <= 0) return 0;
+    for (size_t i = 0; i < io_nfds && n < max; i++) {
+        if (io_fds[i].fd >= 0 && io_fds[i].revents) tags[n++] = (int)i;
+    }
+    return n;
+}
+#endif
+
+/* Search only the part of the transcript that could contain a new match */
+static bool expect_seen(const session *s, size_t old_len) {
+    const char *x = s->e->expect;
+    size_t xl = s->e->expect_len;
+    size_t from = old_len >= xl ? old_len - xl + 1 : 0;
+    for (size_t i = from; i + xl <= s->t_len; i++) {
+        if (memcmp(s->transcript + i, x, xl) == 0) return true;
+    }
+    return false;
+}
+
+static void finish(session *s, status st, double t) {
+    if (s->st != ST_RUNNING) return;
+    s->st = st;
+    s->end = t;
+    __atomic_store_n(&s->stop, 1, __ATOMIC_RELAXED);
+    if (s->started) sched_wake(s->task);
+}
+
+/* Read guest output; returns false at EOF */
+static bool on_output(session *s, double t) {
+    if (s->t_len + TX_CHUNK > s->t_cap) {
+        size_t cap = s->t_cap ? s->t_cap * 2 : 4 * TX_CHUNK;
+        char *n = realloc(s->transcript, cap);
+        if (!n) {
+            finish(s, ST_ERROR, t);
+            return true;
+        }
+        s->transcript = n;
+        s->t_cap = cap;
+    }
+    ssize_t n = read(s->out_rd, s->transcript + s->t_len, TX_CHUNK);
+    if (n < 0) return true;
+    if (n == 0) {
+        /* Guest halted or ran out of cycles */
+        finish(s, s->e->expect ? ST_FAIL : ST_PASS, t);
+        return false;
+    }
+    size_t old = s->t_len;
+    s->t_len += n;
+    if (s->e->expect && expect_seen(s, old)) finish(s, ST_PASS, t);
+    return true;
+}
+
+/* Write more of the script; returns false once it has all been sent or
+ * the pipe has failed. A full pipe or a signal just means try again. */
+static bool on_input(session *s) {
+    const manifest_entry *e = s->e;
+    ssize_t n = write(s->in_wr, e->input + s->sent, e->input_len - s->sent);
+    if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    if (n > 0) {
+        s->sent += n;
+        sched_wake(s->task);
+    }
+    return s->sent < e->input_len;
+}
+
+static void io_worker(session *ss, size_t count, double start) {
+    size_t open_outputs = 0;
+    int tags[64];
+
+    for (size_t i = 0; i < count; i++) {
+        if (!ss[i].started) continue;
+        open_outputs++;
+        io_add(ss[i].out_rd, false, TAG_OUT(i));
+        if (ss[i].in_wr >= 0) io_add(ss[i].in_wr, true, TAG_IN(i));
+    }
+
+    while (open_outputs > 0) {
+        int n = io_wait(tags, 64, TICK_MS);
+        double t = now_sec();
+
+        for (int k = 0; k < n; k++) {
+            session *s = &ss[tags[k] / 2];
+            if (tags[k] & 1) {
+                if (s->in_wr >= 0 && !on_input(s)) {
+                    io_del(s->in_wr, tags[k]);
+                    close(s->in_wr);
+                    s->in_wr = -1;
+                }
+            } else if (s->out_rd >= 0 && !on_output(s, t)) {
+                io_del(s->out_rd, tags[k]);
+                close(s->out_rd);
+                s->out_rd = -1;
+                open_outputs--;
+            }
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            if (ss[i].st == ST_RUNNING && t - start > ss[i].e->budget) {
+                finish(&ss[i], ST_TIMEOUT, t);
+            }
+        }
+    }
+}
+
+/* ---------- Setup and report ---------- */
+
+static int set_nonblock(int fd) {
+    int fl = fcntl(fd, F_GETFL);
+    return fl < 0 ? -1 : fcntl(fd, F_SETFL, fl | O_NONBLOCK);
+}
+
+static int session_open(session *s, const manifest_entry *e) {
+    int in[2], out[2];
+
+    memset(s, 0, sizeof(*s));
+    s->e = e;
+    s->in_rd = s->in_wr = s->out_rd = s->out_wr = -1;
+    s->st = ST_RUNNING;
+
+    s->m = machine_create(e->rom);
+    if (!s->m) return -1;
+    s->m->tx = tx_byte;
+    s->m->tx_ctx = s;
+    if (e->expect && !(s->tail = malloc(e->expect_len))) return -1;
+
+    if (pipe(out) < 0) {
+        perror("pipe");
+        return -1;
+    }
+    s->out_rd = out[0];
+    s->out_wr = out[1];
+    set_nonblock(s->out_rd);
+
+    if (e->input_len > 0) {
+        if (pipe(in) < 0) {
+            perror("pipe");
+            return -1;
+        }
+        s->in_rd = in[0];
+        s->in_wr = in[1];
+        set_nonblock(s->in_rd);
+        set_nonblock(s->in_wr);
+    }
+    return 0;
+}
+
+static void session_close(session *s) {
+    if (s->in_rd >= 0) close(s->in_rd);
+    if (s->in_wr >= 0) close(s->in_wr);
+    if (s->out_rd >= 0) close(s->out_rd);
+    if (s->out_wr >= 0 && !s->started) close(s->out_wr);
+    machine_destroy(s->m);
+    free(s->transcript);
+    free(s->tail);
+}
+
+static void write_log(const char *dir, const session *s) {
+    char path[MANIFEST_PATH_LEN + MANIFEST_NAME_LEN + 8];
+    snprintf(path, sizeof(path), "%s/%s.log", dir, s->e->name);
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        return;
+    }
+    fwrite(s->transcript, 1, s->t_len, f);
+    fclose(f);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] <manifest>\n", prog);
+    fprintf(stderr, "  -o DIR    Write each session's transcript to DIR/<name>.log\n");
+    fprintf(stderr, "  -j N      Scheduler threads (default: one per CPU)\n");
+    fprintf(stderr, "  -q CYCLES Cycles per slice (default %d)\n", SCHED_QUOTA);
+    fprintf(stderr, "Exit status: 0 = all sessions passed, 1 = otherwise\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *manifest_path = NULL;
+    const char *log_dir = NULL;
+    int threads = 0;
+    unsigned long quota = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) log_dir = argv[++i];
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-q") == 0 && i + 1 < argc) quota = strtoul(argv[++i], NULL, 0);
+        else if (argv[i][0] != '-' && !manifest_path) manifest_path = argv[i];
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!manifest_path) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    manifest mf;
+    if (manifest_load(manifest_path, &mf) < 0) return 1;
+    if (mf.count == 0) {
+        fprintf(stderr, "%s: no sessions\n", manifest_path);
+        return 1;
+    }
+
+    session *ss = calloc(mf.count, sizeof(session));
+    sched *sc = sched_create(threads, quota);
+    if (!ss || !sc || io_init(mf.count) < 0) {
+        perror("suite");
+        return 1;
+    }
+
+    /* A session torn down early must not kill the whole suite */
+    signal(SIGPIPE, SIG_IGN);
+
+    double start = now_sec();
+    for (size_t i = 0; i < mf.count; i++) {
+        session *s = &ss[i];
+        if (session_open(s, &mf.entries[i]) < 0 ||
+            !(s->task = sched_add(sc, s->m, &session_ops, s, s->e->cycles, s->e->mhz))) {
+            s->st = ST_ERROR;
+            s->end = start;
+            continue;
+        }
+        if (s->in_rd < 0) sched_input_closed(s->task);
+        s->started = true;
+    }
+    if (sched_start(sc) < 0) return 1;
+    io_worker(ss, mf.count, start);
+    sched_join(sc);
+
+    int failures = 0;
+    double total_wall = now_sec() - start;
+    printf("%-16s %-8s %10s %14s %8s %10s %10s %6s\n",
+           "session", "result", "wall ms", "cycles", "MHz", "output", "cpu ms", "parks");
+    for (size_t i = 0; i < mf.count; i++) {
+        session *s = &ss[i];
+        sched_stats st = {0};
+        if (s->started) sched_task_stats(s->task, &st);
+        double wall = s->end - start;
+        printf("%-16s %-8s %10.1f %14lu %8.2f %10zu %10.1f %6lu\n",
+               s->e->name, status_names[s->st], wall * 1000.0, s->cycles,
+               wall > 0 ? s->cycles / wall / 1e6 : 0.0, s->t_len,
+               st.cpu_sec * 1000.0, st.parks);
+        if (s->st != ST_PASS) failures++;
+        if (log_dir && s->transcript) write_log(log_dir, s);
+        session_close(s);
+    }
+    printf("\n%zu sessions, %d failed, %.1f ms total, %d threads\n",
+           mf.count, failures, total_wall * 1000.0, sched_threads(sc));
+
+    sched_destroy(sc);
+    free(ss);
+    manifest_free(&mf);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,565 @@
+/*
+ * Z80 Superoptimizer
+ * Given a short straight-line reference sequence and the registers and
+ * flags that are live on entry and on exit, enumerates every sequence of
+ * up to -n register instructions that is cheaper than the reference (fewer
+ * t-states, or as many in fewer bytes) and keeps those that agree with it
+ * on every test state.
+ *
+ * The instruction set is not hand-written: every one-byte and CB opcode,
+ * the register ED opcodes and the immediate forms with a few constants
+ * are run through the core (snippet.c) on a batch of random states.
+ * Opcodes that branch, halt, touch memory or ports, vary in cost or change
+ * nothing are dropped; opcodes that behave identically on the batch are
+ * merged, keeping the cheapest; costs are the t-states the core charged. The same runs give
+ * each instruction's read and write sets, so a candidate never reads a
+ * register that is neither live-in nor written earlier in it.
+ *
+ * Candidates are first run on a few states, each instruction from the
+ * cached result of its prefix; only survivors are run whole on the full
+ * test set. The first instruction's index splits the search across -j
+ * threads.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "snippet.h"
+#include "z80_disasm.h"
+
+#define MAX_INSNS      1024
+#define MAX_LEN        4          /* Instructions per candidate */
+#define PROBE_STATES   64         /* States used to classify an instruction */
+#define QUICK_TESTS    16
+#define DEFAULT_TESTS  4096
+#define DEFAULT_LEN    3
+#define DEFAULT_TOP    10
+#define F_DOCUMENTED   0xD7       /* S Z H P/V N C; not the copies of bits 5 and 3 */
+
+typedef struct {
+    uint8_t bytes[4];
+    uint8_t len;
+    uint8_t cycles;
+    uint8_t reads, writes;        /* Bit per SR_* register */
+    char text[32];
+} insn;
+
+typedef struct {
+    uint16_t seq[MAX_LEN];
+    int n;
+    int cycles, bytes;
+} found;
+
+typedef struct {
+    int id;
+    pthread_t thread;
+    snippet *snips;               /* One per catalogue entry, code preloaded */
+    snippet full;
+    snippet_regs pre[MAX_LEN + 1][QUICK_TESTS];
+    uint16_t seq[MAX_LEN];
+    found *hits;
+    size_t hit_count, hit_cap;
+    uint64_t evals;
+} worker;
+
+static insn cat[MAX_INSNS];
+static int cat_count;
+static snippet_regs *tests, *expect;
+static int test_count = DEFAULT_TESTS;
+static uint64_t out_mask;
+static uint8_t in_regs;
+static int ref_cycles, ref_bytes;
+static int max_len = DEFAULT_LEN;
+static int nthreads;
+static uint64_t rng = 0x9E3779B97F4A7C15ULL;
+
+static const char *reg_names[SR_COUNT] = {"a", "f", "b", "c", "d", "e", "h", "l"};
+static const char *flag_names[8] = {"cf", "nf", "pf", "xf", "hf", "yf", "zf", "sf"};
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t next_rand(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+/* ---------- Test states ---------- */
+
+static void make_tests(void) {
+    static const uint8_t edge[] = {0x00, 0x01, 0x0F, 0x7F, 0x80, 0xFE, 0xFF};
+    size_t ne = sizeof(edge);
+
+    for (int t = 0; t < test_count; t++) {
+        tests[t].all = next_rand();
+        /* Interleave edge cases with random states so the quick tests see
+         * both: all registers equal, then pairs of edges in a and one other */
+        int k = t / 2;
+        if (t % 2 == 0 || k >= (int)(ne * 2 + ne * ne * 6)) continue;
+        if (k < (int)ne * 2) {
+            memset(tests[t].r, edge[k % ne], SR_COUNT);
+            tests[t].r[SR_F] = k < (int)ne ? 0x00 : 0xFF;
+        } else {
+            k -= ne * 2;
+            tests[t].r[SR_A] = edge[k % ne];
+            tests[t].r[SR_B + (k / (ne * ne)) % 6] = edge[(k / ne) % ne];
+        }
+    }
+}
+
+/* ---------- Instruction catalogue ---------- */
+
+static int run_code(snippet *s, const uint8_t *code, size_t len, snippet_regs *r) {
+    if (snippet_load(s, code, len) < 0) return -1;
+    return snippet_run(s, r);
+}
+
+static uint64_t signature(snippet *s, const uint8_t *code, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (int t = 0; t < PROBE_STATES; t++) {
+        snippet_regs r = tests[t];
+        run_code(s, code, len, &r);
+        h = (h ^ r.all) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static void describe(insn *in) {
+    uint8_t buf[16] = {0};
+    memcpy(buf, in->bytes, in->len);
+    z80_disasm(buf, 0, in->text, sizeof(in->text));
+}
+
+/* Classify one encoding; returns false if it is not a register instruction */
+static bool probe(snippet *s, const uint8_t *code, size_t len, insn *in) {
+    int cycles = -1;
+    uint8_t writes = 0, reads = 0;
+
+    for (int t = 0; t < PROBE_STATES; t++) {
+        snippet_regs r = tests[t];
+        int c = run_code(s, code, len, &r);
+        if (c < 0 || (cycles >= 0 && c != cycles)) return false;
+        cycles = c;
+        for (int k = 0; k < SR_COUNT; k++) {
+            if (r.r[k] != tests[t].r[k]) writes |= 1 << k;
+        }
+    }
+    if (writes == 0) return false;
+
+    /* A register is read if changing it changes something written */
+    for (int k = 0; k < SR_COUNT; k++) {
+        for (int t = 0; t < PROBE_STATES / 2 && !(reads & (1 << k)); t++) {
+            snippet_regs a = tests[t], b = tests[t];
+            b.r[k] ^= (uint8_t)(next_rand() | 1);
+            run_code(s, code, len, &a);
+            run_code(s, code, len, &b);
+            for (int w = 0; w < SR_COUNT; w++) {
+                if ((writes & (1 << w)) && a.r[w] != b.r[w]) reads |= 1 << k;
+            }
+        }
+    }
+
+    memcpy(in->bytes, code, len);
+    in->len = (uint8_t)len;
+    in->cycles = (uint8_t)cycles;
+    in->reads = reads;
+    in->writes = writes;
+    describe(in);
+    return true;
+}
+
+static void add_insn(snippet *s, const uint8_t *code, size_t len, uint64_t *sigs) {
+    insn in;
+    if (cat_count == MAX_INSNS || !probe(s, code, len, &in)) return;
+
+    uint64_t sig = signature(s, code, len);
+    for (int i = 0; i < cat_count; i++) {
+        if (sigs[i] != sig) continue;
+        /* Same behaviour: keep the cheaper encoding */
+        if (in.cycles < cat[i].cycles || (in.cycles == cat[i].cycles && in.len < cat[i].len)) {
+            cat[i] = in;
+        }
+        return;
+    }
+    sigs[cat_count] = sig;
+    cat[cat_count++] = in;
+}
+
+/* ex af,af', exx and add hl,sp read registers the search does not model;
+ * their results would only reflect the fixed values snippet_run starts with */
+static bool hidden_state(int op) {
+    return op == 0x08 || op == 0xD9 || op == 0x39;
+}
+
+static void build_catalogue(const uint8_t *ref, size_t ref_len) {
+    static const uint8_t imm_ops[] = {0x06, 0x0E, 0x16, 0x1E, 0x26, 0x2E, 0x3E,
+                                      0xC6, 0xCE, 0xD6, 0xDE, 0xE6, 0xEE, 0xF6, 0xFE};
+    /* ED opcodes that only touch registers: neg, adc/sbc hl,rr. The rest
+     * use memory, ports or I/R, or are undefined (the core reports those). */
+    static const uint8_t ed_ops[] = {0x44, 0x42, 0x4A, 0x52, 0x5A, 0x62, 0x6A};
+    uint8_t consts[8] = {0x00, 0x01, 0xFF};
+    int nconst = 3;
+    uint64_t sigs[MAX_INSNS];
+    snippet s;
+    uint8_t code[4];
+
+    snippet_init(&s);
+
+    /* Constants the reference itself uses are worth trying too */
+    for (size_t i = 0; i + 1 < ref_len; i++) {
+        for (size_t k = 0; k < sizeof(imm_ops); k++) {
+            if (ref[i] != imm_ops[k] || nconst == (int)sizeof(consts)) continue;
+            bool dup = false;
+            for (int c = 0; c < nconst; c++) dup |= consts[c] == ref[i + 1];
+            if (!dup) consts[nconst++] = ref[i + 1];
+        }
+    }
+
+    for (int op = 0; op < 256; op++) {
+        code[0] = (uint8_t)op;
+        if (op != 0xCB && op != 0xDD && op != 0xED && op != 0xFD && !hidden_state(op)) {
+            add_insn(&s, code, 1, sigs);
+        }
+        code[0] = 0xCB;
+        code[1] = (uint8_t)op;
+        add_insn(&s, code, 2, sigs);
+    }
+    for (size_t k = 0; k < sizeof(ed_ops); k++) {
+        code[0] = 0xED;
+        code[1] = ed_ops[k];
+        add_insn(&s, code, 2, sigs);
+    }
+    for (size_t k = 0; k < sizeof(imm_ops); k++) {
+        for (int c = 0; c < nconst; c++) {
+            code[0] = imm_ops[k];
+            code[1] = consts[c];
+            add_insn(&s, code, 2, sigs);
+        }
+    }
+}
+
+/* ---------- Search ---------- */
+
+static bool matches(const snippet_regs *got, const snippet_regs *want) {
+    return ((got->all ^ want->all) & out_mask) == 0;
+}
+
+static void record(worker *w, int n, int cycles, int bytes) {
+    if (w->hit_count == w->hit_cap) {
+        size_t cap = w->hit_cap ? w->hit_cap * 2 : 64;
+        found *h = realloc(w->hits, cap * sizeof(found));
+        if (!h) return;
+        w->hits = h;
+        w->hit_cap = cap;
+    }
+    found *f = &w->hits[w->hit_count++];
+    memcpy(f->seq, w->seq, n * sizeof(uint16_t));
+    f->n = n;
+    f->cycles = cycles;
+    f->bytes = bytes;
+}
+
+/* Run the whole candidate on every test state */
+static bool verify(worker *w, int n) {
+    uint8_t code[MAX_LEN * 4];
+    size_t len = 0;
+    for (int i = 0; i < n; i++) {
+        memcpy(code + len, cat[w->seq[i]].bytes, cat[w->seq[i]].len);
+        len += cat[w->seq[i]].len;
+    }
+    snippet_load(&w->full, code, len);
+    for (int t = QUICK_TESTS; t < test_count; t++) {
+        snippet_regs r = tests[t];
+        snippet_run(&w->full, &r);
+        w->evals++;
+        if (!matches(&r, &expect[t])) return false;
+    }
+    return true;
+}
+
+static void search(worker *w, int depth, int cycles, int bytes, uint8_t avail) {
+    for (int i = depth == 0 ? w->id : 0; i < cat_count; i += depth == 0 ? nthreads : 1) {
+        const insn *in = &cat[i];
+        if (in->reads & ~avail) continue;
+        int c = cycles + in->cycles, b = bytes + in->len;
+        if (c > ref_cycles || (c == ref_cycles && b >= ref_bytes)) continue;
+
+        w->seq[depth] = (uint16_t)i;
+        bool ok = true;
+        for (int t = 0; t < QUICK_TESTS; t++) {
+            w->pre[depth + 1][t] = w->pre[depth][t];
+            snippet_run(&w->snips[i], &w->pre[depth + 1][t]);
+            w->evals++;
+            if (ok && !matches(&w->pre[depth + 1][t], &expect[t])) {
+                ok = false;
+                /* Deeper levels still need this prefix's states */
+                if (depth + 1 == max_len) break;
+            }
+        }
+        if (ok && verify(w, depth + 1)) record(w, depth + 1, c, b);
+        if (depth + 1 < max_len) search(w, depth + 1, c, b, avail | in->writes);
+    }
+}
+
+static void *search_thread(void *arg) {
+    worker *w = arg;
+    snippet_init(&w->full);
+    for (int t = 0; t < QUICK_TESTS; t++) w->pre[0][t] = tests[t];
+    search(w, 0, 0, 0, in_regs);
+    return NULL;
+}
+
+/* ---------- Front end ---------- */
+
+static int parse_regs(const char *spec, bool out, uint8_t *regs, uint64_t *mask) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", spec);
+    for (char *item = strtok(buf, ","); item; item = strtok(NULL, ",")) {
+        bool found = false;
+        for (int k = 0; k < SR_COUNT; k++) {
+            if (strcmp(item, reg_names[k]) != 0) continue;
+            *regs |= 1 << k;
+            *mask |= (uint64_t)(k == SR_F && out ? F_DOCUMENTED : 0xFF) << (8 * k);
+            found = true;
+        }
+        for (int k = 0; k < 8; k++) {
+            if (strcmp(item, flag_names[k]) != 0) continue;
+            *regs |= 1 << SR_F;
+            *mask |= (uint64_t)(1 << k) << (8 * SR_F);
+            found = true;
+        }
+        if (!found) {
+            fprintf(stderr, "superopt: unknown register or flag '%s'\n", item);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int parse_hex(int argc, char *argv[], int first, uint8_t *code, size_t *len) {
+    int nibbles = 0;
+    *len = 0;
+    for (int i = first; i < argc; i++) {
+        for (const char *p = argv[i]; *p; p++) {
+            if (isspace((unsigned char)*p)) continue;
+            if (!isxdigit((unsigned char)*p) || *len == SNIPPET_MAX) return -1;
+            int v = isdigit((unsigned char)*p) ? *p - '0' : tolower((unsigned char)*p) - 'a' + 10;
+            if (nibbles++ % 2 == 0) code[*len] = (uint8_t)(v << 4);
+            else code[(*len)++] |= (uint8_t)v;
+        }
+    }
+    return nibbles % 2 == 0 && *len > 0 ? 0 : -1;
+}
+
+static void print_code(const uint8_t *code, size_t len) {
+    uint8_t buf[SNIPPET_MAX + 8] = {0};
+    char text[32];
+    memcpy(buf, code, len);
+    for (size_t pc = 0; pc < len;) {
+        int n = z80_disasm(buf, (uint16_t)pc, text, sizeof(text));
+        printf("%s%s", pc ? " ; " : "", text);
+        pc += n > 0 ? n : 1;
+    }
+}
+
+static int cmp_found(const void *a, const void *b) {
+    const found *x = a, *y = b;
+    if (x->cycles != y->cycles) return x->cycles - y->cycles;
+    if (x->bytes != y->bytes) return x->bytes - y->bytes;
+    if (x->n != y->n) return x->n - y->n;
+    return memcmp(x->seq, y->seq, x->n * sizeof(uint16_t));
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] <hex bytes of reference>\n", prog);
+    fprintf(stderr, "  --in REGS   Live on entry, e.g. a,b,cf (default: all)\n");
+    fprintf(stderr, "  --out REGS  Live on exit, e.g. a,zf (default: whatever the reference\n");
+    fprintf(stderr, "              writes; f = the documented flags)\n");
+    fprintf(stderr, "  -n N        Longest candidate in instructions (default %d, max %d)\n",
+            DEFAULT_LEN, MAX_LEN);
+    fprintf(stderr, "  -t N        Test states (default %d)\n", DEFAULT_TESTS);
+    fprintf(stderr, "  -k N        Show the N best candidates (default %d)\n", DEFAULT_TOP);
+    fprintf(stderr, "  -j N        Threads (default: one per CPU)\n");
+    fprintf(stderr, "  -s SEED     Random seed for the test states\n");
+    fprintf(stderr, "Registers: a f b c d e h l; flags: sf zf yf hf xf pf nf cf\n");
+    fprintf(stderr, "Example: %s --in a --out a CB 27 CB 27   (sla a ; sla a)\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    const char *in_spec = NULL, *out_spec = NULL;
+    int top = DEFAULT_TOP;
+    int i = 1;
+
+    for (; i < argc; i++) {
+        if (strcmp(argv[i], "--in") == 0 && i + 1 < argc) in_spec = argv[++i];
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) out_spec = argv[++i];
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) max_len = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) test_count = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) top = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) nthreads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) rng = strtoull(argv[++i], NULL, 0) | 1;
+        else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else break;
+    }
+
+    uint8_t ref[SNIPPET_MAX];
+    size_t ref_len;
+    if (i == argc || parse_hex(argc, argv, i, ref, &ref_len) < 0 ||
+        max_len < 1 || max_len > MAX_LEN || test_count < PROBE_STATES) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (nthreads <= 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = n > 0 ? (int)n : 1;
+    }
+
+    tests = calloc(test_count, sizeof(snippet_regs));
+    expect = calloc(test_count, sizeof(snippet_regs));
+    if (!tests || !expect) {
+        perror("superopt");
+        return 1;
+    }
+    make_tests();
+
+    /* Reference: outputs, cost and what it writes */
+    snippet s;
+    snippet_init(&s);
+    snippet_load(&s, ref, ref_len);
+    uint8_t ref_writes = 0;
+    for (int t = 0; t < test_count; t++) {
+        expect[t] = tests[t];
+        int c = snippet_run(&s, &expect[t]);
+        if (c < 0) {
+            fprintf(stderr, "superopt: reference must be straight-line register code "
+                    "(no memory, I/O, branches or HALT)\n");
+            return 1;
+        }
+        if (t > 0 && c != ref_cycles) {
+            fprintf(stderr, "superopt: reference cost varies with the input\n");
+            return 1;
+        }
+        ref_cycles = c;
+        for (int k = 0; k < SR_COUNT; k++) {
+            if (expect[t].r[k] != tests[t].r[k]) ref_writes |= 1 << k;
+        }
+    }
+    ref_bytes = (int)ref_len;
+
+    in_regs = 0xFF;
+    if (in_spec) {
+        uint64_t unused = 0;
+        in_regs = 0;
+        if (parse_regs(in_spec, false, &in_regs, &unused) < 0) return 1;
+    }
+    if (out_spec) {
+        uint8_t unused = 0;
+        if (parse_regs(out_spec, true, &unused, &out_mask) < 0) return 1;
+    } else {
+        for (int k = 0; k < SR_COUNT; k++) {
+            if (ref_writes & (1 << k)) {
+                out_mask |= (uint64_t)(k == SR_F ? F_DOCUMENTED : 0xFF) << (8 * k);
+            }
+        }
+    }
+    if (out_mask == 0) {
+        fprintf(stderr, "superopt: nothing is live on exit\n");
+        return 1;
+    }
+
+    double t0 = now_sec();
+    build_catalogue(ref, ref_len);
+
+    worker *ws = calloc(nthreads, sizeof(worker));
+    if (!ws) {
+        perror("superopt");
+        return 1;
+    }
+    for (int k = 0; k < nthreads; k++) {
+        ws[k].id = k;
+        ws[k].snips = malloc(cat_count * sizeof(snippet));
+        if (!ws[k].snips) {
+            perror("superopt");
+            return 1;
+        }
+        for (int c = 0; c < cat_count; c++) {
+            snippet_init(&ws[k].snips[c]);
+            snippet_load(&ws[k].snips[c], cat[c].bytes, cat[c].len);
+        }
+    }
+
+    double t1 = now_sec();
+    for (int k = 0; k < nthreads; k++) {
+        if (pthread_create(&ws[k].thread, NULL, search_thread, &ws[k]) != 0) {
+            perror("pthread_create");
+            return 1;
+        }
+    }
+    uint64_t evals = 0;
+    size_t total = 0;
+    for (int k = 0; k < nthreads; k++) {
+        pthread_join(ws[k].thread, NULL);
+        evals += ws[k].evals;
+        total += ws[k].hit_count;
+    }
+    double t2 = now_sec();
+
+    found *all = malloc((total ? total : 1) * sizeof(found));
+    if (!all) {
+        perror("superopt");
+        return 1;
+    }
+    total = 0;
+    for (int k = 0; k < nthreads; k++) {
+        memcpy(all + total, ws[k].hits, ws[k].hit_count * sizeof(found));
+        total += ws[k].hit_count;
+    }
+    qsort(all, total, sizeof(found), cmp_found);
+
+    printf("reference  %3d cycles %2d bytes  ", ref_cycles, ref_bytes);
+    print_code(ref, ref_len);
+    printf("\n\n");
+    for (size_t k = 0; k < total && (int)k < top; k++) {
+        printf("%4zu  %3d cycles %2d bytes  ", k + 1, all[k].cycles, all[k].bytes);
+        for (int n = 0; n < all[k].n; n++) {
+            printf("%s%s", n ? " ; " : "", cat[all[k].seq[n]].text);
+        }
+        printf("\n");
+    }
+    if (total == 0) printf("no cheaper equivalent found\n");
+
+    fprintf(stderr, "\n%d instructions in catalogue (%.1f ms), %d test states, %d threads\n",
+            cat_count, (t1 - t0) * 1000.0, test_count, nthreads);
+    fprintf(stderr, "%zu equivalent, %llu evaluations in %.1f ms (%.1f M/s)\n", total,
+            (unsigned long long)evals, (t2 - t1) * 1000.0,
+            t2 > t1 ? evals / (t2 - t1) / 1e6 : 0.0);
+
+    for (int k = 0; k < nthreads; k++) {
+        free(ws[k].snips);
+        free(ws[k].hits);
+    }
+    free(ws);
+    free(all);
+    free(tests);
+    free(expect);
+    return 0;
+}
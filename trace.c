@@ -0,0 +1,256 @@
+/*
+ * Execution Trace Writer
+ * Records one fixed-size entry per instruction and builds per-PC and
+ * per-written-page posting lists while recording, so queries can seek
+ * straight to the blocks that matter.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+#define MAX_STEP_WRITES 4   /* Instruction writes + interrupt PC push */
+
+/* Growable posting list; 'last' avoids duplicate block numbers */
+typedef struct {
+    uint32_t *blocks;
+    uint32_t count;
+    uint32_t cap;
+    uint32_t last;
+} posting;
+
+bool trace_enabled = false;
+
+static FILE *trace_file = NULL;
+static char *index_path = NULL;
+
+static trace_record block_buf[TRACE_BLOCK_RECORDS];
+static uint32_t block_fill = 0;
+static uint32_t block_no = 0;
+static uint64_t nrecords = 0;
+
+static trace_block_span *spans = NULL;
+static uint32_t spans_cap = 0;
+
+static posting pc_post[0x10000];
+static posting page_post[0x100];
+
+/* Current step */
+static trace_record cur;
+static uint16_t step_waddr[MAX_STEP_WRITES];
+static uint8_t step_wval[MAX_STEP_WRITES];
+static int step_nwrites = 0;
+
+static void trace_abort(void);
+
+static void posting_add(posting *p, uint32_t block) {
+    if (!trace_file) return;   /* Aborted earlier in this record */
+    if (p->count && p->last == block) return;
+    if (p->count == p->cap) {
+        uint32_t cap = p->cap ? p->cap * 2 : 16;
+        uint32_t *n = realloc(p->blocks, cap * sizeof(uint32_t));
+        if (!n) {
+            trace_abort();   /* A missing posting would hide real hits */
+            return;
+        }
+        p->blocks = n;
+        p->cap = cap;
+    }
+    p->blocks[p->count++] = block;
+    p->last = block;
+}
+
+/* Out of memory for the index: stop tracing, keep the blocks already
+ * written and skip the index, which could no longer match them */
+static void trace_abort(void) {
+    fprintf(stderr, "Out of memory for trace index; trace stopped, no index written\n");
+    trace_enabled = false;
+    block_fill = 0;
+    fclose(trace_file);
+    trace_file = NULL;
+    for (int i = 0; i < 0x10000; i++) free(pc_post[i].blocks);
+    for (int i = 0; i < 0x100; i++) free(page_post[i].blocks);
+    memset(pc_post, 0, sizeof(pc_post));
+    memset(page_post, 0, sizeof(page_post));
+    free(spans);
+    spans = NULL;
+    spans_cap = 0;
+    free(index_path);
+    index_path = NULL;
+}
+
+static void flush_block(void) {
+    if (block_fill == 0) return;
+
+    if (block_no >= spans_cap) {
+        uint32_t cap = spans_cap ? spans_cap * 2 : 256;
+        trace_block_span *n = realloc(spans, cap * sizeof(*spans));
+        if (!n) {
+            trace_abort();
+            return;
+        }
+        spans = n;
+        spans_cap = cap;
+    }
+    spans[block_no].first_cyc = block_buf[0].cyc;
+    spans[block_no].last_cyc = block_buf[block_fill - 1].cyc;
+
+    fwrite(block_buf, sizeof(trace_record), block_fill, trace_file);
+    block_fill = 0;
+    block_no++;
+}
+
+static void emit(const trace_record *r) {
+    if (!trace_file) return;
+    block_buf[block_fill] = *r;
+
+    if (!(r->flags & TRACE_F_CONT)) {
+        posting_add(&pc_post[r->pc], block_no);
+    }
+    for (int i = 0; i < r->nwrites; i++) {
+        posting_add(&page_post[r->waddr[i] >> 8], block_no);
+    }
+    if (!trace_file) return;
+
+    nrecords++;
+    if (++block_fill == TRACE_BLOCK_RECORDS) {
+        flush_block();
+    }
+}
+
+int trace_open(const char *path) {
+    trace_file = fopen(path, "wb");
+    if (!trace_file) {
+        perror("Failed to open trace file");
+        return -1;
+    }
+    setvbuf(trace_file, NULL, _IOFBF, 1 << 20);
+
+    size_t len = strlen(path);
+    index_path = malloc(len + 5);
+    if (!index_path) {
+        fclose(trace_file);
+        trace_file = NULL;
+        return -1;
+    }
+    memcpy(index_path, path, len);
+    memcpy(index_path + len, ".idx", 5);
+
+    trace_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    hdr.version = TRACE_VERSION;
+    hdr.record_size = sizeof(trace_record);
+    hdr.block_records = TRACE_BLOCK_RECORDS;
+    fwrite(&hdr, sizeof(hdr), 1, trace_file);
+
+    trace_enabled = true;
+    return 0;
+}
+
+void trace_begin(uint64_t cyc, uint16_t pc, const uint8_t *mem) {
+    memset(&cur, 0, sizeof(cur));
+    cur.cyc = cyc;
+    cur.pc = pc;
+    for (int i = 0; i < 4; i++) {
+        cur.op[i] = mem[(uint16_t)(pc + i)];
+    }
+    step_nwrites = 0;
+}
+
+void trace_write(uint16_t addr, uint8_t val) {
+    if (step_nwrites < MAX_STEP_WRITES) {
+        step_waddr[step_nwrites] = addr;
+        step_wval[step_nwrites] = val;
+        step_nwrites++;
+    }
+}
+
+void trace_end(void) {
+    int n = step_nwrites < 2 ? step_nwrites : 2;
+    for (int i = 0; i < n; i++) {
+        cur.waddr[i] = step_waddr[i];
+        cur.wval[i] = step_wval[i];
+    }
+    cur.nwrites = (uint8_t)n;
+    emit(&cur);
+
+    /* Writes beyond two (interrupt push after a write) go in a continuation */
+    if (step_nwrites > 2) {
+        trace_record cont;
+        memset(&cont, 0, sizeof(cont));
+        cont.cyc = cur.cyc;
+        cont.pc = cur.pc;
+        cont.flags = TRACE_F_CONT;
+        for (int i = 2; i < step_nwrites; i++) {
+            cont.waddr[i - 2] = step_waddr[i];
+            cont.wval[i - 2] = step_wval[i];
+        }
+        cont.nwrites = (uint8_t)(step_nwrites - 2);
+        emit(&cont);
+    }
+}
+
+static void write_dir(FILE *f, posting *lists, int n, uint32_t *offset) {
+    for (int i = 0; i < n; i++) {
+        trace_posting_dir d = { *offset, lists[i].count };
+        fwrite(&d, sizeof(d), 1, f);
+        *offset += lists[i].count;
+    }
+}
+
+void trace_close(void) {
+    if (!trace_enabled) return;
+    trace_enabled = false;
+
+    flush_block();
+    if (!trace_file) return;   /* Aborted */
+    fclose(trace_file);
+    trace_file = NULL;
+
+    FILE *f = fopen(index_path, "wb");
+    if (!f) {
+        perror("Failed to write trace index");
+        return;
+    }
+
+    uint32_t npostings = 0;
+    for (int i = 0; i < 0x10000; i++) npostings += pc_post[i].count;
+    for (int i = 0; i < 0x100; i++) npostings += page_post[i].count;
+
+    trace_index_header ih;
+    memset(&ih, 0, sizeof(ih));
+    memcpy(ih.magic, TRACE_INDEX_MAGIC, sizeof(TRACE_INDEX_MAGIC));
+    ih.version = TRACE_VERSION;
+    ih.block_records = TRACE_BLOCK_RECORDS;
+    ih.nrecords = nrecords;
+    ih.nblocks = block_no;
+    ih.npostings = npostings;
+    fwrite(&ih, sizeof(ih), 1, f);
+    fwrite(spans, sizeof(*spans), block_no, f);
+
+    uint32_t offset = 0;
+    write_dir(f, pc_post, 0x10000, &offset);
+    write_dir(f, page_post, 0x100, &offset);
+
+    for (int i = 0; i < 0x10000; i++) {
+        fwrite(pc_post[i].blocks, sizeof(uint32_t), pc_post[i].count, f);
+        free(pc_post[i].blocks);
+    }
+    for (int i = 0; i < 0x100; i++) {
+        fwrite(page_post[i].blocks, sizeof(uint32_t), page_post[i].count, f);
+        free(page_post[i].blocks);
+    }
+    fclose(f);
+
+    memset(pc_post, 0, sizeof(pc_post));
+    memset(page_post, 0, sizeof(page_post));
+    free(spans);
+    spans = NULL;
+    spans_cap = 0;
+    free(index_path);
+    index_path = NULL;
+}
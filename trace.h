@@ -0,0 +1,86 @@
+/*
+ * Execution Trace Writer - Header
+ * Fixed-size per-instruction trace records plus a sidecar index
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define TRACE_MAGIC        "Z80TRC1"
+#define TRACE_INDEX_MAGIC  "Z80TIX1"
+#define TRACE_VERSION      1
+#define TRACE_BLOCK_RECORDS 4096   /* Records per index block */
+
+/* Record flags */
+#define TRACE_F_CONT  0x01  /* Continuation: extra writes of the previous step */
+
+/* One executed instruction (24 bytes on disk, host byte order) */
+typedef struct {
+    uint64_t cyc;        /* T-state count before the instruction */
+    uint16_t pc;
+    uint16_t waddr[2];   /* Addresses written (valid up to nwrites) */
+    uint8_t  op[4];      /* Opcode bytes at pc */
+    uint8_t  wval[2];    /* Values written */
+    uint8_t  nwrites;
+    uint8_t  flags;
+    uint8_t  reserved[2];
+} trace_record;
+
+/* Trace file header, followed by the records */
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t block_records;
+    uint32_t reserved;
+} trace_header;
+
+/* Index file (<trace>.idx) layout:
+ *   trace_index_header
+ *   nblocks x { uint64 first_cyc, uint64 last_cyc }
+ *   65536 x { uint32 offset, uint32 count }  - per-PC posting lists
+ *   256 x   { uint32 offset, uint32 count }  - per-written-page posting lists
+ *   uint32 postings[]                         - ascending block numbers
+ * Block b starts at sizeof(trace_header) + b * block_records * record_size.
+ */
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t block_records;
+    uint64_t nrecords;
+    uint32_t nblocks;
+    uint32_t npostings;
+} trace_index_header;
+
+typedef struct {
+    uint32_t offset;
+    uint32_t count;
+} trace_posting_dir;
+
+typedef struct {
+    uint64_t first_cyc;
+    uint64_t last_cyc;
+} trace_block_span;
+
+/* Open trace file (index goes to <path>.idx on close) */
+int trace_open(const char *path);
+
+/* Per-step hooks: begin before z80_step(), write from the memory callback */
+void trace_begin(uint64_t cyc, uint16_t pc, const uint8_t *mem);
+void trace_write(uint16_t addr, uint8_t val);
+void trace_end(void);
+
+/* Flush the last block and write the index */
+void trace_close(void);
+
+/* Nonzero while a trace is being recorded */
+extern bool trace_enabled;
+
+#endif /* TRACE_H */
@@ -0,0 +1,260 @@
+/*
+ * Trace Query Tool
+ * Answers PC, written-address and cycle-window queries against a trace
+ * recorded with 'retroshield -t', seeking only to indexed blocks.
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "trace.h"
+#include "z80_disasm.h"
+
+enum query_kind { Q_PC, Q_WRITE, Q_CYCLES };
+
+static FILE *trace_f;
+static trace_header th;
+static trace_index_header ih;
+static trace_block_span *spans;
+static trace_posting_dir pc_dir[0x10000];
+static trace_posting_dir page_dir[0x100];
+static long postings_base;
+static FILE *index_f;
+
+static uint8_t scratch[0x10000];  /* Opcode bytes for z80_disasm() */
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s <trace> <query> [options]\n", prog);
+    fprintf(stderr, "Queries:\n");
+    fprintf(stderr, "  pc ADDR            Every execution of ADDR\n");
+    fprintf(stderr, "  write LO[-HI]      Every write to an address in LO..HI\n");
+    fprintf(stderr, "  cycles FROM TO     Every instruction in the cycle window\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --from CYC         Ignore records before CYC\n");
+    fprintf(stderr, "  --to CYC           Ignore records after CYC\n");
+    fprintf(stderr, "  -n COUNT           Stop after COUNT hits (0 = all)\n");
+}
+
+static int open_trace(const char *path) {
+    trace_f = fopen(path, "rb");
+    if (!trace_f) {
+        perror("Failed to open trace");
+        return -1;
+    }
+    if (fread(&th, sizeof(th), 1, trace_f) != 1 ||
+        memcmp(th.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 ||
+        th.record_size != sizeof(trace_record)) {
+        fprintf(stderr, "%s: not a trace file\n", path);
+        return -1;
+    }
+
+    char idx_path[1024];
+    snprintf(idx_path, sizeof(idx_path), "%s.idx", path);
+    index_f = fopen(idx_path, "rb");
+    if (!index_f) {
+        perror("Failed to open trace index");
+        return -1;
+    }
+    if (fread(&ih, sizeof(ih), 1, index_f) != 1 ||
+        memcmp(ih.magic, TRACE_INDEX_MAGIC, sizeof(TRACE_INDEX_MAGIC)) != 0) {
+        fprintf(stderr, "%s: not a trace index\n", idx_path);
+        return -1;
+    }
+
+    spans = malloc((ih.nblocks ? ih.nblocks : 1) * sizeof(*spans));
+    if (!spans ||
+        fread(spans, sizeof(*spans), ih.nblocks, index_f) != ih.nblocks ||
+        fread(pc_dir, sizeof(pc_dir), 1, index_f) != 1 ||
+        fread(page_dir, sizeof(page_dir), 1, index_f) != 1) {
+        fprintf(stderr, "%s: truncated index\n", idx_path);
+        return -1;
+    }
+    postings_base = ftell(index_f);
+    return 0;
+}
+
+/* Read one posting list from the index; NULL if it is unreadable or
+ * names a block the index does not have */
+static uint32_t *read_postings(const trace_posting_dir *d) {
+    uint32_t *v = malloc((d->count ? d->count : 1) * sizeof(uint32_t));
+    if (!v) return NULL;
+    fseek(index_f, postings_base + (long)d->offset * sizeof(uint32_t), SEEK_SET);
+    if (fread(v, sizeof(uint32_t), d->count, index_f) != d->count) {
+        fprintf(stderr, "Trace index: truncated posting list\n");
+        free(v);
+        return NULL;
+    }
+    for (uint32_t k = 0; k < d->count; k++) {
+        if (v[k] >= ih.nblocks) {
+            fprintf(stderr, "Trace index: posting for block %u of %u\n", v[k], ih.nblocks);
+            free(v);
+            return NULL;
+        }
+    }
+    return v;
+}
+
+/* First block whose last cycle is >= cyc */
+static uint32_t block_at_cycle(uint64_t cyc) {
+    uint32_t lo = 0, hi = ih.nblocks;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (spans[mid].last_cyc < cyc) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+static void print_record(const trace_record *r) {
+    char buf[64];
+    for (int i = 0; i < 4; i++) {
+        scratch[(uint16_t)(r->pc + i)] = r->op[i];
+    }
+
+    if (r->flags & TRACE_F_CONT) {
+        printf("%12llu  %04X  %-11s %-20s", (unsigned long long)r->cyc,
+               r->pc, "", "(interrupt)");
+    } else {
+        int len = z80_disasm(scratch, r->pc, buf, sizeof(buf));
+        char bytes[16] = "";
+        for (int i = 0; i < len && i < 4; i++) {
+            snprintf(bytes + i * 3, sizeof(bytes) - i * 3, "%02X ", r->op[i]);
+        }
+        printf("%12llu  %04X  %-11s %-20s", (unsigned long long)r->cyc,
+               r->pc, bytes, buf);
+    }
+    for (int i = 0; i < r->nwrites; i++) {
+        printf(" [%04X]=%02X", r->waddr[i], r->wval[i]);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 4) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const char *path = argv[1];
+    const char *kind_str = argv[2];
+    enum query_kind kind;
+    uint32_t lo = 0, hi = 0;
+    uint64_t from = 0, to = UINT64_MAX;
+    unsigned long limit = 0;
+    int i = 3;
+
+    if (strcmp(kind_str, "pc") == 0) {
+        kind = Q_PC;
+        lo = hi = (uint32_t)strtoul(argv[i++], NULL, 0) & 0xFFFF;
+    } else if (strcmp(kind_str, "write") == 0) {
+        kind = Q_WRITE;
+        char *end;
+        lo = (uint32_t)strtoul(argv[i++], &end, 0) & 0xFFFF;
+        hi = (*end == '-') ? (uint32_t)strtoul(end + 1, NULL, 0) & 0xFFFF : lo;
+        if (hi < lo) { uint32_t t = lo; lo = hi; hi = t; }
+    } else if (strcmp(kind_str, "cycles") == 0 && argc >= 5) {
+        kind = Q_CYCLES;
+        from = strtoull(argv[i++], NULL, 0);
+        to = strtoull(argv[i++], NULL, 0);
+    } else {
+        usage(argv[0]);
+        return 1;
+    }
+
+    for (; i < argc; i++) {
+        if (strcmp(argv[i], "--from") == 0 && i + 1 < argc) {
+            from = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--to") == 0 && i + 1 < argc) {
+            to = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            limit = strtoul(argv[++i], NULL, 0);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (open_trace(path) < 0) {
+        return 1;
+    }
+
+    /* Candidate blocks: posting list (merged for page ranges) or window */
+    uint32_t *blocks = NULL;
+    uint32_t nblocks = 0;
+    if (kind == Q_PC) {
+        blocks = read_postings(&pc_dir[lo]);
+        if (!blocks) return 1;
+        nblocks = pc_dir[lo].count;
+    } else if (kind == Q_WRITE) {
+        /* Mark blocks touched by any page in range, then collect in order */
+        uint8_t *hit = calloc(ih.nblocks ? ih.nblocks : 1, 1);
+        blocks = malloc((ih.nblocks ? ih.nblocks : 1) * sizeof(uint32_t));
+        if (!hit || !blocks) return 1;
+        for (uint32_t pg = lo >> 8; pg <= hi >> 8; pg++) {
+            uint32_t *p = read_postings(&page_dir[pg]);
+            if (!p) return 1;
+            for (uint32_t k = 0; k < page_dir[pg].count; k++) hit[p[k]] = 1;
+            free(p);
+        }
+        for (uint32_t b = 0; b < ih.nblocks; b++) {
+            if (hit[b]) blocks[nblocks++] = b;
+        }
+        free(hit);
+    } else {
+        uint32_t first = block_at_cycle(from);
+        blocks = malloc((ih.nblocks ? ih.nblocks : 1) * sizeof(uint32_t));
+        if (!blocks) return 1;
+        for (uint32_t b = first; b < ih.nblocks && spans[b].first_cyc <= to; b++) {
+            blocks[nblocks++] = b;
+        }
+    }
+
+    trace_record *buf = malloc(ih.block_records * sizeof(trace_record));
+    if (!buf) return 1;
+
+    unsigned long hits = 0;
+    for (uint32_t k = 0; k < nblocks; k++) {
+        uint32_t b = blocks[k];
+        if (spans[b].last_cyc < from) continue;
+        if (spans[b].first_cyc > to) break;
+
+        long off = (long)sizeof(trace_header) +
+                   (long)b * ih.block_records * sizeof(trace_record);
+        fseek(trace_f, off, SEEK_SET);
+        size_t n = fread(buf, sizeof(trace_record), ih.block_records, trace_f);
+
+        for (size_t r = 0; r < n; r++) {
+            const trace_record *rec = &buf[r];
+            if (rec->cyc < from || rec->cyc > to) continue;
+
+            bool match = false;
+            if (kind == Q_PC) {
+                match = rec->pc == lo && !(rec->flags & TRACE_F_CONT);
+            } else if (kind == Q_WRITE) {
+                for (int w = 0; w < rec->nwrites; w++) {
+                    if (rec->waddr[w] >= lo && rec->waddr[w] <= hi) match = true;
+                }
+            } else {
+                match = true;
+            }
+
+            if (match) {
+                print_record(rec);
+                if (limit && ++hits >= limit) goto done;
+            }
+        }
+    }
+
+done:
+    free(buf);
+    free(blocks);
+    free(spans);
+    fclose(index_f);
+    fclose(trace_f);
+    return 0;
+}
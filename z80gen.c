@@ -0,0 +1,603 @@
+/*
+ * Z80 Handler Generator
+ * Reads the instruction description table (z80_ops.tbl) and emits the
+ * interpreter dispatch functions that z80.c includes. Each engine is one
+ * emit function, so new dispatch strategies are produced from the same
+ * table and can be benchmarked against each other:
+ *
+ *   switch  one switch per decoding group (the original layout)
+ *   table   one function per opcode, dispatched through const call tables
+ *
+ * Copyright (c) 2025 Alex Jokela
+ * SPDX-License-Identifier: MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+
+#define MAX_ROWS 1024
+#define SPEC_DEFAULT 9   /* Specificity of "default": loses to everything */
+
+typedef struct {
+    int group;
+    char opcode[32];
+    int cycles;
+    char flags[9];
+    char mnemonic[48];
+    char *body;
+    int line;
+} row;
+
+typedef struct {
+    int row;    /* -1 = not described */
+    int spec;   /* Number of pattern bits; lower wins */
+} slot;
+
+typedef struct {
+    const char *name;       /* Group name in the table */
+    const char *func;       /* Dispatcher defined for z80.c */
+    const char *comment;
+    const char *params;     /* Extra handler parameters */
+    const char *args;       /* Extra handler arguments */
+    const char *extra;      /* Extra parameter name, for unused checks */
+    bool inc_r;
+} group_info;
+
+static const group_info groups[] = {
+    {"00", "exec_opcode", "executes a non-prefixed opcode", "", "", NULL, true},
+    {"cb", "exec_opcode_cb", "executes a CB opcode", "", "", NULL, true},
+    {"ed", "exec_opcode_ed", "executes a ED opcode", "", "", NULL, true},
+    {"ddfd", "exec_opcode_ddfd", "executes a DD/FD opcode (IZ = IX or IY)",
+     ", uint16_t* const iz", ", iz", "iz", true},
+    {"ddcb", "exec_opcode_dcb", "executes a displaced CB opcode (DDCB or FDCB)",
+     ", uint16_t addr", ", addr", "addr", false},
+};
+#define NGROUPS (int)(sizeof(groups) / sizeof(groups[0]))
+
+static const char *reg_names[8] = {"b", "c", "d", "e", "h", "l", "(hl)", "a"};
+static const char *reg_lvalues[8] = {"z->b", "z->c", "z->d", "z->e", "z->h", "z->l", "", "z->a"};
+static const char *rot_names[8] = {"rlc", "rrc", "rl", "rr", "sla", "sra", "sll", "srl"};
+
+static row rows[MAX_ROWS];
+static int nrows = 0;
+static slot slots[8][256];
+static const char *tbl_path;
+
+static void fail(int line, const char *msg, const char *arg) {
+    fprintf(stderr, "%s:%d: %s%s%s\n", tbl_path, line, msg, arg ? ": " : "", arg ? arg : "");
+    exit(1);
+}
+
+/* ---------- Parsing ---------- */
+
+static char *append_line(char *body, const char *line) {
+    size_t old = body ? strlen(body) : 0;
+    char *n = realloc(body, old + strlen(line) + 2);
+    if (!n) {
+        perror("z80gen");
+        exit(1);
+    }
+    if (old) {
+        n[old] = '\n';
+        strcpy(n + old + 1, line);
+    } else {
+        strcpy(n, line);
+    }
+    return n;
+}
+
+static void parse_row(char *s, int lineno) {
+    row *r = &rows[nrows];
+    char group[16];
+    int used = 0;
+
+    if (nrows == MAX_ROWS) fail(lineno, "too many rows", NULL);
+    memset(r, 0, sizeof(*r));
+    r->line = lineno;
+
+    if (sscanf(s, "%15s %31s %d %8s %n", group, r->opcode, &r->cycles, r->flags, &used) != 4) {
+        fail(lineno, "expected: group opcode cycles flags \"mnemonic\" body", NULL);
+    }
+    r->group = -1;
+    for (int g = 0; g < NGROUPS; g++) {
+        if (strcmp(group, groups[g].name) == 0) r->group = g;
+    }
+    if (r->group < 0) fail(lineno, "unknown group", group);
+    if (strlen(r->flags) != 8) fail(lineno, "flags must have 8 columns", r->flags);
+
+    s += used;
+    if (*s != '"') fail(lineno, "mnemonic must be quoted", NULL);
+    char *end = strchr(s + 1, '"');
+    if (!end || end - s - 1 >= (long)sizeof(r->mnemonic)) fail(lineno, "bad mnemonic", NULL);
+    memcpy(r->mnemonic, s + 1, end - s - 1);
+
+    s = end + 1;
+    while (isspace((unsigned char)*s)) s++;
+    if (*s) r->body = append_line(NULL, s);
+    nrows++;
+}
+
+static void parse_table(FILE *f) {
+    char line[1024];
+    int lineno = 0;
+    row *cur = NULL;
+
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '#') continue;
+
+        char *s = line;
+        while (isspace((unsigned char)*s)) s++;
+        if (*s == '\0') {
+            cur = NULL;
+            continue;
+        }
+        if (s == line) {
+            parse_row(line, lineno);
+            cur = &rows[nrows - 1];
+            continue;
+        }
+        /* Continuation: keep indentation beyond the first 8 columns */
+        if (!cur) fail(lineno, "indented line outside a row", NULL);
+        s = line;
+        for (int i = 0; i < 8 && *s == ' '; i++) s++;
+        cur->body = append_line(cur->body, s);
+    }
+}
+
+/* ---------- Expansion ---------- */
+
+static void assign(int ri, int code, int spec) {
+    slot *sl = &slots[rows[ri].group][code];
+    if (sl->row >= 0 && sl->spec == spec) {
+        char msg[64];
+        snprintf(msg, sizeof(msg), "opcode %02X also described at line %d", code, rows[sl->row].line);
+        fail(rows[ri].line, msg, NULL);
+    }
+    if (sl->row < 0 || spec < sl->spec) {
+        sl->row = ri;
+        sl->spec = spec;
+    }
+}
+
+static void expand_rows(void) {
+    for (int g = 0; g < NGROUPS; g++) {
+        for (int c = 0; c < 256; c++) slots[g][c].row = -1;
+    }
+
+    for (int ri = 0; ri < nrows; ri++) {
+        const char *op = rows[ri].opcode;
+
+        if (strcmp(op, "default") == 0) {
+            for (int c = 0; c < 256; c++) assign(ri, c, SPEC_DEFAULT);
+        } else if (strlen(op) == 8 && strspn(op, "01yr") == 8) {
+            int mask = 0, bits = 0, spec = 0;
+            for (int i = 0; i < 8; i++) {
+                int bit = 7 - i;
+                if (op[i] == '0' || op[i] == '1') {
+                    mask |= 1 << bit;
+                    bits |= (op[i] - '0') << bit;
+                } else {
+                    spec++;
+                }
+            }
+            for (int c = 0; c < 256; c++) {
+                if ((c & mask) == bits) assign(ri, c, spec);
+            }
+        } else {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%s", op);
+            for (char *t = strtok(buf, ","); t; t = strtok(NULL, ",")) {
+                char *end;
+                long c = strtol(t, &end, 16);
+                if (*end || c < 0 || c > 255) fail(rows[ri].line, "bad opcode", t);
+                assign(ri, (int)c, 0);
+            }
+        }
+    }
+
+    for (int g = 0; g < NGROUPS; g++) {
+        for (int c = 0; c < 256; c++) {
+            if (slots[g][c].row < 0) {
+                fprintf(stderr, "%s: %s opcode %02X is not described\n",
+                        tbl_path, groups[g].name, c);
+                exit(1);
+            }
+        }
+    }
+}
+
+/* Substitute {y} {r} {R} {rot} for one opcode of a pattern row */
+static char *subst(const char *text, int code) {
+    const int y = (code >> 3) & 7, r = code & 7;
+    char num[2] = {(char)('0' + y), '\0'};
+    size_t cap = strlen(text) * 2 + 64, n = 0;
+    char *out = malloc(cap);
+
+    if (!out) {
+        perror("z80gen");
+        exit(1);
+    }
+    while (*text) {
+        const char *rep = NULL;
+        size_t skip = 0;
+        if (strncmp(text, "{y}", 3) == 0) { rep = num; skip = 3; }
+        else if (strncmp(text, "{r}", 3) == 0) { rep = reg_names[r]; skip = 3; }
+        else if (strncmp(text, "{R}", 3) == 0) { rep = reg_lvalues[r]; skip = 3; }
+        else if (strncmp(text, "{rot}", 5) == 0) { rep = rot_names[y]; skip = 5; }
+
+        if (rep) {
+            size_t len = strlen(rep);
+            if (n + len + 1 >= cap) {
+                cap = cap * 2 + len;
+                out = realloc(out, cap);
+                if (!out) {
+                    perror("z80gen");
+                    exit(1);
+                }
+            }
+            memcpy(out + n, rep, len);
+            n += len;
+            text += skip;
+        } else {
+            if (n + 2 >= cap) {
+                cap *= 2;
+                out = realloc(out, cap);
+                if (!out) {
+                    perror("z80gen");
+                    exit(1);
+                }
+            }
+            out[n++] = *text++;
+        }
+    }
+    out[n] = '\0';
+    return out;
+}
+
+static bool is_pattern(const row *r) {
+    return strspn(r->opcode, "01yr") == 8 && strlen(r->opcode) == 8;
+}
+
+static bool is_default(const row *r) {
+    return strcmp(r->opcode, "default") == 0;
+}
+
+/* ---------- Output helpers ---------- */
+
+/* Print a body indented by 'indent' spaces, one line per table line */
+static void put_body(FILE *out, const char *body, int indent) {
+    const char *p = body;
+    while (*p) {
+        const char *nl = strchr(p, '\n');
+        size_t len = nl ? (size_t)(nl - p) : strlen(p);
+        if (len) fprintf(out, "%*s%.*s\n", indent, "", (int)len, p);
+        else fputc('\n', out);
+        p += len + (nl ? 1 : 0);
+    }
+}
+
+/* A one-line body that doesn't declare anything can follow the case label */
+static bool inline_body(const char *body) {
+    static const char *decls[] = {"const ", "uint8_t ", "uint16_t ", "int ", "bool ", NULL};
+    if (strchr(body, '\n')) return false;
+    for (int i = 0; decls[i]; i++) {
+        if (strncmp(body, decls[i], strlen(decls[i])) == 0) return false;
+    }
+    return true;
+}
+
+static void emit_cycles(FILE *out) {
+    for (int g = 0; g < NGROUPS; g++) {
+        fprintf(out, "static const uint8_t cyc_%s[256] = {", groups[g].name);
+        for (int c = 0; c < 256; c++) {
+            if (c % 16 == 0) fprintf(out, "\n   ");
+            fprintf(out, " %d,", rows[slots[g][c].row].cycles);
+        }
+        fprintf(out, "\n};\n\n");
+    }
+}
+
+/* The flags column as three masks per opcode: bits left alone, forced to
+ * 1 and forced to 0. '*' and '.' put the bit in none of them. */
+static void flag_masks(const char *flags, int *keep, int *set, int *clear) {
+    *keep = *set = *clear = 0;
+    for (int i = 0; i < 8; i++) {
+        int bit = 1 << (7 - i);
+        if (flags[i] == '-') *keep |= bit;
+        else if (flags[i] == '1') *set |= bit;
+        else if (flags[i] == '0') *clear |= bit;
+    }
+}
+
+/* Built with -DZ80_CHECK_FLAGS, every dispatcher checks F against its row */
+static void emit_flags(FILE *out) {
+    fprintf(out, "#ifdef Z80_CHECK_FLAGS\n");
+    fprintf(out, "typedef struct { uint8_t keep, set, clear; } flag_effect;\n\n");
+    for (int g = 0; g < NGROUPS; g++) {
+        fprintf(out, "static const flag_effect flags_%s[256] = {", groups[g].name);
+        for (int c = 0; c < 256; c++) {
+            int keep, set, clear;
+            flag_masks(rows[slots[g][c].row].flags, &keep, &set, &clear);
+            if (c % 8 == 0) fprintf(out, "\n   ");
+            fprintf(out, " {0x%02X,0x%02X,0x%02X},", keep, set, clear);
+        }
+        fprintf(out, "\n};\n\n");
+    }
+    fprintf(out, "static void check_flags(z80* const z, const char* group, uint8_t opcode,\n");
+    fprintf(out, "    uint8_t before, flag_effect e) {\n");
+    fprintf(out, "  const uint8_t f = get_f(z);\n");
+    fprintf(out, "  if (((f ^ before) & e.keep) || (f & e.set) != e.set || (f & e.clear)) {\n");
+    fprintf(out, "    fprintf(stderr, \"z80: %%s %%02X at %%04X left F %%02X -> %%02X, \"\n");
+    fprintf(out, "        \"against z80_ops.tbl\\n\", group, opcode, z->pc, before, f);\n");
+    fprintf(out, "    abort();\n");
+    fprintf(out, "  }\n");
+    fprintf(out, "}\n");
+    fprintf(out, "#endif\n\n");
+}
+
+static void emit_prologue(FILE *out, int g) {
+    const group_info *gi = &groups[g];
+    fprintf(out, "// %s\n", gi->comment);
+    fprintf(out, "void %s(z80* const z, uint8_t opcode%s) {\n", gi->func, gi->params);
+    fprintf(out, "#ifdef Z80_CHECK_FLAGS\n  const uint8_t f_in = get_f(z);\n#endif\n");
+    fprintf(out, "  z->cyc += cyc_%s[opcode];\n", gi->name);
+    if (gi->inc_r) fprintf(out, "  inc_r(z);\n");
+}
+
+static void emit_epilogue(FILE *out, int g) {
+    fprintf(out, "#ifdef Z80_CHECK_FLAGS\n");
+    fprintf(out, "  check_flags(z, \"%s\", opcode, f_in, flags_%s[opcode]);\n",
+            groups[g].name, groups[g].name);
+    fprintf(out, "#endif\n");
+}
+
+static void emit_iz_macros(FILE *out) {
+    fprintf(out, "#define IZD displace(z, *iz, nextb(z))\n");
+    fprintf(out, "#define IZH (*iz >> 8)\n");
+    fprintf(out, "#define IZL (*iz & 0xFF)\n\n");
+}
+
+static void emit_iz_undef(FILE *out) {
+    fprintf(out, "#undef IZD\n#undef IZH\n#undef IZL\n\n");
+}
+
+/* ---------- Engine: switch ---------- */
+
+static void emit_case_body(FILE *out, const char *body, const char *mnemonic) {
+    if (!body) {
+        fprintf(out, " break; // %s\n", mnemonic);
+    } else if (inline_body(body)) {
+        fprintf(out, " %s break; // %s\n", body, mnemonic);
+    } else {
+        fprintf(out, " {\n");
+        put_body(out, body, 4);
+        fprintf(out, "  } break; // %s\n", mnemonic);
+    }
+}
+
+static void emit_switch_group(FILE *out, int g) {
+    int default_row = -1;
+
+    emit_prologue(out, g);
+    fprintf(out, "\n");
+    if (strcmp(groups[g].name, "ddfd") == 0) emit_iz_macros(out);
+    fprintf(out, "  switch (opcode) {\n");
+
+    for (int ri = 0; ri < nrows; ri++) {
+        const row *r = &rows[ri];
+        if (r->group != g) continue;
+        if (is_default(r)) {
+            default_row = ri;
+            continue;
+        }
+
+        if (is_pattern(r)) {
+            for (int c = 0; c < 256; c++) {
+                if (slots[g][c].row != ri) continue;
+                char *body = r->body ? subst(r->body, c) : NULL;
+                char *mn = subst(r->mnemonic, c);
+                fprintf(out, "  case 0x%02X:", c);
+                emit_case_body(out, body, mn);
+                free(body);
+                free(mn);
+            }
+            continue;
+        }
+
+        /* Fixed opcodes share one body */
+        bool first = true;
+        for (int c = 0; c < 256; c++) {
+            if (slots[g][c].row != ri) continue;
+            if (!first) fprintf(out, "\n");
+            fprintf(out, "  case 0x%02X:", c);
+            first = false;
+        }
+        if (!first) emit_case_body(out, r->body, r->mnemonic);
+    }
+
+    for (int c = 0; c < 256 && default_row >= 0; c++) {
+        if (slots[g][c].row == default_row) {
+            fprintf(out, "\n  default:");
+            emit_case_body(out, rows[default_row].body, rows[default_row].mnemonic);
+            break;
+        }
+    }
+    fprintf(out, "  }\n");
+    emit_epilogue(out, g);
+    if (strcmp(groups[g].name, "ddfd") == 0) {
+        fprintf(out, "\n");
+        emit_iz_undef(out);
+    }
+    fprintf(out, "}\n\n");
+}
+
+static void emit_switch(FILE *out) {
+    for (int g = 0; g < NGROUPS; g++) emit_switch_group(out, g);
+}
+
+/* ---------- Engine: call table ---------- */
+
+static void handler_name(char *buf, size_t len, int g, int c) {
+    const row *r = &rows[slots[g][c].row];
+    int first = c;
+
+    /* Rows with several fixed opcodes share the handler of the first one */
+    if (!is_pattern(r) && !is_default(r)) {
+        for (first = 0; slots[g][first].row != slots[g][c].row; first++) {}
+    }
+    snprintf(buf, len, "op_%s_%02X", groups[g].name, first);
+}
+
+/* True if the body refers to the CPU argument */
+static bool uses_cpu(const char *body) {
+    return body && (strstr(body, "z->") || strstr(body, "(z") || strstr(body, "z,") ||
+                    strstr(body, "IZD"));
+}
+
+static void emit_handler(FILE *out, int g, int c, const char *body, const char *mnemonic) {
+    const group_info *gi = &groups[g];
+    char name[32];
+
+    handler_name(name, sizeof(name), g, c);
+    fprintf(out, "static void %s(z80* const z%s) { // %s\n", name, gi->params, mnemonic);
+    if (!uses_cpu(body)) fprintf(out, "  (void)z;\n");
+    if (gi->extra && (!body || (!strstr(body, gi->extra) && !strstr(body, "IZ")))) {
+        fprintf(out, "  (void)%s;\n", gi->extra);
+    }
+    if (body && is_default(&rows[slots[g][c].row]) && strstr(body, "opcode")) {
+        fprintf(out, "  const uint8_t opcode = 0x%02X;\n", c);
+    }
+    if (body) put_body(out, body, 2);
+    fprintf(out, "}\n\n");
+}
+
+static void emit_table_group(FILE *out, int g) {
+    const group_info *gi = &groups[g];
+    char name[32];
+
+    if (strcmp(gi->name, "ddfd") == 0) emit_iz_macros(out);
+
+    for (int c = 0; c < 256; c++) {
+        const row *r = &rows[slots[g][c].row];
+        char hn[32];
+        handler_name(hn, sizeof(hn), g, c);
+        snprintf(name, sizeof(name), "op_%s_%02X", gi->name, c);
+        if (strcmp(hn, name) != 0) continue;   /* Shared, already emitted */
+
+        if (is_pattern(r)) {
+            char *body = r->body ? subst(r->body, c) : NULL;
+            char *mn = subst(r->mnemonic, c);
+            emit_handler(out, g, c, body, mn);
+            free(body);
+            free(mn);
+        } else {
+            emit_handler(out, g, c, r->body, r->mnemonic);
+        }
+    }
+
+    fprintf(out, "static void (*const ops_%s[256])(z80* const%s) = {",
+            gi->name, strcmp(gi->name, "ddfd") == 0 ? ", uint16_t* const" :
+                      strcmp(gi->name, "ddcb") == 0 ? ", uint16_t" : "");
+    for (int c = 0; c < 256; c++) {
+        handler_name(name, sizeof(name), g, c);
+        fprintf(out, "%s%s,", c % 6 == 0 ? "\n   " : " ", name);
+    }
+    fprintf(out, "\n};\n\n");
+
+    emit_prologue(out, g);
+    fprintf(out, "  ops_%s[opcode](z%s);\n", gi->name, gi->args);
+    emit_epilogue(out, g);
+    fprintf(out, "}\n\n");
+    if (strcmp(gi->name, "ddfd") == 0) emit_iz_undef(out);
+}
+
+static void emit_table(FILE *out) {
+    for (int g = 0; g < NGROUPS; g++) emit_table_group(out, g);
+}
+
+/* ---------- Main ---------- */
+
+static const struct {
+    const char *name;
+    void (*emit)(FILE *);
+} engines[] = {
+    {"switch", emit_switch},
+    {"table", emit_table},
+    {NULL, NULL}
+};
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-e ENGINE] [-o OUT] <z80_ops.tbl>\n", prog);
+    fprintf(stderr, "  -e ENGINE   Dispatch engine: switch (default), table\n");
+    fprintf(stderr, "  -o OUT      Output file (default: stdout)\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *engine = "switch";
+    const char *out_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) engine = argv[++i];
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) out_path = argv[++i];
+        else if (argv[i][0] != '-' && !tbl_path) tbl_path = argv[i];
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!tbl_path) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int e;
+    for (e = 0; engines[e].name; e++) {
+        if (strcmp(engines[e].name, engine) == 0) break;
+    }
+    if (!engines[e].name) {
+        fprintf(stderr, "Unknown engine: %s\n", engine);
+        return 1;
+    }
+
+    FILE *f = fopen(tbl_path, "r");
+    if (!f) {
+        perror(tbl_path);
+        return 1;
+    }
+    parse_table(f);
+    fclose(f);
+    expand_rows();
+
+    /* Write to a temporary name so a failed run never leaves a stale file */
+    char tmp[1024];
+    FILE *out = stdout;
+    if (out_path) {
+        snprintf(tmp, sizeof(tmp), "%s.tmp", out_path);
+        out = fopen(tmp, "w");
+        if (!out) {
+            perror(tmp);
+            return 1;
+        }
+    }
+
+    fprintf(out, "// Generated from %s by z80gen (engine: %s) - do not edit\n\n", tbl_path, engine);
+    emit_cycles(out);
+    emit_flags(out);
+    engines[e].emit(out);
+
+    if (out_path) {
+        if (fclose(out) != 0 || rename(tmp, out_path) != 0) {
+            perror(out_path);
+            return 1;
+        }
+    }
+    return 0;
+}